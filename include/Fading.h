@@ -24,31 +24,151 @@
 
 #include "Singleton.h"
 #include <vector>
+#include <stdint.h>
+#include <cstddef>
 #include <pthread.h>
 using namespace std;
 
+// number of sinusoids in each of the in-phase and quadrature components of a Fading::Channel
+#define FADING_SINUSOIDS	8
+
 namespace Urae {
 
 	/* class Fading
 	 * This is a class which reads in two randomly sampled gaussian component lists from a file and uses them to calculate Rayleigh and Rician fading
 	 * The format of these files is identical to the component files used in Qualnet
+	 * Without a file, the components are generated as they are needed.
+	 * The lists are never changed once read. Samples are drawn through streams, each of which walks the lists in its own
+	 * random order, so any number of threads can calculate fading at once without locking.
+	 * Channels give fading correlated in time, following the Doppler spread of the moving hosts.
+	 * Fading addressed by a pair of hosts and a time slot is independent from slot to slot, and needs no streams.
 	 */
 	class Fading : public Singleton<Fading> {
 	public:
 		typedef vector<double> GaussianList;
-		
+
+		/* class Fading::Stream
+		 * A sequence of fading samples. Each pass visits every component once, stepping through each list with its
+		 * own random start and stride, which are chosen afresh for the next pass. Without lists, the components are
+		 * drawn from the stream's own generator by the Box-Muller transform. A stream belongs to one caller.
+		 */
+		class Stream {
+		public:
+			Stream();
+			Stream(const Fading *pFading, uint64_t streamId);
+			double CalculateFading(int classification, double kFactor = 0);
+
+			/*
+			 * Method: void CalculateFading( int classification, double kFactor, size_t count, double *pOut );
+			 * Description: Fills pOut with the next count samples, as count calls of the above would.
+			 */
+			void CalculateFading(int classification, double kFactor, size_t count, double *pOut);
+		protected:
+			void NextComponents(size_t count, double *pC1, double *pC2);
+			void NextPass();
+			uint64_t NextRandom();
+			const Fading *m_pFading;
+			uint64_t mState;
+			unsigned int mPosition[2];
+			unsigned int mStride[2];
+			unsigned int mRemaining;
+		};
+
+		/* class Fading::Channel
+		 * Fading correlated in time, for one transmitter/receiver pair: the sum-of-sinusoids model of Zheng and Xiao,
+		 * whose in-phase and quadrature components are unit variance Gaussians with the autocorrelation of Clarke's model.
+		 * The samples are a function of the seed, the channel ID and the time alone.
+		 */
+		class Channel {
+		public:
+			Channel();
+			Channel(int seed, uint64_t channelId);
+
+			/*
+			 * Method: double CalculateFading( int classification, double kFactor, double time, double dopplerFrequency ) const;
+			 * Description: The fading at the given time (in s), for the given maximum Doppler frequency (in Hz).
+			 */
+			double CalculateFading(int classification, double kFactor, double time, double dopplerFrequency) const;
+
+			/*
+			 * Method: void CalculateFading( int classification, double kFactor, double startTime, double interval, ... ) const;
+			 * Description: Fills pOut with the fading at count times, interval apart. The sinusoids are stepped by rotating
+			 * 				their phasors, so a frame costs little more than a single sample.
+			 */
+			void CalculateFading(int classification, double kFactor, double startTime, double interval, double dopplerFrequency, size_t count, double *pOut) const;
+		protected:
+			double mFrequency[2*FADING_SINUSOIDS];		// in-phase, then quadrature, as fractions of the maximum Doppler frequency
+			double mPhase[2*FADING_SINUSOIDS];
+		};
+
+		/*
+		 * Method: Fading( const char* componentsFile, int seed );
+		 * Description: Reads the gaussian components from the given file, or generates them if it is NULL or empty.
+		 */
 		Fading(const char* componentsFile, int seed);
 		~Fading();
+
+		/*
+		 * Method: double CalculateFading( int classification, double kFactor );
+		 * Description: Draws a sample from the calling thread's own stream, which is created on its first call.
+		 */
 		double CalculateFading(int classification, double kFactor = 0);
+
+		/*
+		 * Method: void CalculateFading( int classification, double kFactor, size_t count, double *pOut );
+		 * Description: Fills pOut with count samples from the calling thread's own stream.
+		 */
+		void CalculateFading(int classification, double kFactor, size_t count, double *pOut);
+
+		/*
+		 * Method: double CalculateFading( int classification, double kFactor, uint32_t txId, uint32_t rxId, uint64_t slot ) const;
+		 * Description: Independent fading for a pair of hosts in a time slot. Each sample is a function of the seed, the
+		 * 				host IDs and the slot alone, from a counter-based generator, so it is the same whatever order or
+		 * 				thread it is calculated in. Swap the IDs into a fixed order for fading that is the same both ways.
+		 */
+		double CalculateFading(int classification, double kFactor, uint32_t txId, uint32_t rxId, uint64_t slot) const;
+
+		/*
+		 * Method: void CalculateFading( int classification, double kFactor, uint32_t txId, uint32_t rxId, uint64_t firstSlot, ... ) const;
+		 * Description: Fills pOut with the above for count slots from firstSlot.
+		 */
+		void CalculateFading(int classification, double kFactor, uint32_t txId, uint32_t rxId, uint64_t firstSlot, size_t count, double *pOut) const;
+
+		/*
+		 * Method: Stream CreateStream( uint64_t streamId ) const;
+		 * Description: Creates a stream for one caller. The samples depend only on the seed and the stream ID.
+		 */
+		Stream CreateStream(uint64_t streamId) const { return Stream(this, streamId); }
+
+		/*
+		 * Method: Channel CreateChannel( uint64_t channelId ) const;
+		 * Description: Creates the time correlated fading of a channel, e.g. one identified by its pair of hosts.
+		 */
+		Channel CreateChannel(uint64_t channelId) const { return Channel(mSeed, channelId); }
+
 	protected:
-		pthread_mutex_t mListMutex;
 		GaussianList mComponents1;
 		GaussianList mComponents2;
 		int mSamplingRate;
 		int mBaseDopplerFrequency;
-		int mNumGaussianComponents;
-		int mCurrentIndex;
-		void SetArrayIdx();
+		int mNumGaussianComponents;				// 0 if the components are generated
+		int mSeed;
+
+		/*
+		 * Method: void LoadComponents( const char* componentsFile );
+		 * Description: Reads the gaussian component lists from the given file.
+		 */
+		void LoadComponents(const char* componentsFile);
+
+		/*
+		 * Method: Stream *GetThreadStream();
+		 * Description: Get the calling thread's stream, creating it on its first call.
+		 */
+		Stream *GetThreadStream();
+
+		pthread_key_t mThreadStreamKey;			// the calling thread's stream
+		pthread_mutex_t mThreadStreamMutex;		// only taken to create a thread's stream
+		vector<Stream*> mThreadStreams;			// every thread's stream, in the order they were created
 
 	};
 
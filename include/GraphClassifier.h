@@ -0,0 +1,166 @@
+/*
+ *  GraphClassifier.h - Classifies link pairs from the road graph when the classification file has no entry for them.
+ *  Copyright (C) 2012  C. S. Cooper, A. Mukunthan
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contact Details: Cooper - andor734@gmail.com
+ */
+
+#pragma once
+
+#include "VectorMath.h"
+#include "UraeData.h"
+#include <stdint.h>
+#include <pthread.h>
+#include <unordered_map>
+#include <vector>
+
+namespace Urae {
+
+	/*
+	 * Name: GraphClassifier
+	 * Inherits: None
+	 * Description: Computes the CORNER classifications of summed links from the nodes and links of the road network.
+	 * 				Links meeting nearly head on at a node continue the same street. Two links on the same street are
+	 * 				in LOS, links on streets which cross at a junction are in NLOS1, and links on streets joined by a
+	 * 				third street are in NLOS2. Of the routes found, the one with the lowest classification and then
+	 * 				the fewest nodes is used, filling in the same fields as the classification file.
+	 * 				The classifications of a link are found with one search along the streets from it, which goes
+	 * 				no further than the range from the link. Each link's are computed the first time they are asked
+	 * 				for and kept in a cache which may be used from several threads at once.
+	 */
+	class GraphClassifier {
+
+	public:
+
+		/*
+		 * Method: GraphClassifier( UraeData *pData, VectorMath::Real range );
+		 * Description: Builds the streets of the given network. Links further apart than range are out of range.
+		 */
+		GraphClassifier( UraeData *pData, VectorMath::Real range );
+		virtual ~GraphClassifier();
+
+		/*
+		 * Method: bool Classify( const VectorMath::OrderedIndexPair &linkPair, UraeData::ClassificationRecord *pRecord );
+		 * Description: Writes the classification of the given pair of summed links to pRecord, computing the classifications
+		 * 				of the first link if they are not in the cache. Returns false if the links are out of range.
+		 */
+		bool Classify( const VectorMath::OrderedIndexPair &linkPair, UraeData::ClassificationRecord *pRecord );
+
+		/*
+		 * Method: void ClassifyFrom( int link, std::vector<int32_t> *pOthers, std::vector<UraeData::ClassificationRecord> *pRecords ) const;
+		 * Description: Appends the links not less than the given one which are in range of it, in ascending order, and their classifications.
+		 */
+		void ClassifyFrom( int link, std::vector<int32_t> *pOthers, std::vector<UraeData::ClassificationRecord> *pRecords ) const;
+
+		/*
+		 * Method: void ClassifyAll( unsigned int threads, std::vector<uint64_t> *pRowOffsets, std::vector<int32_t> *pOthers, std::vector<UraeData::ClassificationRecord> *pRecords );
+		 * Description: Classifies every link with ClassifyFrom, sharing the links between the given number of threads,
+		 * 				and fills in a table of compressed rows, one per link. The table is the same whatever the thread count.
+		 */
+		void ClassifyAll( unsigned int threads, std::vector<uint64_t> *pRowOffsets, std::vector<int32_t> *pOthers, std::vector<UraeData::ClassificationRecord> *pRecords );
+
+		/*
+		 * Method: size_t GetCachedLinkCount();
+		 * Description: Get the number of links whose classifications are in the cache.
+		 */
+		size_t GetCachedLinkCount();
+
+		/*
+		 * Method: VectorMath::Real GetRange() const;
+		 * Description: Get the distance beyond which links are out of range.
+		 */
+		VectorMath::Real GetRange() const { return mRange; }
+
+	protected:
+
+		/*
+		 * Name: StreetNode
+		 * Description: A node reached by following a street, the number of nodes passed to get there
+		 * 				(counting this one) and the link on which it was reached. A route may only turn at a node in range.
+		 */
+		struct StreetNode {
+			int mNode;
+			int mNodeCount;
+			int mLink;
+			bool mInRange;
+		};
+
+		typedef std::vector<StreetNode> StreetNodeList;
+
+		/*
+		 * Name: Row
+		 * Description: Classifications of one link, as ClassifyFrom gives them.
+		 */
+		struct Row {
+			std::vector<int32_t> mOthers;
+			std::vector<UraeData::ClassificationRecord> mRecords;
+		};
+
+		/*
+		 * Method: void ComputeContinuations();
+		 * Description: Finds the link which continues the street of each summed link at each of its ends.
+		 */
+		void ComputeContinuations();
+
+		/*
+		 * Method: int GetContinuation( int link, int node ) const;
+		 * Description: Returns the link continuing the street of the given link through the given end node, or -1.
+		 */
+		int GetContinuation( int link, int node ) const;
+
+		/*
+		 * Method: VectorMath::LineSegment GetSegment( int link ) const;
+		 * Description: Get the line between the nodes of the given summed link.
+		 */
+		VectorMath::LineSegment GetSegment( int link ) const;
+
+		/*
+		 * Method: void WalkStreet( int link, int node, VectorMath::LineSegment from, StreetNodeList *pNodes ) const;
+		 * Description: Appends the nodes reached by following the street of the given link through the given end node,
+		 * 				up to and including the first node further than the range from the given line.
+		 */
+		void WalkStreet( int link, int node, VectorMath::LineSegment from, StreetNodeList *pNodes ) const;
+
+		/*
+		 * Method: static void *ClassifierThread( void *pArg );
+		 * Description: Worker thread of ClassifyAll, which takes links until every one has been classified.
+		 */
+		static void *ClassifierThread( void *pArg );
+
+		/*
+		 * Name: CacheShard
+		 * Description: Part of the cache, with its own lock so that threads asking for different links rarely wait.
+		 */
+		struct CacheShard {
+			pthread_mutex_t mMutex;
+			std::unordered_map<int,Row*> mRows;
+		};
+
+		enum { ShardCount = 64 };
+
+		UraeData *m_pData;
+		VectorMath::Real mRange;
+		std::vector<int32_t> mContinuations;				// link continuing each summed link at its node A end, then node B end
+		CacheShard mShards[ShardCount];
+
+		std::vector<Row> *m_pAllRows;						// rows being filled by ClassifyAll
+		int mNextLink;										// next link for a ClassifyAll thread to take
+		pthread_mutex_t mNextLinkMutex;						// guards mNextLink
+
+	};
+
+
+};
@@ -0,0 +1,125 @@
+/*
+ *  PathlossBatch.h - Classifies and calculates the pathloss of many transmitter/receiver pairs at once.
+ *  Copyright (C) 2012  C. S. Cooper, A. Mukunthan
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contact Details: Cooper - andor734@gmail.com
+ */
+
+#pragma once
+
+#include "VectorMath.h"
+#include "UraeData.h"
+#include <vector>
+
+namespace Urae {
+
+	/*
+	 * Name: PathlossBatch
+	 * Inherits: None
+	 * Description: Classifies many transmitter/receiver pairs, refines their classifications by position,
+	 * 				and calculates their CORNER pathloss and K-factors, giving the same results as
+	 * 				GetClassification, RefineClassification and Classifier::CalculatePathloss would one pair at a time.
+	 * 				The pairs are grouped by state and each group is run through one of the PathlossKernels, so the
+	 * 				pathloss agrees with the Classifier to within rounding (exactly, with the Scalar instruction set).
+	 * 				The scratch space is kept between calls, so reusing a batch does not allocate.
+	 */
+	class PathlossBatch {
+
+	public:
+
+		/*
+		 * Method: PathlossBatch( bool refine );
+		 * Description: Uses the UraeData singleton. If refine is false, the classifications are used as they are in the table.
+		 */
+		PathlossBatch( bool refine = true );
+		virtual ~PathlossBatch();
+
+		/*
+		 * Method: void Calculate( size_t count, const int *pTxLinks, const int *pRxLinks, ..., VectorMath::Real *pK );
+		 * Description: Calculates count pairs, given their summed links, positions and lanes. The lanes may be NULL
+		 * 				for lane 0. The state, pathloss (in mW) and K-factor of each pair are written to the output arrays;
+		 * 				pK may be NULL to skip the K-factors, which are 0 for pairs not in LOS.
+		 */
+		void Calculate( size_t count, const int *pTxLinks, const int *pRxLinks, const VectorMath::Vector2D *pTxPos, const VectorMath::Vector2D *pRxPos,
+						const int *pTxLanes, const int *pRxLanes, int *pStates, VectorMath::Real *pPathloss, VectorMath::Real *pK );
+
+		/*
+		 * Method: void CalculateForRoads( size_t count, const UraeData::RoadId *pTxRoads, const UraeData::RoadId *pRxRoads, ... );
+		 * Description: As Calculate, given the road IDs of the pairs, so vehicles may be on internal links.
+		 */
+		void CalculateForRoads( size_t count, const UraeData::RoadId *pTxRoads, const UraeData::RoadId *pRxRoads, const VectorMath::Vector2D *pTxPos, const VectorMath::Vector2D *pRxPos,
+								const int *pTxLanes, const int *pRxLanes, int *pStates, VectorMath::Real *pPathloss, VectorMath::Real *pK );
+
+		/*
+		 * Method: void CalculateFromTransmitter( int txLink, const VectorMath::Vector2D &txPos, int txLane, size_t count, const int *pRxLinks, ... );
+		 * Description: As Calculate, for one transmitter and many receivers, whose positions are given as separate
+		 * 				arrays of x and y. pRxLanes may be NULL for lane 0.
+		 */
+		void CalculateFromTransmitter( int txLink, const VectorMath::Vector2D &txPos, int txLane, size_t count, const int *pRxLinks,
+									   const VectorMath::Real *pRxX, const VectorMath::Real *pRxY, const int *pRxLanes,
+									   int *pStates, VectorMath::Real *pPathloss, VectorMath::Real *pK );
+
+		/*
+		 * Method: void CalculateFromTransmitterForRoads( const UraeData::RoadId &txRoad, const VectorMath::Vector2D &txPos, int txLane, size_t count, ... );
+		 * Description: As CalculateFromTransmitter, given the road IDs of the transmitter and receivers.
+		 */
+		void CalculateFromTransmitterForRoads( const UraeData::RoadId &txRoad, const VectorMath::Vector2D &txPos, int txLane, size_t count, const UraeData::RoadId *pRxRoads,
+											   const VectorMath::Real *pRxX, const VectorMath::Real *pRxY, const int *pRxLanes,
+											   int *pStates, VectorMath::Real *pPathloss, VectorMath::Real *pK );
+
+		/*
+		 * Method: const UraeData::Classification &GetClassification( size_t index ) const;
+		 * Description: Get the (refined) classification of the given pair of the last calculation.
+		 */
+		const UraeData::Classification &GetClassification( size_t index ) const { return mClassifications[index]; }
+
+	protected:
+
+		/*
+		 * Method: void CalculateClassified( size_t count, const VectorMath::Vector2D *pTxPos, ..., VectorMath::Real *pK );
+		 * Description: Refines the classifications of the pairs, groups them by state and calculates each group.
+		 */
+		void CalculateClassified( size_t count, const VectorMath::Vector2D *pTxPos, const VectorMath::Vector2D *pRxPos,
+								  const int *pTxLanes, const int *pRxLanes, int *pStates, VectorMath::Real *pPathloss, VectorMath::Real *pK );
+
+		/*
+		 * Method: void SetTransmitter( const VectorMath::Vector2D &txPos, int txLane, size_t count, const VectorMath::Real *pRxX, const VectorMath::Real *pRxY );
+		 * Description: Fills the pair positions and transmitter lanes for one transmitter and count receivers.
+		 */
+		void SetTransmitter( const VectorMath::Vector2D &txPos, int txLane, size_t count, const VectorMath::Real *pRxX, const VectorMath::Real *pRxY );
+
+		/*
+		 * Method: VectorMath::Real *Scratch( int array, size_t count );
+		 * Description: Get one of the scratch arrays, with room for count values.
+		 */
+		VectorMath::Real *Scratch( int array, size_t count );
+
+		enum { ScratchCount = 8 };
+
+		UraeData *m_pData;
+		bool mRefine;
+
+		std::vector<UraeData::Classification> mClassifications;		// classification of each pair
+		std::vector<size_t> mOrder;									// pairs ordered by state
+		std::vector<VectorMath::Real> mScratch[ScratchCount];		// per group inputs and outputs of the loops
+		std::vector<VectorMath::Vector2D> mTxPos;					// positions and transmitter lanes of the pairs,
+		std::vector<VectorMath::Vector2D> mRxPos;					// when there is one transmitter
+		std::vector<int> mTxLanes;
+
+	};
+
+
+};
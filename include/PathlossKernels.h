@@ -0,0 +1,135 @@
+/*
+ *  PathlossKernels.h - Loops calculating the CORNER pathloss of many pairs, with vector versions chosen at run time.
+ *  Copyright (C) 2012  C. S. Cooper, A. Mukunthan
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contact Details: Cooper - andor734@gmail.com
+ */
+
+#pragma once
+
+#include "VectorMath.h"
+#include <cstddef>
+
+namespace Urae {
+
+	/*
+	 * Name: PathlossConstants
+	 * Description: Parameters of the scenario used by the pathloss loops.
+	 */
+	struct PathlossConstants {
+		VectorMath::Real mLambdaBy4PiSq;
+		VectorMath::Real mWavelength;
+		VectorMath::Real mLossPerReflection;
+		const VectorMath::Real *m_pReflectionLoss;		// loss per reflection to the power 2n (UraeData::GetReflectionLossTable), or NULL
+		size_t mReflectionLossCount;
+	};
+
+	/*
+	 * Name: PathlossKernels
+	 * Inherits: None
+	 * Description: The LOS, NLOS1 and NLOS2 formulas of Classifier::CalculatePathloss as loops over arrays, one value
+	 * 				per pair. Each has a scalar version, which gives exactly the same results as the Classifier, and
+	 * 				SSE2 and AVX2 versions, which do too while the reflection counts are within the table of
+	 * 				reflection losses, and otherwise agree with it to within rounding. The best the CPU supports
+	 * 				is chosen the first time a kernel is used. Single precision builds have only the scalar versions.
+	 */
+	class PathlossKernels {
+
+	public:
+
+		enum InstructionSet {
+			Scalar = 0,
+			SSE2,
+			AVX2
+		};
+
+		/*
+		 * Method: static InstructionSet GetInstructionSet();
+		 * Description: Get the instruction set the kernels are using.
+		 */
+		static InstructionSet GetInstructionSet();
+
+		/*
+		 * Method: static bool SetInstructionSet( InstructionSet set );
+		 * Description: Use the given instruction set, e.g. Scalar for results identical to the Classifier.
+		 * 				Returns false, and changes nothing, if the CPU does not support it.
+		 */
+		static bool SetInstructionSet( InstructionSet set );
+
+		/*
+		 * Method: static const char *GetInstructionSetName( InstructionSet set );
+		 * Description: Get the name of the given instruction set.
+		 */
+		static const char *GetInstructionSetName( InstructionSet set );
+
+		/*
+		 * Method: static void Los( size_t n, const VectorMath::Real *pDistSq, const PathlossConstants &k, VectorMath::Real *pOut );
+		 * Description: Pathloss of pairs in line of sight, given the squared distances between them.
+		 */
+		static void Los( size_t n, const VectorMath::Real *pDistSq, const PathlossConstants &k, VectorMath::Real *pOut );
+
+		/*
+		 * Method: static void Nlos1( size_t n, const VectorMath::Real *pRm2, const VectorMath::Real *pRs2, ..., VectorMath::Real *pOut );
+		 * Description: Pathloss of pairs around one corner, given the squared distances of the source and destination
+		 * 				from the corner and the widths of the main and side streets.
+		 */
+		static void Nlos1( size_t n, const VectorMath::Real *pRm2, const VectorMath::Real *pRs2, const VectorMath::Real *pWm, const VectorMath::Real *pWs,
+						   const PathlossConstants &k, VectorMath::Real *pOut );
+
+		/*
+		 * Method: static void Nlos2( size_t n, const VectorMath::Real *pRm2, const VectorMath::Real *pRs2, const VectorMath::Real *pRp2, ..., VectorMath::Real *pOut );
+		 * Description: Pathloss of pairs on parallel streets, given the squared distance of the source from the first corner,
+		 * 				between the corners, and of the destination from the second corner, and the widths of the three streets.
+		 */
+		static void Nlos2( size_t n, const VectorMath::Real *pRm2, const VectorMath::Real *pRs2, const VectorMath::Real *pRp2,
+						   const VectorMath::Real *pWm, const VectorMath::Real *pWs, const VectorMath::Real *pWp,
+						   const PathlossConstants &k, VectorMath::Real *pOut );
+
+	protected:
+
+		typedef void (*LosKernel)( size_t, const VectorMath::Real*, const PathlossConstants&, VectorMath::Real* );
+		typedef void (*Nlos1Kernel)( size_t, const VectorMath::Real*, const VectorMath::Real*, const VectorMath::Real*, const VectorMath::Real*,
+									 const PathlossConstants&, VectorMath::Real* );
+		typedef void (*Nlos2Kernel)( size_t, const VectorMath::Real*, const VectorMath::Real*, const VectorMath::Real*,
+									 const VectorMath::Real*, const VectorMath::Real*, const VectorMath::Real*,
+									 const PathlossConstants&, VectorMath::Real* );
+
+		/*
+		 * Method: static bool IsSupported( InstructionSet set );
+		 * Description: Returns true if the CPU (and this build) supports the given instruction set.
+		 */
+		static bool IsSupported( InstructionSet set );
+
+		/*
+		 * Method: static void Select();
+		 * Description: Chooses the best supported instruction set. Run once, before a kernel is first used.
+		 */
+		static void Select();
+
+		/*
+		 * Method: static void Use( InstructionSet set );
+		 * Description: Points the kernels at the versions for the given instruction set.
+		 */
+		static void Use( InstructionSet set );
+
+		static InstructionSet mInstructionSet;
+		static LosKernel m_pLos;
+		static Nlos1Kernel m_pNlos1;
+		static Nlos2Kernel m_pNlos2;
+
+	};
+
+};
@@ -0,0 +1,451 @@
+/*
+ *  RiceData.h - Indexed storage for the pre-computed K-factors of a road network.
+ *  Copyright (C) 2012  C. S. Cooper, A. Mukunthan
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contact Details: Cooper - andor734@gmail.com
+ */
+
+#pragma once
+
+#include "Singleton.h"
+#include "VectorMath.h"
+#include <stdint.h>
+#include <pthread.h>
+#include <cstdio>
+#include <iostream>
+#include <list>
+#include <string>
+#include <vector>
+
+#define RICE_FILE_MAGIC		"URAEKBIN"		// first eight bytes of a binary K-factor file
+#define RICE_FILE_VERSION	1
+#define RICE_LOG8_MIN		1e-3			// smallest non-zero K-factor of the 8-bit log-scale encoding
+#define RICE_LOG8_MAX		1e4				// largest finite K-factor of the 8-bit log-scale encoding
+
+namespace Urae {
+
+	class TextParser;
+
+	/*
+	 * Name: RiceData
+	 * Inherits: None
+	 * Description: Flat storage for the pre-computed K-factors. This keeps the nesting of the
+	 * 				Raytracer output (source link -> location -> lane -> destination link -> location -> lane),
+	 * 				but each level is one contiguous array indexed through a table of prefix offsets:
+	 * 					-> mLinkLocations[l]..mLinkLocations[l+1] are the locations of source link l
+	 * 					-> mLocationLanes[p]..mLocationLanes[p+1] are the lanes of location p
+	 * 					-> mLaneDestinations[n]..mLaneDestinations[n+1] are the destinations of lane n
+	 * 					-> mDestinationLinks[d] is the (ascending) link index of destination d
+	 * 					-> mDestinationLocations[d]..mDestinationLocations[d+1] are the locations of destination d
+	 * 					-> mLocationValues[q]..mLocationValues[q+1] are the K-factors of destination location q
+	 * 				The arrays are either parsed from the text .urae.k format into memory, or mapped
+	 * 				read-only from the binary .urae.k format, which is the same arrays on disk.
+	 * 				Either way a lookup is a handful of array indexings and one binary search.
+	 * 				The K-factors themselves may be stored at reduced precision (see ValueFormat),
+	 * 				since the fading only needs a couple of significant digits.
+	 * 				A binary file may also be paged rather than mapped: only the source link table is
+	 * 				kept resident, and the block of each source link is read the first time GetK needs it
+	 * 				and kept in an LRU cache with a byte budget. All levels of one source link are
+	 * 				contiguous in every section, so a block is one read per section.
+	 */
+	class RiceData {
+
+	public:
+
+		/*
+		 * Name: FileHeader
+		 * Description: The header at the start of a binary K-factor file.
+		 */
+		struct FileHeader {
+			char mMagic[8];						// always RICE_FILE_MAGIC
+			uint32_t mVersion;					// format version, RICE_FILE_VERSION
+			uint32_t mValueFormat;				// encoding of the K-factors (see ValueFormat)
+			double mIncrement;					// distance between K-factor calculations along the links
+			uint64_t mLinkCount;				// number of entries in the source link table
+			uint64_t mLocationCount;			// number of source locations
+			uint64_t mLaneCount;				// number of source lanes
+			uint64_t mDestinationCount;			// number of destination links
+			uint64_t mDestLocationCount;		// number of destination locations
+			uint64_t mValueCount;				// number of K-factors
+			uint64_t mSectionOffset[7];			// byte offset of each section from the start of the file
+		};
+
+		/*
+		 * Name: Section
+		 * Description: Enumerates the sections of the binary file, in file order.
+		 */
+		enum Section {
+			LinkLocations = 0,
+			LocationLanes,
+			LaneDestinations,
+			DestinationLinks,
+			DestinationLocations,
+			LocationValues,
+			Values,
+			SectionCount
+		};
+
+		/*
+		 * Name: ValueFormat
+		 * Description: Enumerates the encodings of the K-factors in the Values section.
+		 */
+		enum ValueFormat {
+			Float64 = 0,		// 8-byte doubles, DBL_MAX for an infinite K-factor
+			Float16,			// IEEE half precision, +infinity for an infinite K-factor, saturating at 65504
+			Log8				// 0 is Rayleigh, 255 is infinite, and 1..254 are spaced logarithmically over [RICE_LOG8_MIN,RICE_LOG8_MAX]
+		};
+
+		/*
+		 * Name: Writer
+		 * Inherits: None
+		 * Description: Writes a binary K-factor file from a stream of nested entries.
+		 * 				The sections are spooled to temporary files, so the whole data set
+		 * 				never has to be held in memory. Source links and the destination links
+		 * 				of each source lane must be given in ascending order.
+		 */
+		class Writer {
+
+		public:
+			Writer( const char *filename, VectorMath::Real increment, ValueFormat format = Float64 );
+			~Writer();
+
+			void BeginLink( int linkIndex );
+			void BeginLocation();
+			void BeginLane();
+			void BeginDestination( int linkIndex );
+			void BeginDestinationLocation();
+			void AddValue( double k );
+
+			/*
+			 * Method: void Finish();
+			 * Description: Writes the header and the spooled sections to the output file.
+			 */
+			void Finish();
+
+			/*
+			 * Method: void Finish( FILE *pOut );
+			 * Description: Writes the header and the spooled sections at the current position of the given file,
+			 * 				which must be a multiple of 8 bytes. The section offsets are relative to that position.
+			 */
+			void Finish( FILE *pOut );
+
+		protected:
+			std::string mFilename;
+			FileHeader mHeader;
+			FILE *m_pSections[SectionCount];
+			int64_t mNextLink;
+			int64_t mLastDestination;
+
+		private:
+			Writer( const Writer& );
+			Writer &operator=( const Writer& );
+
+		};
+
+		RiceData();
+		~RiceData();
+
+		/*
+		 * Method: static bool IsBinaryFile( const char *filename );
+		 * Description: Returns true if the given file starts with the binary K-factor header.
+		 */
+		static bool IsBinaryFile( const char *filename );
+
+		/*
+		 * Method: void Map( const char *filename );
+		 * Description: Maps the given binary K-factor file read-only.
+		 */
+		void Map( const char *filename );
+
+		/*
+		 * Method: void MapRegion( const void *pBase, size_t size, const char *name );
+		 * Description: Uses a binary K-factor file which is already in memory, e.g. as part of a larger mapping.
+		 * 				The memory is not owned, and must outlive this object or the next Unload.
+		 */
+		void MapRegion( const void *pBase, size_t size, const char *name );
+
+		/*
+		 * Method: void Page( const char *filename, size_t cacheBytes, ValueFormat format );
+		 * Description: Opens the given binary K-factor file for paging, keeping at most about cacheBytes
+		 * 				of source link blocks in memory. Blocks are re-encoded to the given format as they are read.
+		 */
+		void Page( const char *filename, size_t cacheBytes, ValueFormat format = Float64 );
+
+		/*
+		 * Method: void LoadText( const char *filename, ValueFormat format );
+		 * Description: Parses the text K-factor output of the Raytracer into memory.
+		 */
+		void LoadText( const char *filename, ValueFormat format = Float64 );
+
+		/*
+		 * Method: void Load( const char *filename, ValueFormat format, size_t cacheBytes );
+		 * Description: Maps the file if it is binary, otherwise parses it as text.
+		 * 				The K-factors are kept in the given format, so a file in any other
+		 * 				format is re-encoded into memory rather than mapped.
+		 * 				If cacheBytes is not 0, a binary file is neither mapped nor re-encoded whole;
+		 * 				it is paged through an LRU cache of about cacheBytes of source link blocks,
+		 * 				each re-encoded as it is read. Text files have no index to page from, so
+		 * 				they are always loaded whole.
+		 */
+		void Load( const char *filename, ValueFormat format = Float64, size_t cacheBytes = 0 );
+
+		/*
+		 * Method: void Unload();
+		 * Description: Releases the mapped file or the parsed tables.
+		 */
+		void Unload();
+
+		/*
+		 * Method: bool IsLoaded();
+		 * Description: Returns true if K-factors have been loaded.
+		 */
+		bool IsLoaded() const { return mLoaded; }
+
+		/*
+		 * Method: size_t GetMemoryUsage();
+		 * Description: Returns the number of bytes used by the tables.
+		 */
+		size_t GetMemoryUsage() const;
+
+		/*
+		 * Method: bool IsPaged();
+		 * Description: Returns true if the source link blocks are read on demand.
+		 */
+		bool IsPaged() const { return mFile >= 0; }
+
+		/*
+		 * Method: void GetCacheStatistics( uint64_t *pHits, uint64_t *pMisses, size_t *pResidentBytes );
+		 * Description: Returns the block cache hits and misses, and the bytes of blocks in memory, when paged.
+		 */
+		void GetCacheStatistics( uint64_t *pHits, uint64_t *pMisses, size_t *pResidentBytes ) const;
+
+		/*
+		 * Method: VectorMath::Real GetIncrement();
+		 * Description: Returns the distance between K-factor calculations along the links.
+		 */
+		VectorMath::Real GetIncrement() const { return mHeader.mIncrement; }
+
+		/*
+		 * Method: ValueFormat GetValueFormat();
+		 * Description: Returns the encoding the K-factors are stored in.
+		 */
+		ValueFormat GetValueFormat() const { return (ValueFormat)mHeader.mValueFormat; }
+
+		/*
+		 * Method: VectorMath::Real GetK( int srcLink, unsigned int srcPos, int srcLane, int destLink, unsigned int destPos, int destLane );
+		 * Description: Get the K-factor for the given indices, or 0 (Rayleigh) if there is no entry.
+		 */
+		VectorMath::Real GetK( int srcLink, unsigned int srcPos, int srcLane, int destLink, unsigned int destPos, int destLane ) const;
+
+		/*
+		 * Method: void Write( const char *filename, ValueFormat format );
+		 * Description: Writes the loaded K-factors to a binary file in the given format.
+		 */
+		void Write( const char *filename, ValueFormat format ) const;
+
+		/*
+		 * Method: void Write( FILE *pOut, ValueFormat format );
+		 * Description: Writes the loaded K-factors in the given format at the current position of the given file.
+		 */
+		void Write( FILE *pOut, ValueFormat format ) const;
+
+		/*
+		 * Method: static void ConvertText( const char *textFile, const char *binaryFile, ValueFormat format );
+		 * Description: Converts the text K-factor output of the Raytracer to the binary format.
+		 */
+		static void ConvertText( const char *textFile, const char *binaryFile, ValueFormat format = Float64 );
+
+		/*
+		 * Method: static uint64_t Merge( const std::vector<std::string> &inputs, const char *outFile, ValueFormat format );
+		 * Description: Merges K-factor files (text or binary), e.g. the per-area outputs of the Raytracer, into one binary file.
+		 * 				The inputs are streamed rather than loaded, and must all have the same increment.
+		 * 				Source links found in several inputs have their destination links combined; where the same
+		 * 				destination appears more than once, the earliest input wins. Returns the number of such overlaps.
+		 */
+		static uint64_t Merge( const std::vector<std::string> &inputs, const char *outFile, ValueFormat format = Float64 );
+
+		/*
+		 * Method: static ValueFormat ParseValueFormat( const char *name );
+		 * Description: Returns the format called "float64", "float16" or "log8".
+		 */
+		static ValueFormat ParseValueFormat( const char *name );
+
+		/*
+		 * Method: static size_t GetValueSize( ValueFormat format );
+		 * Description: Returns the number of bytes taken by one K-factor in the given format.
+		 */
+		static size_t GetValueSize( ValueFormat format );
+
+		/*
+		 * Method: static void EncodeValue( double k, ValueFormat format, void *pOut );
+		 * Description: Stores a K-factor in the given format. pOut must hold GetValueSize( format ) bytes.
+		 */
+		static void EncodeValue( double k, ValueFormat format, void *pOut );
+
+		/*
+		 * Method: static double DecodeValue( const void *pValues, uint64_t index, ValueFormat format );
+		 * Description: Reads the K-factor at the given index of an array in the given format.
+		 */
+		static double DecodeValue( const void *pValues, uint64_t index, ValueFormat format );
+
+	protected:
+
+		/*
+		 * Name: Tables
+		 * Description: Storage for the tables when they are parsed rather than mapped.
+		 */
+		struct Tables {
+			std::vector<uint64_t> mLinkLocations;
+			std::vector<uint64_t> mLocationLanes;
+			std::vector<uint64_t> mLaneDestinations;
+			std::vector<int32_t> mDestinationLinks;
+			std::vector<uint64_t> mDestinationLocations;
+			std::vector<uint64_t> mLocationValues;
+			std::vector<uint8_t> mValues;			// encoded in the format given by the header
+		};
+
+		class TableBuilder;
+
+		/*
+		 * Name: Block
+		 * Description: The slices of each section belonging to one source link, when paged.
+		 * 				The offsets inside are still global, so each slice records the index of its first element.
+		 */
+		struct Block {
+			uint64_t mLocationBase;						// global index of mLocationLanes[0]
+			uint64_t mLaneBase;							// global index of mLaneDestinations[0]
+			uint64_t mDestinationBase;					// global index of mDestinationLinks[0] and mDestinationLocations[0]
+			uint64_t mDestLocationBase;					// global index of mLocationValues[0]
+			uint64_t mValueBase;						// global index of the first value
+			std::vector<uint64_t> mLocationLanes;
+			std::vector<uint64_t> mLaneDestinations;
+			std::vector<int32_t> mDestinationLinks;
+			std::vector<uint64_t> mDestinationLocations;
+			std::vector<uint64_t> mLocationValues;
+			std::vector<uint8_t> mValues;
+			size_t mBytes;								// memory used by the slices
+			std::list<int>::iterator mLruPosition;		// position in the LRU list
+		};
+
+		/*
+		 * Name: TableView
+		 * Description: The arrays a lookup indexes, with the global index of the first element of each.
+		 */
+		struct TableView {
+			const uint64_t *mLocationLanes;
+			const uint64_t *mLaneDestinations;
+			const int32_t *mDestinationLinks;
+			const uint64_t *mDestinationLocations;
+			const uint64_t *mLocationValues;
+			const void *m_pValues;
+			uint64_t mLocationBase, mLaneBase, mDestinationBase, mDestLocationBase, mValueBase;
+		};
+
+		/*
+		 * Method: static double Lookup( const TableView &view, ValueFormat format, uint64_t location, int srcLane, int destLink, unsigned int destPos, int destLane );
+		 * Description: Finds the K-factor below the given source location, or 0 if there is none.
+		 */
+		static double Lookup( const TableView &view, ValueFormat format, uint64_t location, int srcLane, int destLink, unsigned int destPos, int destLane );
+
+		/*
+		 * Method: static bool CheckHeader( const FileHeader &header, uint64_t fileSize );
+		 * Description: Returns true if the header is a supported version and every section lies within the file.
+		 */
+		static bool CheckHeader( const FileHeader &header, uint64_t fileSize );
+
+		/*
+		 * Method: bool CheckOffsets( Section section, uint64_t count, uint64_t total );
+		 * Description: Returns true if a prefix offset table of count entries starts at 0, never decreases,
+		 * 				and ends at the number of records it indexes. A paged file is read in chunks.
+		 */
+		bool CheckOffsets( Section section, uint64_t count, uint64_t total ) const;
+
+		/*
+		 * Method: bool CheckTables();
+		 * Description: Returns true if every prefix offset table of the mapped or paged file is consistent,
+		 * 				so that lookups never index past the sections.
+		 */
+		bool CheckTables() const;
+
+		/*
+		 * Method: void ReadSection( Section section, uint64_t first, uint64_t count, void *pOut );
+		 * Description: Reads count elements of a section of the paged file, starting at the given element.
+		 */
+		void ReadSection( Section section, uint64_t first, uint64_t count, void *pOut ) const;
+
+		/*
+		 * Method: Block *GetBlock( int srcLink );
+		 * Description: Returns the block of the given source link, reading it if it is not cached. Call with mCacheMutex held.
+		 */
+		Block *GetBlock( int srcLink ) const;
+
+		/*
+		 * Method: void ParseText( TextParser &parser, int numRice, const char *filename, Sink &sink );
+		 * Description: Parses the source link entries of a text K-factor file into a Writer or into Tables.
+		 */
+		template <class Sink> static void ParseText( TextParser &parser, int numRice, const char *filename, Sink &sink );
+
+		/*
+		 * Method: void SetTablePointers();
+		 * Description: Points the lookup arrays at the parsed tables.
+		 */
+		void SetTablePointers();
+
+		/*
+		 * Method: void CopyTables( ValueFormat format );
+		 * Description: Copies the mapped arrays into memory, re-encoding the K-factors.
+		 */
+		void CopyTables( ValueFormat format );
+
+		/*
+		 * Method: void CopyInto( Writer &writer );
+		 * Description: Passes every loaded K-factor to the given writer, in file order.
+		 */
+		void CopyInto( Writer &writer ) const;
+
+		FileHeader mHeader;
+		bool mLoaded;
+		void *m_pBase;
+		size_t mMappedSize;
+		bool mOwnsMapping;				// false if m_pBase is part of someone else's mapping
+		Tables mTables;
+
+		const uint64_t *mLinkLocations;
+		const uint64_t *mLocationLanes;
+		const uint64_t *mLaneDestinations;
+		const int32_t *mDestinationLinks;
+		const uint64_t *mDestinationLocations;
+		const uint64_t *mLocationValues;
+		const void *m_pValues;
+
+		// paging
+		int mFile;										// descriptor of the paged file, or -1
+		ValueFormat mFileFormat;						// encoding of the values in the paged file
+		size_t mCacheBudget;							// bytes of blocks to keep in memory
+		std::vector<uint64_t> mLinkTable;				// source link table of the paged file
+		mutable std::vector<Block*> mBlocks;			// cached block of each source link, or NULL
+		mutable std::list<int> mLru;					// cached source links, most recently used first
+		mutable size_t mCacheBytes;
+		mutable uint64_t mCacheHits, mCacheMisses;
+		mutable pthread_mutex_t mCacheMutex;
+
+	private:
+		RiceData( const RiceData& );
+		RiceData &operator=( const RiceData& );
+
+	};
+
+};
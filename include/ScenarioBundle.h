@@ -0,0 +1,194 @@
+/*
+ *  ScenarioBundle.h - Single binary file holding a compiled URAE scenario.
+ *  Copyright (C) 2012  C. S. Cooper, A. Mukunthan
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contact Details: Cooper - andor734@gmail.com
+ */
+
+#pragma once
+
+#include "RiceData.h"
+#include <stdint.h>
+#include <iostream>
+#include <string>
+
+#define BUNDLE_FILE_MAGIC		"URAEBNDL"
+#define BUNDLE_FILE_VERSION		3
+
+namespace Urae {
+
+	class UraeData;
+
+	/*
+	 * Name: ScenarioBundle
+	 * Inherits: None
+	 * Description: Reads and writes a scenario bundle: the nodes, links, classifications, buildings,
+	 * 				link maps, car definitions and K-factors of a scenario in one file, together with
+	 * 				the summed link set, building buckets and link grid that UraeData would otherwise
+	 * 				compute after loading.
+	 * 				The file is a header followed by 8 byte aligned sections of fixed size records, so it
+	 * 				is read with one mmap and no parsing. The K-factors are an embedded binary K-factor file,
+	 * 				used in place; everything else is copied straight into UraeData's containers.
+	 */
+	class ScenarioBundle {
+
+	public:
+
+		/*
+		 * Method: static void Write( UraeData &data, const char *filename, RiceData::ValueFormat riceFormat, VectorMath::Real classRange );
+		 * Description: Writes the loaded and computed scenario to a bundle, with the K-factors in the given format.
+		 * 				classRange is recorded as the range the classifications were pruned to, or 0 if they were not.
+		 */
+		static void Write( UraeData &data, const char *filename, RiceData::ValueFormat riceFormat = RiceData::Float64, VectorMath::Real classRange = 0 );
+
+		/*
+		 * Method: static void Read( UraeData &data, const char *filename );
+		 * Description: Maps the given bundle and fills the (empty) UraeData from it.
+		 */
+		static void Read( UraeData &data, const char *filename );
+
+		/*
+		 * Method: static bool IsBundleFile( const char *filename );
+		 * Description: Returns true if the given file starts with the bundle header.
+		 */
+		static bool IsBundleFile( const char *filename );
+
+		/*
+		 * Method: static void Compile( const char *bundleFile, const char *linksFile, ..., RiceData::ValueFormat riceFormat, unsigned int loaderThreads, VectorMath::Real classRange, std::ostream *pLog );
+		 * Description: Loads the given CORNER files (NULL or "" for any that are not used), computes the summed links,
+		 * 				buckets and grid, and writes them all to a bundle. If classRange is not 0, the classifications between
+		 * 				links further apart than it are left out. The load timings are written to pLog, if given.
+		 * 				The files are loaded into a UraeData of its own, and UraeData::GetSingleton() is left as it was,
+		 * 				though it briefly points at that UraeData, so no other thread should be using it meanwhile.
+		 */
+		static void Compile( const char *bundleFile, const char *linksFile, const char *nodesFile, const char *classFile, const char *buildingFile, const char *linkMapFile, const char *intLinkMapFile, const char *riceDataFile, const char *carDefFile, VectorMath::Real grid, RiceData::ValueFormat riceFormat = RiceData::Float64, unsigned int loaderThreads = 1, VectorMath::Real classRange = 0, std::ostream *pLog = NULL );
+
+		/*
+		 * Method: static std::string Share( const char *name, const char *directory, const char *linksFile, ..., unsigned int loaderThreads, VectorMath::Real classRange );
+		 * Description: Returns the path of the bundle called name in the given directory (e.g. /dev/shm, which is held in memory).
+		 * 				The first process to ask compiles it from the given files, while any others wait on a lock;
+		 * 				after that it is recompiled if one of the files is newer, or if it was compiled with a different
+		 * 				grid, riceFormat or classRange. Every process then loads the
+		 * 				same bundle, and since the classifications and K-factors are used in place from a shared mapping,
+		 * 				the machine holds one copy of them however many processes there are.
+		 * 				The bundle is compiled as by Compile, so UraeData::GetSingleton() is left as it was.
+		 * 				Processes sharing a name should ask for the same settings, or each will recompile it in turn.
+		 */
+		static std::string Share( const char *name, const char *directory, const char *linksFile, const char *nodesFile, const char *classFile, const char *buildingFile, const char *linkMapFile, const char *intLinkMapFile, const char *riceDataFile, const char *carDefFile, VectorMath::Real grid, RiceData::ValueFormat riceFormat = RiceData::Float64, unsigned int loaderThreads = 1, VectorMath::Real classRange = 0 );
+
+		enum Section {
+			Nodes = 0,				// NodeRecord per node
+			NodeLinkOffsets,		// uint64 prefix offsets into NodeLinks, one per node plus one
+			NodeLinks,				// int32 summed link indices connected to each node
+			Links,					// LinkRecord per link
+			SummedLinks,			// LinkRecord per summed link
+			ClassRowOffsets,		// uint64 prefix offsets into ClassOtherLinks and Classifications, one per row plus one
+			ClassOtherLinks,		// int32 other link of each classification, ascending within each row
+			Classifications,		// UraeData::ClassificationRecord per classification
+			Buildings,				// BuildingRecord per building
+			BuildingEdgeOffsets,	// uint64 prefix offsets into BuildingEdges, one per building plus one
+			BuildingEdges,			// EdgeRecord per building edge
+			BucketOffsets,			// uint64 prefix offsets into BucketEntries, one per bucket (x major) plus one
+			BucketEntries,			// int64 building indices in each bucket
+			GridOffsets,			// uint64 prefix offsets into GridEntries, one per grid square (row major) plus one
+			GridEntries,			// int32 summed link indices in each grid square
+			LinkNames,				// NameRecord per link mapping
+			InternalLinkNames,		// NameRecord per internal link mapping
+			CarDefinitions,			// CarRecord per car definition
+			Names,					// characters of all the names
+			KFactors,				// an embedded binary K-factor file (empty if there are none)
+			SectionCount
+		};
+
+	protected:
+
+		/*
+		 * Name: FileHeader
+		 * Description: Start of the bundle. Section offsets are from the start of the file; counts are in records.
+		 */
+		struct FileHeader {
+			char mMagic[8];
+			uint32_t mVersion;
+			uint32_t mRiceFormat;
+			double mGridSize;
+			double mBucketSize;
+			double mLengthIncrement;
+			double mClassRange;					// range the classifications were pruned to, 0 if they were not
+			double mMapRect[4];					// location x, y and size x, y
+			double mCentroid[2];
+			uint32_t mBucketX;
+			uint32_t mBucketY;
+			uint32_t mGridRowCount;
+			uint32_t mGridColumnCount;
+			uint64_t mSectionOffset[SectionCount];
+			uint64_t mSectionCount[SectionCount];
+		};
+
+		struct NodeRecord {
+			int32_t mIndex;
+			int32_t mPadding;
+			double mPosition[2];
+			double mSize;
+		};
+
+		struct LinkRecord {
+			int32_t mIndex;
+			int32_t mNodeA;
+			int32_t mNodeB;
+			int32_t mLaneCount;
+			double mFlow;
+			double mSpeed;
+		};
+
+		struct BuildingRecord {
+			int64_t mId;
+			double mPermitivity;
+			double mMaxHeight;
+			double mHeightStdDev;
+		};
+
+		struct EdgeRecord {
+			double mStart[2];
+			double mEnd[2];
+		};
+
+		struct NameRecord {
+			uint64_t mOffset;					// into the Names section
+			uint32_t mLength;
+			int32_t mIndex;
+		};
+
+		struct CarRecord {
+			uint64_t mNameOffset;
+			uint32_t mNameLength;
+			uint32_t mPadding;
+			double mAcceleration;
+			double mDeceleration;
+			double mDriverImperfection;
+			double mLength;
+			double mWidth;
+			double mHeight;
+		};
+
+		/*
+		 * Method: static bool CheckHeader( const FileHeader &header, uint64_t fileSize );
+		 * Description: Returns true if the header is a supported version and every section lies within the file.
+		 */
+		static bool CheckHeader( const FileHeader &header, uint64_t fileSize );
+
+	};
+
+};
@@ -55,7 +55,7 @@ public:
         	char buffer[200];
         	va_list v;
         	va_start(v, strMessage);
-        	vsprintf( buffer, strMessage.c_str(), v );
+        	vsnprintf( buffer, sizeof(buffer), strMessage.c_str(), v );
         	va_end(v);
         	m_strException = std::string("Exception: ") + std::string(buffer);
 
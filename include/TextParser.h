@@ -0,0 +1,101 @@
+/*
+ *  TextParser.h - Fast tokeniser for the whitespace-separated CORNER and K-factor text files.
+ *  Copyright (C) 2012  C. S. Cooper, A. Mukunthan
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contact Details: Cooper - andor734@gmail.com
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Urae {
+
+	/*
+	 * Name: TextParser
+	 * Inherits: None
+	 * Description: Reads a whole text file with one mmap (or one read, if the file cannot be mapped)
+	 * 				and parses whitespace-separated tokens straight out of the buffer with std::from_chars.
+	 * 				It is a drop-in for the 'stream >> x' parsing of the input files:
+	 * 					-> numbers are read the same way, and a malformed one sets the fail flag and reads as 0
+	 * 					-> once the fail flag is set, every later read gives 0 or an empty token
+	 * 				No memory is allocated per token unless a std::string is asked for.
+	 */
+	class TextParser {
+
+	public:
+		TextParser();
+		~TextParser();
+
+		/*
+		 * Method: bool Open( const char *filename );
+		 * Description: Loads the given file. Returns false if it cannot be read.
+		 */
+		bool Open( const char *filename );
+
+		/*
+		 * Method: void Close();
+		 * Description: Releases the file.
+		 */
+		void Close();
+
+		/*
+		 * Method: bool Fail();
+		 * Description: Returns true if a read has failed, either from a malformed number or the end of the file.
+		 */
+		bool Fail() const { return mFail; }
+
+		/*
+		 * Method: std::string_view ReadToken();
+		 * Description: Reads the next whitespace-separated token. The view is valid until the file is closed.
+		 */
+		std::string_view ReadToken();
+
+		int ReadInt();
+		double ReadDouble();
+
+		TextParser &operator>>( int &value ) { value = ReadInt(); return *this; }
+		TextParser &operator>>( double &value ) { value = ReadDouble(); return *this; }
+		TextParser &operator>>( float &value ) { value = (float)ReadDouble(); return *this; }
+		TextParser &operator>>( std::string &value ) { value = ReadToken(); return *this; }
+
+	protected:
+
+		/*
+		 * Method: bool SkipWhitespace();
+		 * Description: Moves to the start of the next token. Returns false, and fails, at the end of the file.
+		 */
+		bool SkipWhitespace();
+
+		const char *m_pBegin;
+		const char *m_pEnd;
+		const char *m_pPos;
+		bool mFail;
+
+		void *m_pMapped;				// the mapped file, if it could be mapped
+		size_t mMappedSize;
+		std::vector<char> mBuffer;		// otherwise the file is read into here
+
+	private:
+		TextParser( const TextParser& );
+		TextParser &operator=( const TextParser& );
+
+	};
+
+};
@@ -22,6 +22,11 @@
 
 #include "Singleton.h"
 #include "VectorMath.h"
+#include "RiceData.h"
 #include "UraeData.h"
+#include "ScenarioBundle.h"
 #include "Fading.h"
 #include "Classifier.h"
+#include "PathlossKernels.h"
+#include "PathlossBatch.h"
+#include "GraphClassifier.h"
@@ -22,11 +22,25 @@
 
 #include "Singleton.h"
 #include "VectorMath.h"
+#include "RiceData.h"
+#include <stdint.h>
+#include <pthread.h>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 #include <list>
 #include <map>
 
+#define MAX_REFLECTION_LOSSES	4096			// longest table of reflection losses UraeData keeps
+#define LINK_RASTER_CELL_SIZE	10.0			// side of a cell of the link raster in metres, unless the map is very large
+#define LINK_RASTER_MAX_CELLS	4194304			// most cells the link raster may have
+
 namespace Urae {
 
+	class ScenarioBundle;
+	class GraphClassifier;
+
 	/*
 	 * Name: UraeData
 	 * Inherits: Singleton
@@ -38,6 +52,8 @@ namespace Urae {
 	 * 					-> Classifications for CORNER
 	 */
 	class UraeData : public Singleton<UraeData> {
+
+		friend class ScenarioBundle;
 		
 	public:
 
@@ -65,7 +81,7 @@ namespace Urae {
 			VectorMath::Vector2D position;	// position of the intersection
 			LinkIndexSet mConnectedLinks;	// set of links which connect to this node.
 							// Note: This indexes the summed link set, NOT the other link set.
-			VectorMath::Real mSize;			// size of the intersection (treated as a circle).
+			VectorMath::Real mSize;			// size of the intersection (treated as a circle): half the width of its widest link.
 		};
 
 		typedef std::vector< VectorMath::Vector2D > VectorSet;
@@ -80,6 +96,37 @@ namespace Urae {
 			VectorMath::Real mSideStreetLaneCount;	/**< Number of lanes in the sidestreet for NLOS1/2 calculations. */
 			VectorMath::Real mParaStreetLaneCount;	/**< Number of lanes in the sidestreet for NLOS2 calculations. */
 			bool mFlipped;							/**< This flag is set for a particular lookup instance to show whether the source and destination indices are flipped from what we entered. */
+			int mCoefficients = -1;					/**< Index of the precomputed pathloss coefficients of this classification, or -1 if it has none. */
+		};
+
+		/*
+		 * Name: PathlossCoefficients
+		 * Description: The parts of the CORNER formulas which depend only on a classification, and not on where
+		 * 				the vehicles are: the junctions, the street widths and their products.
+		 */
+		struct PathlossCoefficients {
+			VectorMath::Vector2D mCorner[2];		// first junction, and the second of NLOS2
+			VectorMath::Real mMainWidth;			// Wm
+			VectorMath::Real mSideWidth;			// Ws
+			VectorMath::Real mParaWidth;			// Wp
+			VectorMath::Real mSideMainWidth;		// Ws * Wm
+			VectorMath::Real mParaSideWidth;		// Wp * Ws
+			VectorMath::Real mCornerDistance;		// rs, between the junctions of NLOS2
+			VectorMath::Real mCornerDistanceWidth;	// rs * Wm * Wp
+		};
+
+		/*
+		 * Name: ClassificationRecord
+		 * Description: Compact form in which the classifications are stored. The link pair is implied by its place in the table.
+		 */
+		struct ClassificationRecord {
+			int32_t mNodeSet[2];					// junctions in this classification
+			int32_t mFullNodeCount;					// full number of nodes traversed to get this classification
+			float mMainStreetLaneCount;
+			float mSideStreetLaneCount;
+			float mParaStreetLaneCount;
+			uint8_t mClassification;
+			uint8_t mPadding[3];
 		};
 
 		struct Building {
@@ -94,12 +141,29 @@ namespace Urae {
 		typedef std::vector<Link> LinkSet;
 		typedef std::vector<Node> NodeSet;
 		typedef std::pair<int,int> LinkPair;
-		typedef std::map< VectorMath::OrderedIndexPair, Classification > ClassificationMap;
 		typedef std::vector< Building > BuildingSet;
 		typedef std::vector<long> Bucket;
 		typedef std::map<std::string,int> LinkIndexMap;
 		typedef std::map<std::string,int> InternalLinkIndexMap;
 
+		/*
+		 * Name: RoadId
+		 * Description: Dense index of a SUMO edge name found in the link or internal link mapping.
+		 * 				Resolve a name once with GetRoadId, then look up by ID without touching strings.
+		 */
+		typedef int RoadId;
+		static const RoadId NoRoad = -1;
+
+		/*
+		 * Name: Road
+		 * Description: What an interned edge name maps to.
+		 */
+		struct Road {
+			std::string_view mName;				// the key in the link or internal link mapping
+			int mLinkIndex;						// summed link index, or -1 if the edge has no mapping
+			int mNodeIndex;						// parent node of an internal edge, or -1
+		};
+
 		/*
 		 * Name: Grid
 		 * Description: Contains the rectangle representing the current grid and the list of links in the grid
@@ -110,13 +174,6 @@ namespace Urae {
 			LinkIndexSet linkList;
 		};
 
-		typedef std::vector<double> DestinationLaneList;
-		typedef std::vector<DestinationLaneList> DestinationLocationList;
-		typedef std::map<int,DestinationLocationList> DestinationLookup;
-		typedef std::vector<DestinationLookup> SourceLaneList;
-		typedef std::vector<SourceLaneList> SourceLocationList;
-		typedef std::vector<SourceLocationList> RiceFactorMap;
-
 		struct CarDefinition {
 
 			VectorMath::Real mAcceleration;
@@ -131,6 +188,17 @@ namespace Urae {
 
 		typedef std::map<std::string,CarDefinition> CarDefinitionMap;
 
+		/*
+		 * Name: LoadTiming
+		 * Description: Wall-clock time taken by one step of loading the network.
+		 */
+		struct LoadTiming {
+			std::string mStep;		// name of the file or step
+			double mSeconds;		// time taken
+		};
+
+		typedef std::vector<LoadTiming> LoadTimingList;
+
 		// getters
 		VectorMath::Real GetWavelength();
 		VectorMath::Real GetLamdaBy4PiSq();
@@ -157,8 +225,10 @@ namespace Urae {
 		 * 		9. L - losses due to the system (signal processing, etc) not related to propagation
 		 * 		10. sensitivity - the sensitivity of the receiver
 		 * 		11. lpr - The loss per reflection
+		 * 		12. grid - size of the grid squares in metres
+		 * 		13. loaderThreads - number of threads parsing the input files (1 reads them one after another)
 		 */
-		UraeData( const char* linksFile, const char* nodesFile, const char* classFile, const char* buildingFile, const char* linkMapFile, VectorMath::Real laneWidth, VectorMath::Real lambda, VectorMath::Real txPower, VectorMath::Real L, VectorMath::Real sensitivity, VectorMath::Real lpr, VectorMath::Real grid );
+		UraeData( const char* linksFile, const char* nodesFile, const char* classFile, const char* buildingFile, const char* linkMapFile, VectorMath::Real laneWidth, VectorMath::Real lambda, VectorMath::Real txPower, VectorMath::Real L, VectorMath::Real sensitivity, VectorMath::Real lpr, VectorMath::Real grid, unsigned int loaderThreads = 1 );
 
 		/*
 		 * Constructor Arguments:
@@ -176,8 +246,26 @@ namespace Urae {
 		 * 		12. L - losses due to the system (signal processing, etc) not related to propagation
 		 * 		13. sensitivity - the sensitivity of the receiver
 		 * 		14. lpr - The loss per reflection
+		 * 		15. grid - size of the grid squares in metres
+		 * 		16. loaderThreads - number of threads parsing the input files (1 reads them one after another)
+		 * 		17. riceFormat - precision the K-factors are kept in
+		 * 		18. riceCacheBytes - if not 0, a binary K-factor file is paged by source link, keeping about this many bytes in memory
+		 * 		19. classRange - if not 0, classifications between links further apart than this are dropped (see PruneClassifications)
+		 */
+		UraeData( const char* linksFile, const char* nodesFile, const char* classFile, const char* buildingFile, const char* linkMapFile, const char* intLinkMapFile, const char* riceDataFile, const char *carDefFile, VectorMath::Real laneWidth, VectorMath::Real lambda, VectorMath::Real txPower, VectorMath::Real L, VectorMath::Real sensitivity, VectorMath::Real lpr, VectorMath::Real grid, unsigned int loaderThreads = 1, RiceData::ValueFormat riceFormat = RiceData::Float64, size_t riceCacheBytes = 0, VectorMath::Real classRange = 0 );
+
+		/*
+		 * Constructor Arguments:
+		 * 		1. bundleFile - file name of a scenario bundle written by the BundleCompiler
+		 * 		2. laneWidth - width of one lane in metres
+		 * 		3. lambda - wavelength of the carrier signal
+		 * 		4. txPower - transmission power of the signal
+		 * 		5. L - losses due to the system (signal processing, etc) not related to propagation
+		 * 		6. sensitivity - the sensitivity of the receiver
+		 * 		7. lpr - The loss per reflection
+		 * The grid size and the precision of the K-factors are those the bundle was compiled with.
 		 */
-		UraeData( const char* linksFile, const char* nodesFile, const char* classFile, const char* buildingFile, const char* linkMapFile, const char* intLinkMapFile, const char* riceDataFile, const char *carDefFile, VectorMath::Real laneWidth, VectorMath::Real lambda, VectorMath::Real txPower, VectorMath::Real L, VectorMath::Real sensitivity, VectorMath::Real lpr, VectorMath::Real grid );
+		UraeData( const char *bundleFile, VectorMath::Real laneWidth, VectorMath::Real lambda, VectorMath::Real txPower, VectorMath::Real L, VectorMath::Real sensitivity, VectorMath::Real lpr );
 
 		~UraeData();
 
@@ -223,12 +311,26 @@ namespace Urae {
 		 */
 		int GetSummedLinkCount() { return mSummedLinkSet.size(); }
 
+		/*
+		 * Method: int GetCommonLink( int n1, int n2 ) const;
+		 * Description: Returns the summed link joining the two given nodes, or -1 if there is none.
+		 */
+		int GetCommonLink( int n1, int n2 ) const;
+
 		/*
 		 * Method: void GetGrid(Vector2D position) {
 		 * Description: Gets the grid associated with the specified position
 		 */
 		Grid* GetGrid(VectorMath::Vector2D position);
 
+		/*
+		 * Method: int MatchPosition( VectorMath::Vector2D position, int *pNode ) const;
+		 * Description: Returns the summed link nearest the given position, if it is within the width of the link, or -1.
+		 * 				pNode (if not NULL) is set to the nearest junction whose area holds the position, or -1.
+		 * 				Only the candidates in the position's cell of the link raster are looked at.
+		 */
+		int MatchPosition( VectorMath::Vector2D position, int *pNode ) const;
+
 		/*
 		 * Method: Classification GetClassification( int l1, int l2 );
 		 * Description: Get the CORNER classification between the given links.
@@ -236,21 +338,103 @@ namespace Urae {
 		Classification GetClassification( int l1, int l2 );
 
 		/*
-		 * Method: Classification GetClassification( std::string link1, std::string link2 );
-		 * Description: Get the CORNER classification between the given links (by names).
+		 * Method: size_t GetClassificationCount() const;
+		 * Description: Get the number of classifications held.
+		 */
+		size_t GetClassificationCount() const { return mClassRowCount > 0 ? m_pClassRowOffsets[mClassRowCount] : 0; }
+
+		/*
+		 * Method: size_t PruneClassifications( VectorMath::Real range );
+		 * Description: Drops the classifications between summed links whose closest points are further apart than range
+		 * 				(e.g. the free space range), which are then out of range. Returns the number dropped.
+		 * 				The junction tables are not rebuilt, so prune before they are computed.
 		 */
-		Classification GetClassification( std::string link1, std::string link2 );
+		size_t PruneClassifications( VectorMath::Real range );
+
+		/*
+		 * Method: void EnableGraphClassification( VectorMath::Real range );
+		 * Description: Link pairs with no classification are classified from the road graph the first time they are
+		 * 				asked for (see GraphClassifier), instead of being out of range. Links further apart than range
+		 * 				stay out of range; a range of 0 uses the free space range.
+		 */
+		void EnableGraphClassification( VectorMath::Real range = 0 );
+
+		/*
+		 * Method: void ComputeClassifications( VectorMath::Real range, unsigned int threads );
+		 * Description: Replaces the classifications with those of every pair of links in range, computed from the road
+		 * 				graph by the given number of threads (see GraphClassifier). A range of 0 uses the free space range.
+		 */
+		void ComputeClassifications( VectorMath::Real range = 0, unsigned int threads = 1 );
+
+		/*
+		 * Method: void DisableGraphClassification();
+		 * Description: Link pairs with no classification are out of range again, and the computed ones are forgotten.
+		 */
+		void DisableGraphClassification();
+
+		/*
+		 * Method: GraphClassifier *GetGraphClassifier();
+		 * Description: Get the classifier of link pairs missing from the table, or NULL if it is not enabled.
+		 */
+		GraphClassifier *GetGraphClassifier() { return m_pGraphClassifier; }
+
+		/*
+		 * Method: void WriteClassifications( const char *classFile );
+		 * Description: Writes the classifications held to a CORNER class file.
+		 */
+		void WriteClassifications( const char *classFile );
+
+		/*
+		 * Method: Classification GetClassification( std::string_view link1, std::string_view link2 );
+		 * Description: Get the CORNER classification between the given links (by names). Unmapped names are out of range.
+		 */
+		Classification GetClassification( std::string_view link1, std::string_view link2 );
 
 		/**
 		 *	Get the classification between the given points.
 		 */
-		Classification GetClassification( std::string txName, std::string rxName, VectorMath::Vector2D, VectorMath::Vector2D );
+		Classification GetClassification( std::string_view txName, std::string_view rxName, VectorMath::Vector2D, VectorMath::Vector2D );
+
+		/*
+		 * Method: Classification GetClassification( RoadId txRoad, RoadId rxRoad, Vector2D txPos, Vector2D rxPos );
+		 * Description: Get the classification between the given points, on roads resolved by GetRoadId.
+		 */
+		Classification GetClassification( RoadId txRoad, RoadId rxRoad, VectorMath::Vector2D txPos, VectorMath::Vector2D rxPos );
 
 		/**
 		 *	Refine the given classification based on the position of vehicles.
 		 */
 		void RefineClassification( Classification &cls, VectorMath::Vector2D &s, VectorMath::Vector2D &d );
 
+		/*
+		 * Method: const PathlossCoefficients *GetPathlossCoefficients( const Classification &cls, PathlossCoefficients *pScratch ) const;
+		 * Description: Get the precomputed coefficients of the given classification. A classification which has none
+		 * 				(e.g. one from the GraphClassifier) has them computed into pScratch, which is returned.
+		 */
+		const PathlossCoefficients *GetPathlossCoefficients( const Classification &cls, PathlossCoefficients *pScratch ) const;
+
+		/*
+		 * Method: VectorMath::Real GetReflectionLoss( unsigned int n ) const;
+		 * Description: Get the loss per reflection to the power of 2n, from a table while it has not underflowed.
+		 */
+		VectorMath::Real GetReflectionLoss( unsigned int n ) const {
+			if ( n < mReflectionLoss.size() )
+				return mReflectionLoss[n];
+			return ( !mReflectionLoss.empty() && mReflectionLoss.back() == 0 ) ? 0 : pow( mLossPerReflection, 2 * n );
+		}
+
+		/*
+		 * Method: const VectorMath::Real *GetReflectionLossTable( size_t *pCount ) const;
+		 * Description: Get the table of GetReflectionLoss, and the number of values in it.
+		 */
+		const VectorMath::Real *GetReflectionLossTable( size_t *pCount ) const { *pCount = mReflectionLoss.size(); return mReflectionLoss.data(); }
+
+		/*
+		 * Method: VectorMath::Real GetLambdaTerm( int power ) const;
+		 * Description: Get GetLamdaBy4PiSq times the wavelength to the given power, 0 to 2.
+		 */
+		VectorMath::Real GetLambdaTerm( int power ) const { return mLambdaTerms[power]; }
+
 		/*
 		 * Method: VectorMath::Real GetK( LinkPair p, Vector2D srcPos, Vector2D destPos );
 		 * Description: Get the pre-computed k-factor between the given source and destination.
@@ -258,16 +442,36 @@ namespace Urae {
 		VectorMath::Real GetK( VectorMath::OrderedIndexPair p, VectorMath::Vector2D srcPos, int srcLane, VectorMath::Vector2D destPos, int destLane, bool flipped = false );
 
 		/*
-		 * Method: bool LinkIsInternal( std::string linkName, LinkIndexSet **pLinkIndices );
+		 * Method: RoadId GetRoadId( std::string_view roadName ) const;
+		 * Description: Returns the ID of the given SUMO edge name, or NoRoad if neither link mapping holds it.
+		 */
+		RoadId GetRoadId( std::string_view roadName ) const;
+
+		/*
+		 * Method: int GetRoadCount() const;
+		 * Description: Get the number of road IDs.
+		 */
+		int GetRoadCount() const { return mRoads.size(); }
+
+		/*
+		 * Method: const Road *GetRoad( RoadId road ) const;
+		 * Description: Get the given road, or NULL if the ID is not valid.
+		 */
+		const Road *GetRoad( RoadId road ) const { return ( road >= 0 && road < (RoadId)mRoads.size() ) ? &mRoads[road] : NULL; }
+
+		/*
+		 * Method: bool LinkIsInternal( std::string_view linkName, LinkIndexSet **pLinkIndices );
 		 * Description: Returns true if the given link name is an internal link, and returns a pointer to the parent node's connected links.
 		 */
-		bool LinkIsInternal( std::string linkName, LinkIndexSet **pLinkIndices );
+		bool LinkIsInternal( std::string_view linkName, LinkIndexSet **pLinkIndices );
+		bool LinkIsInternal( RoadId road, LinkIndexSet **pLinkIndices );
 
 		/*
-		 * Method: bool LinkHasMapping( std::string linkName, int *pMapping );
+		 * Method: bool LinkHasMapping( std::string_view linkName, int *pMapping );
 		 * Description: Returns true if the given link name is mapped to an index.
 		 */
-		bool LinkHasMapping( std::string linkName, int *pMapping );
+		bool LinkHasMapping( std::string_view linkName, int *pMapping );
+		bool LinkHasMapping( RoadId road, int *pMapping ) const;
 
 		/*
 		 * Method: Building *GetBuilding( int index );
@@ -284,10 +488,11 @@ namespace Urae {
 		void CollectBucketsInRange( VectorMath::Real r, VectorMath::Vector2D p, Bucket* );
 
 		/*
-		 * Method: void LoadNetwork( char* linksFile, char* nodesFile, const char* classFile, const char* buildingFile, const char* linkMapFile, const char* intLinkMapFile, const char* riceDataFile, const char* carDefFile );
+		 * Method: void LoadNetwork( char* linksFile, char* nodesFile, const char* classFile, const char* buildingFile, const char* linkMapFile, const char* intLinkMapFile, const char* riceDataFile, const char* carDefFile, unsigned int threads );
 		 * Description: Loads the data from the links, nodes, classification, buildings, link map, internal link map, rice data files, and car definitions.
+		 * 				The files do not depend on each other, so with more than one thread they are parsed concurrently, largest first.
 		 */
-		void LoadNetwork( const char* linksFile, const char* nodesFile, const char* classFile, const char* buildingFile, const char* linkMapFile, const char* intLinkMapFile, const char* riceDataFile, const char* carDefFile );
+		void LoadNetwork( const char* linksFile, const char* nodesFile, const char* classFile, const char* buildingFile, const char* linkMapFile, const char* intLinkMapFile, const char* riceDataFile, const char* carDefFile, unsigned int threads = 1 );
 		
 		/*
 		 * Method: void ComputeSummedLinkSet();
@@ -296,29 +501,131 @@ namespace Urae {
 		 */
 		void ComputeSummedLinkSet();
 
+		/*
+		 * Method: void ComputeNodePairLinks();
+		 * Description: Builds the table of summed links by the pair of nodes they join, and the squared half width
+		 * 				of each summed link, which the refinement of classifications uses, and sets the size of each node.
+		 */
+		void ComputeNodePairLinks();
+
 		/*
 		 * Method: void ComputeBuckets();
 		 * Description: Fills the buckets with indices of building edges.
 		 */
 		void ComputeBuckets();
 
+		/*
+		 * Method: void ComputeLinkRaster();
+		 * Description: Builds the raster MatchPosition uses: the geometry of each summed link, and for each cell of a
+		 * 				fine raster over the map the links and junctions which a position in that cell may match.
+		 */
+		void ComputeLinkRaster();
+
+		/*
+		 * Method: void ComputeJunctionClassifications();
+		 * Description: Finds, for every junction with internal links, the connected link which gives the best
+		 * 				classification to each other link, and the pair of connected links which gives the best
+		 * 				classification to each other junction. Vehicles on internal links are then classified with
+		 * 				one table lookup instead of a search over the junction's links.
+		 */
+		void ComputeJunctionClassifications();
+
+		/*
+		 * Method: void ComputePathlossCoefficients();
+		 * Description: Computes the coefficients of every NLOS classification in the table, shared between those with
+		 * 				the same junctions and streets, the table of reflection losses, and the wavelength terms.
+		 */
+		void ComputePathlossCoefficients();
+
 		/*
 		 * Method: VectorMath::Vector3D GetVehicleTypeDimensions( std::string );
 		 * Description: Get the width (x), length (y), and height (z) of vehicles of the given class.
 		 */
 		VectorMath::Vector3D GetVehicleTypeDimensions( std::string );
 
+		/*
+		 * Method: const RiceData &GetRiceData();
+		 * Description: Get the table of pre-computed K-factors, e.g. for its memory use and cache statistics.
+		 */
+		const RiceData &GetRiceData() const { return mRiceTable; }
+
+		/*
+		 * Method: const LoadTimingList &GetLoadTimings();
+		 * Description: Get the time taken by each file and step when the network was loaded.
+		 */
+		const LoadTimingList &GetLoadTimings() const { return mLoadTimings; }
+
+		/*
+		 * Method: void PrintLoadTimings( std::ostream &stream );
+		 * Description: Write the time taken by each file and step to the given stream.
+		 */
+		void PrintLoadTimings( std::ostream &stream ) const;
+
 	protected:
 
+		/*
+		 * Name: LoadTask
+		 * Description: One input file waiting to be parsed by LoadNetwork.
+		 */
+		struct LoadTask {
+			void (UraeData::*m_pLoader)( const char* );		// method which parses the file
+			const char *mFilename;
+			const char *mStep;								// name of the step in the load timings
+			double mSeconds;
+			Exception *m_pError;							// set if the loader threw
+		};
+
+		typedef std::vector<LoadTask*> LoadQueue;
+
+		/*
+		 * Method: static void *LoaderThread( void *pArg );
+		 * Description: Worker thread which takes tasks from the load queue until it is empty.
+		 */
+		static void *LoaderThread( void *pArg );
+
+		/*
+		 * Method: void RunLoadTask( LoadTask *pTask );
+		 * Description: Parses one file, recording the time taken and any exception thrown.
+		 */
+		void RunLoadTask( LoadTask *pTask );
+
+		/*
+		 * Method: void AddLoadTiming( const char *step, double seconds );
+		 * Description: Append a step to the load timings.
+		 */
+		void AddLoadTiming( const char *step, double seconds );
+
+		// Parsers for each of the input files. These only touch their own members, so they may run concurrently.
+		void LoadNodes( const char *nodesFile );
+		void LoadLinks( const char *linksFile );
+		void LoadClassifications( const char *classFile );
+		void LoadBuildings( const char *buildingFile );
+		void LoadLinkMap( const char *linkMapFile );
+		void LoadInternalLinkMap( const char *intLinkMapFile );
+		void LoadCarDefinitions( const char *carDefFile );
+		void LoadRiceData( const char *riceDataFile );
+
+		/*
+		 * Method: const ClassificationRecord *FindClassification( const VectorMath::OrderedIndexPair &linkPair );
+		 * Description: Returns the classification record of the given link pair, or NULL if there is none.
+		 */
+		const ClassificationRecord *FindClassification( const VectorMath::OrderedIndexPair &linkPair ) const;
+
+		/*
+		 * Method: void InternRoads();
+		 * Description: Gives every name in the link and internal link mappings a road ID.
+		 */
+		void InternRoads();
+
 		/**
-		 * Get the classification between two positions when one link is internal.
+		 * Get the classification between two positions when one link is internal to the given junction.
 		 */
-		Classification GetClassificationFromOneInternal( std::string internalName, int otherIndex, VectorMath::Vector2D, VectorMath::Vector2D );
+		Classification GetClassificationFromOneInternal( int internalNode, int otherIndex, VectorMath::Vector2D, VectorMath::Vector2D );
 
 		/**
-		 * Get the classification between two positions when both links are internal.
+		 * Get the classification between two positions when both links are internal to the given junctions.
 		 */
-		Classification GetClassificationFromInternalLinks( std::string txName, std::string rxName, VectorMath::Vector2D, VectorMath::Vector2D );
+		Classification GetClassificationFromInternalLinks( int txNode, int rxNode, VectorMath::Vector2D, VectorMath::Vector2D );
 
 
 		Bucket **m_ppBuckets;
@@ -330,8 +637,24 @@ namespace Urae {
 		LinkSet mLinkSet;									// set of links loaded from file
 		NodeSet mNodeSet;									// set of nodes loaded from file
 		LinkSet mSummedLinkSet;								// link set calculated by summing lane counts of links sharing nodes
+		std::vector<VectorMath::Real> mLinkHalfWidthSq;		// squared half width of each summed link
+
+		/*
+		 * Name: NodePairLinkTable
+		 * Description: Summed links in compressed rows, one row per node, each holding the nodes it is joined to in
+		 * 				ascending order and the link joining them.
+		 */
+		struct NodePairLinkTable {
+			std::vector<uint64_t> mRowOffsets;				// start of each node's row in the next two, plus the end
+			std::vector<int32_t> mNodes;
+			std::vector<int32_t> mLinks;
+		};
+
+		NodePairLinkTable mNodePairLinks;					// summed link joining each pair of nodes
 		LinkIndexMap mLinkIndexMap;							// mapping between link indices and link names
 		InternalLinkIndexMap mInternalLinkIndexMap;			// mapping between internal link names and parent node indices
+		std::vector<Road> mRoads;							// interned edge names of both mappings, indexed by road ID
+		std::unordered_map<std::string_view,RoadId> mRoadIdMap;	// edge name to road ID; the keys view the mapping keys
 
 		VectorMath::Real mWavelength;						// wavelength of carrier signal
 		VectorMath::Real mTransmitPower;					// transmission power
@@ -354,14 +677,103 @@ namespace Urae {
 		VectorMath::Real mLaneWidth;						// Width of each lane
 		VectorMath::Rect mMapRect;							// Rectangle showing bounds of the map network
 
-		ClassificationMap mClassificationMap;				// classifications
+		/*
+		 * Name: ClassificationTable
+		 * Description: Classifications in compressed rows, one row per link. The row of a link holds the links
+		 * 				paired with it which are not less than it, in ascending order, and their records.
+		 */
+		struct ClassificationTable {
+			std::vector<uint64_t> mRowOffsets;				// start of each row in the next two, plus the end
+			std::vector<int32_t> mOtherLinks;
+			std::vector<ClassificationRecord> mRecords;
+		};
+
+		ClassificationTable mClassificationTable;			// classifications, when parsed from the classification file
+		const uint64_t *m_pClassRowOffsets;					// the classification table in use, parsed or in a bundle
+		const int32_t *m_pClassOtherLinks;
+		const ClassificationRecord *m_pClassRecords;
+		size_t mClassRowCount;
+
+		std::vector<PathlossCoefficients> mPathlossCoefficients;	// distinct coefficients of the NLOS classifications
+		std::vector<int32_t> mClassCoefficients;			// index into mPathlossCoefficients of each classification, or -1
+		std::vector<VectorMath::Real> mReflectionLoss;		// loss per reflection to the power 2n, until it underflows
+		VectorMath::Real mLambdaTerms[3];					// mLambdaBy4PiSq times the wavelength to the power 0, 1 and 2
+
+		/*
+		 * Name: JunctionTable
+		 * Description: Best classifications from each junction, in compressed rows indexed by node. Of the junction's
+		 * 				connected links (or pairs of them) with the lowest classification, the last in the order
+		 * 				they are connected wins, as it would in a search over them. Only classifications in range are kept.
+		 */
+		struct JunctionTable {
+			std::vector<uint64_t> mLinkRowOffsets;			// start of each node's row in the next two, plus the end
+			std::vector<int32_t> mLinks;					// other link, ascending within each row
+			std::vector<int32_t> mLinkWinners;				// connected link of the junction giving the best classification
+			std::vector<uint64_t> mNodeRowOffsets;			// start of each node's row in the next two, plus the end
+			std::vector<int32_t> mNodes;					// other junction, ascending within each row
+			std::vector<LinkPair> mNodeWinners;				// connected links of both junctions giving the best classification
+		};
+
+		JunctionTable mJunctionTable;						// best classifications to and between junctions
+
+		/*
+		 * Name: LinkSegment
+		 * Description: A summed link as a line from its node A, with the squared width a position must be within to match it.
+		 */
+		struct LinkSegment {
+			VectorMath::Vector2D mStart;
+			VectorMath::Vector2D mDirection;				// unit vector towards node B, or 0 for a link of no length
+			VectorMath::Real mLength;
+			VectorMath::Real mWidthSq;
+
+			// squared distance of the given position from the nearest point of the segment
+			VectorMath::Real DistanceSq( VectorMath::Vector2D p ) const {
+				VectorMath::Real rx = p.x - mStart.x, ry = p.y - mStart.y;
+				VectorMath::Real t = rx * mDirection.x + ry * mDirection.y;
+				t = ( t < 0 ) ? 0 : ( t > mLength ) ? mLength : t;
+				rx -= mDirection.x * t;
+				ry -= mDirection.y * t;
+				return rx * rx + ry * ry;
+			}
+		};
+
+		/*
+		 * Name: LinkRaster
+		 * Description: Candidates for matching positions, in compressed rows, one per cell of a raster over the map
+		 * 				(row major). A cell lists every summed link which passes within its width of the cell, and every
+		 * 				junction whose area reaches it, in ascending order, so a position is matched from its own cell alone.
+		 */
+		struct LinkRaster {
+			VectorMath::Vector2D mOrigin;					// corner of the first cell
+			VectorMath::Real mCellSize;
+			unsigned int mColumnCount;
+			unsigned int mRowCount;
+			std::vector<uint32_t> mLinkRowOffsets;			// start of each cell's row in mLinks, plus the end
+			std::vector<int32_t> mLinks;
+			std::vector<uint32_t> mNodeRowOffsets;			// start of each cell's row in mNodes, plus the end
+			std::vector<int32_t> mNodes;
+			std::vector<LinkSegment> mSegments;				// geometry of each summed link
+		};
+
+		LinkRaster mLinkRaster;								// candidate links and junctions of each part of the map
+		GraphClassifier *m_pGraphClassifier;				// classifies pairs missing from the table, if enabled
 		BuildingSet mBuildingSet;
 
-		RiceFactorMap mRiceFactorData;						// map of pre-computed K-factors
-		int mLengthIncrement;								// Increment between K-Factor calculations along the links.
+		RiceData mRiceTable;								// flat table of pre-computed K-factors
+		RiceData::ValueFormat mRiceFormat;					// precision the K-factors are kept in
+		size_t mRiceCacheBytes;								// memory budget when paging the K-factors, 0 to load them whole
+		VectorMath::Real mLengthIncrement;					// Increment between K-Factor calculations along the links.
 
 		CarDefinitionMap mCarDefinitions;					// map of car definitions
 
+		void *m_pBundle;									// mapped scenario bundle, if loaded from one
+		size_t mBundleSize;
+
+		LoadTimingList mLoadTimings;						// time taken by each step of loading
+		LoadQueue mLoadQueue;								// files still to be parsed by the loader threads
+		unsigned int mNextLoadTask;							// index of the next task in the load queue
+		pthread_mutex_t mLoadQueueMutex;					// guards mNextLoadTask
+
 	};
 
 
@@ -75,7 +75,13 @@ namespace VectorMath {
 
 	class Rect;
 	class LineSegment;
+
+	// Build with URAE_SINGLE_PRECISION defined (make SINGLEPRECISION=1) for single precision geometry and pathloss.
+#ifdef URAE_SINGLE_PRECISION
+	typedef float Real;
+#else
 	typedef double Real;
+#endif
     
 	/*
 	 *	Class:		 Vector2D
@@ -267,6 +273,12 @@ namespace VectorMath {
 		Real DistanceAlongLine( Vector2D p );
 		
 		Real DistanceFromPoint(Vector2D p);
+
+		/*
+		 *	Function:	 Real DistanceFromSegment( LineSegment l );
+		 *	Description: Computes the shortest distance between this line segment and the given one (0 if they cross).
+		 */
+		Real DistanceFromSegment( LineSegment l );
 		
 		bool PointInCommon( LineSegment l );
 
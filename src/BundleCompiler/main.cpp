@@ -0,0 +1,122 @@
+/*
+ *  main.cpp - Compiles the CORNER files of a scenario into one scenario bundle
+ *  Copyright (C) 2012  C. S. Cooper, A. Mukunthan
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contact Details: Cooper - andor734@gmail.com
+ */
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+
+#include "Urae.h"
+
+using namespace std;
+using namespace Urae;
+
+
+void PrintUsage() {
+
+	cout << "Usage:\n";
+	cout << "  BundleCompiler -o <output.bundle> -n <nodes> -l <links> -c <class> [options]\n";
+	cout << "      Load the CORNER files of a scenario, compute the summed links, buckets and grid,\n";
+	cout << "      and write them all to one bundle for UraeData to load.\n";
+	cout << "  Options:\n";
+	cout << "      -b <file>   buildings file\n";
+	cout << "      -m <file>   link mapping file\n";
+	cout << "      -i <file>   internal link mapping file\n";
+	cout << "      -k <file>   K-factor file (text or binary)\n";
+	cout << "      -d <file>   car definitions file\n";
+	cout << "      -g <metres> size of the grid squares (default 200)\n";
+	cout << "      -f float64|float16|log8   precision of the K-factors (default float64)\n";
+	cout << "      -t <count>  number of threads loading the files (default 1)\n";
+	cout << "      -r <metres> leave out classifications between links further apart than this (e.g. the free space range)\n";
+
+}
+
+
+int main( int argc, char *pArgv[] ) {
+
+	string outFile, linksFile, nodesFile, classFile, buildingFile, linkMapFile, intLinkMapFile, riceFile, carDefFile;
+	VectorMath::Real grid = 200, classRange = 0;
+	unsigned int threads = 1;
+
+	try {
+
+		RiceData::ValueFormat format = RiceData::Float64;
+
+		for ( int a = 1; a < argc; a++ ) {
+
+			if ( pArgv[a][0] != '-' || a + 1 >= argc ) {
+				PrintUsage();
+				return -1;
+			}
+
+			char arg = pArgv[a][1];
+			a++;
+
+			switch( arg ) {
+				case 'o':	outFile = pArgv[a];			break;
+				case 'l':	linksFile = pArgv[a];		break;
+				case 'n':	nodesFile = pArgv[a];		break;
+				case 'c':	classFile = pArgv[a];		break;
+				case 'b':	buildingFile = pArgv[a];	break;
+				case 'm':	linkMapFile = pArgv[a];		break;
+				case 'i':	intLinkMapFile = pArgv[a];	break;
+				case 'k':	riceFile = pArgv[a];		break;
+				case 'd':	carDefFile = pArgv[a];		break;
+				case 'g':	grid = atof( pArgv[a] );	break;
+				case 't':	threads = atoi( pArgv[a] );	break;
+				case 'r':	classRange = atof( pArgv[a] );	break;
+				case 'f':	format = RiceData::ParseValueFormat( pArgv[a] );	break;
+
+				default:
+					cout << "Unknown argument: -" << arg << "\n";
+					PrintUsage();
+					return -1;
+			};
+
+		}
+
+		if ( outFile.empty() || nodesFile.empty() || linksFile.empty() || classFile.empty() || grid <= 0 ) {
+			PrintUsage();
+			return -1;
+		}
+
+		cout << "Load times:\n";
+		ScenarioBundle::Compile( outFile.c_str(),
+								 linksFile.c_str(),
+								 nodesFile.c_str(),
+								 classFile.c_str(),
+								 buildingFile.c_str(),
+								 linkMapFile.c_str(),
+								 intLinkMapFile.c_str(),
+								 riceFile.c_str(),
+								 carDefFile.c_str(),
+								 grid, format, threads, classRange, &cout );
+
+		cout << "Written scenario bundle to " << outFile << "\n";
+
+	} catch ( Exception &e ) {
+
+		cout << e.What() << "\n";
+		return -1;
+
+	}
+
+	return 0;
+
+}
@@ -0,0 +1,102 @@
+/*
+ *  main.cpp - Conversion tool for CORNER classification files
+ *  Copyright (C) 2012  C. S. Cooper, A. Mukunthan
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contact Details: Cooper - andor734@gmail.com
+ */
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+
+#include "Urae.h"
+
+using namespace std;
+using namespace Urae;
+
+
+void PrintUsage() {
+
+	cout << "Usage:\n";
+	cout << "  ClassTool prune [-t <count>] -r <metres> <links> <nodes> <class> <output.cls>\n";
+	cout << "      Leave out the classifications between links further apart than the given range\n";
+	cout << "      (e.g. the free space range of the radios), which are then taken to be out of range.\n";
+	cout << "      The links and nodes files give the geometry; -t sets the number of loader threads.\n";
+
+}
+
+
+int main( int argc, char *pArgv[] ) {
+
+	if ( argc < 2 ) {
+		PrintUsage();
+		return -1;
+	}
+
+	string command = pArgv[1];
+
+	try {
+
+		if ( command == "prune" ) {
+
+			VectorMath::Real range = 0;
+			unsigned int threads = 1;
+			int a = 2;
+			while ( a + 1 < argc && pArgv[a][0] == '-' ) {
+				string opt = pArgv[a];
+				if ( opt == "-r" )
+					range = atof( pArgv[a+1] );
+				else if ( opt == "-t" )
+					threads = atoi( pArgv[a+1] );
+				else
+					break;
+				a += 2;
+			}
+
+			if ( range <= 0 || argc - a != 4 ) {
+				PrintUsage();
+				return -1;
+			}
+
+			// the radio parameters don't matter here, only the geometry and classifications
+			UraeData *pData = new UraeData( 5, 0.125, 1, 1, 1, 0.75, 200 );
+			pData->LoadNetwork( pArgv[a], pArgv[a+1], pArgv[a+2], NULL, NULL, NULL, NULL, NULL, threads );
+			pData->ComputeSummedLinkSet();
+
+			size_t dropped = pData->PruneClassifications( range );
+			size_t kept = pData->GetClassificationCount();
+			pData->WriteClassifications( pArgv[a+3] );
+			delete pData;
+
+			cout << "Kept " << kept << " of " << kept + dropped << " classifications within " << range << "m in " << pArgv[a+3] << "\n";
+
+		} else {
+
+			PrintUsage();
+			return -1;
+
+		}
+
+	} catch ( Exception &e ) {
+
+		cout << e.What() << "\n";
+		return -1;
+
+	}
+
+	return 0;
+
+}
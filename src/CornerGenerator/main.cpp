@@ -0,0 +1,104 @@
+/*
+ *  main.cpp - Generates the CORNER classification file of a road network
+ *  Copyright (C) 2012  C. S. Cooper, A. Mukunthan
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contact Details: Cooper - andor734@gmail.com
+ */
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+
+#include "Urae.h"
+
+using namespace std;
+using namespace Urae;
+
+
+void PrintUsage() {
+
+	cout << "Usage:\n";
+	cout << "  CornerGenerator -o <output.cls> -n <nodes> -l <links> -r <metres> [-t <count>]\n";
+	cout << "      Classify every pair of links within the given range of each other (e.g. the free space\n";
+	cout << "      range of the radios) from the road network, and write them to a CORNER class file.\n";
+	cout << "      -t sets the number of threads; the output is the same whatever it is.\n";
+	cout << "      Use the BundleCompiler to put the classifications in a scenario bundle.\n";
+
+}
+
+
+int main( int argc, char *pArgv[] ) {
+
+	string outFile, nodesFile, linksFile;
+	VectorMath::Real range = 0;
+	unsigned int threads = 1;
+
+	for ( int a = 1; a < argc; a++ ) {
+
+		if ( pArgv[a][0] != '-' || a + 1 >= argc ) {
+			PrintUsage();
+			return -1;
+		}
+
+		char arg = pArgv[a][1];
+		a++;
+
+		switch( arg ) {
+			case 'o':	outFile = pArgv[a];			break;
+			case 'n':	nodesFile = pArgv[a];		break;
+			case 'l':	linksFile = pArgv[a];		break;
+			case 'r':	range = atof( pArgv[a] );	break;
+			case 't':	threads = atoi( pArgv[a] );	break;
+
+			default:
+				cout << "Unknown argument: -" << arg << "\n";
+				PrintUsage();
+				return -1;
+		};
+
+	}
+
+	if ( outFile.empty() || nodesFile.empty() || linksFile.empty() || range <= 0 || threads < 1 ) {
+		PrintUsage();
+		return -1;
+	}
+
+	UraeData *pData = NULL;
+	try {
+
+		// the radio parameters don't matter here, only the geometry
+		pData = new UraeData( 5, 0.125, 1, 1, 1, 0.75, 200 );
+		pData->LoadNetwork( linksFile.c_str(), nodesFile.c_str(), NULL, NULL, NULL, NULL, NULL, NULL );
+		pData->ComputeSummedLinkSet();
+		pData->ComputeClassifications( range, threads );
+		pData->WriteClassifications( outFile.c_str() );
+
+		cout << "Load times:\n";
+		pData->PrintLoadTimings( cout );
+		cout << "Written " << pData->GetClassificationCount() << " classifications of " << pData->GetSummedLinkCount() << " links to " << outFile << "\n";
+
+	} catch ( Exception &e ) {
+
+		cout << e.What() << "\n";
+		delete pData;
+		return -1;
+
+	}
+
+	delete pData;
+	return 0;
+
+}
@@ -0,0 +1,208 @@
+/*
+ *  main.cpp - Checks the vector pathloss kernels against the scalar ones
+ *  Copyright (C) 2012  C. S. Cooper, A. Mukunthan
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contact Details: Cooper - andor734@gmail.com
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cmath>
+
+#include "PathlossKernels.h"
+
+using namespace std;
+using namespace VectorMath;
+using namespace Urae;
+
+
+void PrintUsage() {
+
+	cout << "Usage:\n";
+	cout << "  KernelCheck [options]\n";
+	cout << "      Run the SSE2 and AVX2 pathloss kernels on random pairs and check that they agree with\n";
+	cout << "      the scalar ones. Returns 0 if every kernel the CPU supports is within the tolerance.\n";
+	cout << "  Options:\n";
+	cout << "      -l <loss>    loss per reflection (default 0.99, so long runs of reflections still count)\n";
+	cout << "      -r <count>   length of the table of reflection losses (default 64)\n";
+	cout << "      -s <seed>    random seed (default 1)\n";
+	cout << "      -t <tol>     largest relative difference allowed (default 1e-9)\n";
+
+}
+
+
+/*
+ * Name: Pairs
+ * Description: The inputs of the NLOS kernels for a set of pairs. LOS uses the main distances.
+ */
+struct Pairs {
+	vector<Real> mRm2, mRs2, mRp2, mWm, mWs, mWp;
+};
+
+
+/*
+ * Method: Real Uniform( Real low, Real high );
+ * Description: A random number between low and high.
+ */
+static Real Uniform( Real low, Real high ) {
+
+	return low + ( high - low ) * ( rand() / (Real)RAND_MAX );
+
+}
+
+
+/*
+ * Method: void MakePairs( size_t n, int mode, Pairs &p );
+ * Description: Random pairs whose reflection counts are within the table (mode 0), beyond it (mode 1), or either (mode 2).
+ */
+static void MakePairs( size_t n, int mode, Pairs &p ) {
+
+	p.mRm2.resize( n ); p.mRs2.resize( n ); p.mRp2.resize( n );
+	p.mWm.resize( n ); p.mWs.resize( n ); p.mWp.resize( n );
+
+	for ( size_t i = 0; i < n; i++ ) {
+
+		// Near pairs in wide streets take a few reflections, far ones in narrow streets take hundreds.
+		bool far = ( mode == 2 ) ? ( rand() & 1 ) : ( mode == 1 );
+		Real rMin = far ? 300 : 5, rMax = far ? 800 : 60;
+		Real wMin = far ? 2 : 15, wMax = far ? 6 : 40;
+		p.mRm2[i] = pow( Uniform( rMin, rMax ), 2 );
+		p.mRs2[i] = pow( Uniform( rMin, rMax ), 2 );
+		p.mRp2[i] = pow( Uniform( rMin, rMax ), 2 );
+		p.mWm[i] = Uniform( wMin, wMax );
+		p.mWs[i] = Uniform( wMin, wMax );
+		p.mWp[i] = Uniform( wMin, wMax );
+
+	}
+
+}
+
+
+/*
+ * Method: void Run( int kernel, const Pairs &p, const PathlossConstants &k, vector<Real> &out );
+ * Description: Runs the LOS (0), NLOS1 (1) or NLOS2 (2) kernel on the pairs.
+ */
+static void Run( int kernel, const Pairs &p, const PathlossConstants &k, vector<Real> &out ) {
+
+	size_t n = p.mRm2.size();
+	out.assign( n, 0 );
+	if ( kernel == 0 )
+		PathlossKernels::Los( n, &p.mRm2[0], k, &out[0] );
+	else if ( kernel == 1 )
+		PathlossKernels::Nlos1( n, &p.mRm2[0], &p.mRs2[0], &p.mWm[0], &p.mWs[0], k, &out[0] );
+	else
+		PathlossKernels::Nlos2( n, &p.mRm2[0], &p.mRs2[0], &p.mRp2[0], &p.mWm[0], &p.mWs[0], &p.mWp[0], k, &out[0] );
+
+}
+
+
+int main( int argc, char *pArgv[] ) {
+
+	Real lossPerReflection = 0.99, tolerance = 1e-9;
+	unsigned int tableLength = 64, seed = 1;
+	for ( int a = 1; a < argc; a += 2 ) {
+		string opt = pArgv[a];
+		if ( a + 1 >= argc ) {
+			PrintUsage();
+			return -1;
+		}
+		if ( opt == "-l" )
+			lossPerReflection = atof( pArgv[a+1] );
+		else if ( opt == "-r" )
+			tableLength = atoi( pArgv[a+1] );
+		else if ( opt == "-s" )
+			seed = atoi( pArgv[a+1] );
+		else if ( opt == "-t" )
+			tolerance = atof( pArgv[a+1] );
+		else {
+			PrintUsage();
+			return -1;
+		}
+	}
+	srand( seed );
+
+	// the table of reflection losses, as UraeData::GetReflectionLossTable gives it
+	vector<Real> reflectionLoss;
+	for ( unsigned int n = 0; n < tableLength; n++ )
+		reflectionLoss.push_back( pow( lossPerReflection, 2 * n ) );
+
+	PathlossConstants k;
+	k.mWavelength = 0.125;
+	k.mLambdaBy4PiSq = pow( k.mWavelength / ( 4 * M_PI ), 2 );
+	k.mLossPerReflection = lossPerReflection;
+	k.m_pReflectionLoss = reflectionLoss.empty() ? NULL : &reflectionLoss[0];
+	k.mReflectionLossCount = reflectionLoss.size();
+
+	// odd lengths leave a tail for the scalar loop after the vectors
+	const size_t Lengths[] = { 1, 2, 3, 5, 7, 8, 13, 64, 1001 };
+	const char *KernelNames[] = { "LOS", "NLOS1", "NLOS2" };
+	const char *ModeNames[] = { "within the table", "beyond the table", "mixed" };
+	const PathlossKernels::InstructionSet Sets[] = { PathlossKernels::SSE2, PathlossKernels::AVX2 };
+
+	bool passed = true;
+	for ( int s = 0; s < 2; s++ ) {
+
+		if ( !PathlossKernels::SetInstructionSet( Sets[s] ) ) {
+			cout << PathlossKernels::GetInstructionSetName( Sets[s] ) << ": not supported, skipped\n";
+			continue;
+		}
+
+		for ( int kernel = 0; kernel < 3; kernel++ ) {
+			for ( int mode = 0; mode < 3; mode++ ) {
+
+				double worst = 0;
+				size_t failures = 0, count = 0;
+				for ( size_t l = 0; l < sizeof(Lengths) / sizeof(Lengths[0]); l++ ) {
+
+					Pairs p;
+					MakePairs( Lengths[l], mode, p );
+
+					vector<Real> expected, actual;
+					PathlossKernels::SetInstructionSet( PathlossKernels::Scalar );
+					Run( kernel, p, k, expected );
+					PathlossKernels::SetInstructionSet( Sets[s] );
+					Run( kernel, p, k, actual );
+
+					for ( size_t i = 0; i < expected.size(); i++ ) {
+						double difference = fabs( (double)actual[i] - expected[i] ) / fabs( (double)expected[i] );
+						if ( !( difference <= tolerance ) )
+							failures++;
+						if ( difference > worst )
+							worst = difference;
+					}
+					count += expected.size();
+
+				}
+
+				cout << PathlossKernels::GetInstructionSetName( Sets[s] ) << " " << KernelNames[kernel] << ", " << ModeNames[mode]
+					 << ": " << count << " pairs, largest relative difference " << worst;
+				if ( failures > 0 ) {
+					cout << ", " << failures << " beyond " << tolerance << " FAILED";
+					passed = false;
+				}
+				cout << "\n";
+
+			}
+		}
+
+	}
+
+	cout << ( passed ? "All kernels agree with the scalar versions.\n" : "Some kernels differ from the scalar versions.\n" );
+	return passed ? 0 : 1;
+
+}
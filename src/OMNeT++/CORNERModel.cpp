@@ -26,6 +26,8 @@
 
 #include <queue>
 #include <fstream>
+#include <vector>
+#include <algorithm>
 
 
 
@@ -64,7 +66,7 @@ void CORNERModel::filterSignal( AirFrame *frame, const Coord& sendersPos, const
 
 	UraeScenarioManager *pManager = UraeScenarioManagerAccess().get();
 
-	std::string txRoadId, rxRoadId;
+	UraeData::RoadId txRoadId = UraeData::NoRoad, rxRoadId = UraeData::NoRoad;
 	int txLaneId, rxLaneId;
 	CarMobility *pMobTx = dynamic_cast<CarMobility*>(dynamic_cast<ChannelAccess *const>( frame->getSenderModule())->getMobilityModule());
 	CarMobility *pMobRx = dynamic_cast<CarMobility*>(dynamic_cast<ChannelAccess *const>(frame->getArrivalModule())->getMobilityModule());
@@ -73,20 +75,20 @@ void CORNERModel::filterSignal( AirFrame *frame, const Coord& sendersPos, const
 	UraeData::Classification c;
 
 	if ( pMobTx ) {
-		txRoadId = pMobTx->getRoadId();
+		txRoadId = pMobTx->getUraeRoadId();
 		txLaneId = pMobTx->getLaneId();
 	} else if ( pRsuTx ) {
-		txRoadId = pRsuTx->getRoadId();
+		txRoadId = pRsuTx->getUraeRoadId();
 		txLaneId = pRsuTx->getLaneId();
 	}
 	Coord posT = pManager->ConvertCoords( sendersPos );
 	Vector2D posTv = Vector2D(posT.x,posT.y);
 
 	if ( pMobRx ) {
-		rxRoadId = pMobRx->getRoadId();
+		rxRoadId = pMobRx->getUraeRoadId();
 		rxLaneId = pMobRx->getLaneId();
 	} else if ( pRsuRx ) {
-		rxRoadId = pRsuRx->getRoadId();
+		rxRoadId = pRsuRx->getUraeRoadId();
 		rxLaneId = pRsuRx->getLaneId();
 	}
 	Coord posR = pManager->ConvertCoords( receiverPos );
@@ -115,17 +117,29 @@ void CORNERModel::filterSignal( AirFrame *frame, const Coord& sendersPos, const
 	);
 
 
-	if ( kFactor != DBL_MAX ) {
+	if ( kFactor < DBL_MAX ) {
+
+		// we have fading at this point, correlated in time for this pair of hosts.
+		// Both ends move, so the maximum Doppler shift is that of the sum of their speeds.
+		double speed = ( pMobTx ? pMobTx->getSpeed() : 0 ) + ( pMobRx ? pMobRx->getSpeed() : 0 );
+		double dopplerFrequency = speed / UraeData::GetSingleton()->GetWavelength();
+		int txId = frame->getSenderModule()->getId(), rxId = frame->getArrivalModule()->getId();
+		uint64_t channelId = ( (uint64_t)std::min( txId, rxId ) << 32 ) | (uint32_t)std::max( txId, rxId );
+		Fading::Channel channel = Fading::GetSingleton()->CreateChannel( channelId );
+
+		size_t count = 0;
+		for ( simtime_t t = signal.getReceptionStart(); t <= signal.getReceptionEnd(); t += interval )
+			count++;
+		std::vector<double> fading( count );
+		channel.CalculateFading( c.mClassification, kFactor, signal.getReceptionStart().dbl(), interval.dbl(), dopplerFrequency, count, fading.data() );
 
-		// we have fading at this point
 		Mapping *att = MappingUtils::createMapping( dimensions, Mapping::LINEAR );
 		Argument pos;
-
+		size_t i = 0;
 		for ( simtime_t t = signal.getReceptionStart(); t <= signal.getReceptionEnd(); t += interval ) {
 
 			pos.setTime( t );
-			double f = Fading::GetSingleton()->CalculateFading( c.mClassification, kFactor );
-			att->appendValue( pos, f );
+			att->appendValue( pos, fading[i++] );
 
 		}
 		signal.addAttenuation( att );
@@ -26,6 +26,7 @@ CarMobility::CarMobility() {
 
 	mGridCell.x = -1;
 	mGridCell.y = -1;
+	mUraeRoadId = Urae::UraeData::NoRoad;
 
 }
 
@@ -62,8 +63,10 @@ const VectorMath::Vector3D& CarMobility::getCarDimensions() const {
 
 void CarMobility::nextPosition(const Coord& position, std::string road_id, double speed, double angle, TraCIScenarioManager::VehicleSignal signals ) {
 
-	if ( this->road_id != road_id )
+	if ( this->road_id != road_id ) {
 		updateLane();
+		mUraeRoadId = Urae::UraeData::GetSingleton()->GetRoadId( road_id );
+	}
 
 	TraCIMobility::nextPosition( position, road_id, speed, angle, signals );
 
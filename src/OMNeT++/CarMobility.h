@@ -38,6 +38,9 @@ public:
 	/** Get the current lane. */
 	int getLaneId() { return mLaneID; }
 
+	/** Get the URAE ID of the current road, resolved whenever the road changes. */
+	Urae::UraeData::RoadId getUraeRoadId() const { return mUraeRoadId; }
+
 	/** Get the current grid cell of this car. */
 	const Coord getGridCell() const;
 
@@ -62,6 +65,7 @@ protected:
 	void updateLane();
 
 	int mLaneID;							/**< The ID of the lane this car is on. */
+	Urae::UraeData::RoadId mUraeRoadId;	/**< The URAE ID of the road this car is on. */
 	Coord mGridCell;						/**< The grid cell in which this car is located. */
 	std::string mCarType;					/**< The type of car. */
 	VectorMath::Vector3D mCarDimensions;	/**< The dimensions of the vehicle. */
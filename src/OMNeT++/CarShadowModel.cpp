@@ -91,7 +91,7 @@ void CarShadowModel::filterSignal( AirFrame *frame, const Coord& sendersPos, con
 	CarMobility *pSenderMob = dynamic_cast<CarMobility*>(dynamic_cast<ChannelAccess *const>(frame->getSenderModule())->getMobilityModule());
 	CarMobility *pReceiverMob = dynamic_cast<CarMobility*>(dynamic_cast<ChannelAccess *const>(frame->getArrivalModule())->getMobilityModule());
 
-	std::string txRoadId, rxRoadId;
+	UraeData::RoadId txRoadId, rxRoadId;
 	UraeData::Classification c;
 
 	double txHeight;
@@ -105,12 +105,12 @@ void CarShadowModel::filterSignal( AirFrame *frame, const Coord& sendersPos, con
 		txHeight = txRsuMob->getHeight();
 		xStartTmp = txRsuMob->getCurrentPosition().x / pManager->getGridSize();
 		yStartTmp = txRsuMob->getCurrentPosition().y / pManager->getGridSize();
-		txRoadId = txRsuMob->getRoadId();
+		txRoadId = txRsuMob->getUraeRoadId();
 	} else {
 		txHeight = pSenderMob->getCarDimensions().z;
 		xStartTmp = MAX( pSenderMob->getGridCell().x, 0 );
 		yStartTmp = MAX( pSenderMob->getGridCell().y, 0 );
-		txRoadId = pSenderMob->getRoadId();
+		txRoadId = pSenderMob->getUraeRoadId();
 	}
 
 	if ( !pReceiverMob ) {
@@ -120,12 +120,12 @@ void CarShadowModel::filterSignal( AirFrame *frame, const Coord& sendersPos, con
 		rxHeight = rxRsuMob->getHeight();
 		xEndTmp = rxRsuMob->getCurrentPosition().x / pManager->getGridSize();
 		yEndTmp = rxRsuMob->getCurrentPosition().y / pManager->getGridSize();
-		rxRoadId = rxRsuMob->getRoadId();
+		rxRoadId = rxRsuMob->getUraeRoadId();
 	} else {
 		rxHeight = pReceiverMob->getCarDimensions().z;
 		xEndTmp = MAX( pReceiverMob->getGridCell().x, 0);
 		yEndTmp = MAX( pReceiverMob->getGridCell().y, 0);
-		rxRoadId = pReceiverMob->getRoadId();
+		rxRoadId = pReceiverMob->getUraeRoadId();
 	}
 
 	Coord posT = pManager->ConvertCoords( sendersPos );
@@ -24,6 +24,17 @@ void RsuMobility::initialize( int stage )
 	if ( stage == 0 ) {
 		mHeight = par("height").doubleValue();
 		mRoadId = par("roadId").stringValue();
+		mUraeRoadId = Urae::UraeData::NoRoad;
+		mUraeRoadResolved = false;
 	}
 }
 
+Urae::UraeData::RoadId RsuMobility::getUraeRoadId()
+{
+	if ( !mUraeRoadResolved ) {
+		mUraeRoadId = Urae::UraeData::GetSingleton()->GetRoadId( mRoadId );
+		mUraeRoadResolved = true;
+	}
+	return mUraeRoadId;
+}
+
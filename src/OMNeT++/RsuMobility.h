@@ -18,6 +18,7 @@
 
 #include <omnetpp.h>
 #include "ConstSpeedMobility.h"
+#include "UraeData.h"
 
 /**
  * RsuMobility.
@@ -31,11 +32,16 @@ public:
 	std::string getRoadId() { return mRoadId; }
 	int getLaneId() { return 0; }
 
+	/** Get the URAE ID of the road, resolved on first use since the scenario may not be loaded at initialisation. */
+	Urae::UraeData::RoadId getUraeRoadId();
+
 protected:
     virtual void initialize(int);
 
     double mHeight;			/**< The height in metres of this RSU off the ground. */
     std::string mRoadId;	/**< The id of the road in Sumo this RSU is on. */
+    Urae::UraeData::RoadId mUraeRoadId;	/**< The URAE ID of that road. */
+    bool mUraeRoadResolved;			/**< Whether mUraeRoadId has been looked up. */
 
 };
 
@@ -55,24 +55,61 @@ void UraeScenarioManager::initialize(int stage) {
 		}
 
 		try {
-			mUraeData = new Urae::UraeData( mLinkFile.c_str(),
-											mNodeFile.c_str(),
-											mClassificationFile.c_str(),
-											NULL,
-											mLinkMappingFile.c_str(),
-											mInternalLinkMappingFile.c_str(),
-											mRiceFile.c_str(),
-											mCarDefinitionFile.c_str(),
-											par("laneWidth").doubleValue(),
-											par("waveLength").doubleValue(),
-											par("txPower").doubleValue(),
-											par("systemLoss").doubleValue(),
-											FWMath::dBm2mW( par("sensitivity").doubleValue() ),
-											par("lossPerReflection").doubleValue(), 200 );
+			std::string bundleFile = par("bundleFile").stringValue();
+			std::string sharedName = par("sharedName").stringValue();
+			if ( !sharedName.empty() )
+				bundleFile = Urae::ScenarioBundle::Share( sharedName.c_str(),
+														  par("sharedDirectory").stringValue(),
+														  mLinkFile.c_str(),
+														  mNodeFile.c_str(),
+														  mClassificationFile.c_str(),
+														  NULL,
+														  mLinkMappingFile.c_str(),
+														  mInternalLinkMappingFile.c_str(),
+														  mRiceFile.c_str(),
+														  mCarDefinitionFile.c_str(),
+														  200,
+														  Urae::RiceData::ParseValueFormat( par("riceFormat").stringValue() ),
+														  par("loaderThreads").longValue(),
+														  par("classRange").doubleValue() );
+			if ( !bundleFile.empty() )
+				mUraeData = new Urae::UraeData( bundleFile.c_str(),
+												par("laneWidth").doubleValue(),
+												par("waveLength").doubleValue(),
+												par("txPower").doubleValue(),
+												par("systemLoss").doubleValue(),
+												FWMath::dBm2mW( par("sensitivity").doubleValue() ),
+												par("lossPerReflection").doubleValue() );
+			else
+				mUraeData = new Urae::UraeData( mLinkFile.c_str(),
+												mNodeFile.c_str(),
+												mClassificationFile.c_str(),
+												NULL,
+												mLinkMappingFile.c_str(),
+												mInternalLinkMappingFile.c_str(),
+												mRiceFile.c_str(),
+												mCarDefinitionFile.c_str(),
+												par("laneWidth").doubleValue(),
+												par("waveLength").doubleValue(),
+												par("txPower").doubleValue(),
+												par("systemLoss").doubleValue(),
+												FWMath::dBm2mW( par("sensitivity").doubleValue() ),
+												par("lossPerReflection").doubleValue(), 200,
+												par("loaderThreads").longValue(),
+												Urae::RiceData::ParseValueFormat( par("riceFormat").stringValue() ),
+												(size_t)par("riceCacheSize").doubleValue(),
+												par("classRange").doubleValue() );
+			if ( par("graphClassification").boolValue() )
+				mUraeData->EnableGraphClassification( par("classRange").doubleValue() );
 		} catch (Exception &e) {
 			opp_error(e.What().c_str());
 		}
 
+		EV << "Urae data loaded:\n";
+		const Urae::UraeData::LoadTimingList &timings = mUraeData->GetLoadTimings();
+		for ( Urae::UraeData::LoadTimingList::const_iterator it = timings.begin(); it != timings.end(); it++ )
+			EV << "  " << it->mStep << ": " << it->mSeconds << "s\n";
+
 		if ( Urae::UraeData::GetSingleton() == NULL )
 		    opp_error("Urae::UraeData Initialization failed for some reason.");
 
@@ -98,6 +135,15 @@ void UraeScenarioManager::initialize(int stage) {
 
 void UraeScenarioManager::finish() {
 
+	if ( mUraeData && mUraeData->GetRiceData().IsPaged() ) {
+		uint64_t hits, misses;
+		size_t resident;
+		mUraeData->GetRiceData().GetCacheStatistics( &hits, &misses, &resident );
+		recordScalar( "riceCacheHits", hits );
+		recordScalar( "riceCacheMisses", misses );
+		recordScalar( "riceCacheResidentBytes", resident );
+	}
+
 	if ( mUraeData )
 		delete mUraeData;
 	if ( mFading )
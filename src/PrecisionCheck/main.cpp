@@ -0,0 +1,314 @@
+/*
+ *  main.cpp - Compares the pathloss and K-factors of the single and double precision builds
+ *  Copyright (C) 2012  C. S. Cooper, A. Mukunthan
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contact Details: Cooper - andor734@gmail.com
+ */
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cfloat>
+#include <cmath>
+#include <ctime>
+
+#include "Urae.h"
+#include "Classifier.h"
+
+using namespace std;
+using namespace VectorMath;
+using namespace Urae;
+
+
+void PrintUsage() {
+
+	cout << "Usage:\n";
+	cout << "  PrecisionCheck run -n <nodes> -l <links> -c <class> -o <output> [options]\n";
+	cout << "      Classify random pairs on the links of a scenario and calculate their pathloss and K-factors,\n";
+	cout << "      timing the calculation, and write the results to the output file. Run the same command with\n";
+	cout << "      PrecisionCheck (built against liburae.a) and PrecisionCheckf (liburaef.a), then compare them.\n";
+	cout << "  Options:\n";
+	cout << "      -b <file>   buildings file\n";
+	cout << "      -m <file>   link mapping file\n";
+	cout << "      -i <file>   internal link mapping file\n";
+	cout << "      -k <file>   K-factor file\n";
+	cout << "      -d <file>   car definitions file\n";
+	cout << "      -g <metres> size of the grid squares (default 200)\n";
+	cout << "      -p <count>  number of pairs (default 200000)\n";
+	cout << "      -s <seed>   random seed (default 1)\n";
+	cout << "      -r <count>  number of timed passes over the pairs (default 5)\n";
+	cout << "  PrecisionCheck compare <double output> <single output>\n";
+	cout << "      Report the differences between the results of the two builds, and their timings.\n";
+
+}
+
+
+/*
+ * Name: Results
+ * Description: The output of a run: the state, pathloss and K-factor of each pair (-1 for an infinite K-factor).
+ */
+struct Results {
+	string mPrecision;
+	double mMilliseconds;
+	vector<int> mStates;
+	vector<double> mPathloss, mK;
+};
+
+
+/*
+ * Method: double GetWallTime();
+ * Description: Seconds on a monotonic clock.
+ */
+static double GetWallTime() {
+
+	timespec t;
+	clock_gettime( CLOCK_MONOTONIC, &t );
+	return t.tv_sec + t.tv_nsec * 1e-9;
+
+}
+
+
+/*
+ * Method: const char *OptionalFile( const string &filename );
+ * Description: Treats an empty file name as no file.
+ */
+static const char *OptionalFile( const string &filename ) {
+
+	return filename.empty() ? NULL : filename.c_str();
+
+}
+
+
+/*
+ * Method: Vector2D PointOnLink( UraeData *pData, UraeData::Link *pLink, double t );
+ * Description: The point the fraction t of the way along the link, found in double precision.
+ */
+static Vector2D PointOnLink( UraeData *pData, UraeData::Link *pLink, double t ) {
+
+	Vector2D a = pData->GetNode( pLink->nodeAindex )->position, b = pData->GetNode( pLink->nodeBindex )->position;
+	return Vector2D( (double)a.x + ( (double)b.x - a.x ) * t, (double)a.y + ( (double)b.y - a.y ) * t );
+
+}
+
+
+/*
+ * Method: int Run( int argc, char *pArgv[] );
+ * Description: The run command.
+ */
+static int Run( int argc, char *pArgv[] ) {
+
+	string outFile, linksFile, nodesFile, classFile, buildingFile, linkMapFile, intLinkMapFile, riceFile, carDefFile;
+	Real grid = 200;
+	int pairCount = 200000, passes = 5;
+	unsigned int seed = 1;
+
+	for ( int a = 2; a < argc; a++ ) {
+
+		if ( pArgv[a][0] != '-' || a + 1 >= argc ) {
+			PrintUsage();
+			return -1;
+		}
+
+		char arg = pArgv[a][1];
+		a++;
+
+		switch( arg ) {
+			case 'o':	outFile = pArgv[a];				break;
+			case 'l':	linksFile = pArgv[a];			break;
+			case 'n':	nodesFile = pArgv[a];			break;
+			case 'c':	classFile = pArgv[a];			break;
+			case 'b':	buildingFile = pArgv[a];		break;
+			case 'm':	linkMapFile = pArgv[a];			break;
+			case 'i':	intLinkMapFile = pArgv[a];		break;
+			case 'k':	riceFile = pArgv[a];			break;
+			case 'd':	carDefFile = pArgv[a];			break;
+			case 'g':	grid = atof( pArgv[a] );		break;
+			case 'p':	pairCount = atoi( pArgv[a] );	break;
+			case 's':	seed = atoi( pArgv[a] );		break;
+			case 'r':	passes = atoi( pArgv[a] );		break;
+
+			default:
+				cout << "Unknown argument: -" << arg << "\n";
+				PrintUsage();
+				return -1;
+		};
+
+	}
+
+	if ( outFile.empty() || nodesFile.empty() || linksFile.empty() || classFile.empty() || grid <= 0 || pairCount <= 0 || passes <= 0 ) {
+		PrintUsage();
+		return -1;
+	}
+
+	UraeData *pData = new UraeData( linksFile.c_str(), nodesFile.c_str(), classFile.c_str(), OptionalFile( buildingFile ), OptionalFile( linkMapFile ),
+									OptionalFile( intLinkMapFile ), OptionalFile( riceFile ), OptionalFile( carDefFile ),
+									5, 0.125, 80, 1142.9, 1e-11, 0.75, grid );
+
+	// The pairs are placed in double precision, so both builds draw the same ones.
+	srand( seed );
+	int linkCount = pData->GetSummedLinkCount();
+	vector<Vector2D> sources( pairCount ), destinations( pairCount );
+	for ( int p = 0; p < pairCount; p++ ) {
+		UraeData::Link *pSource = pData->GetSummedLink( rand() % linkCount );
+		UraeData::Link *pDestination = pData->GetSummedLink( rand() % linkCount );
+		double t1 = rand() / (double)RAND_MAX, t2 = rand() / (double)RAND_MAX;
+		sources[p] = PointOnLink( pData, pSource, t1 );
+		destinations[p] = PointOnLink( pData, pDestination, t2 );
+	}
+
+	Results r;
+	r.mStates.resize( pairCount );
+	r.mPathloss.resize( pairCount );
+	r.mK.resize( pairCount );
+	double start = GetWallTime();
+	for ( int pass = 0; pass < passes; pass++ ) {
+		for ( int p = 0; p < pairCount; p++ ) {
+			Classifier c;
+			r.mPathloss[p] = c.CalculatePathloss( sources[p], destinations[p] );
+			UraeData::Classification classification = c.GetClassification();
+			r.mStates[p] = classification.mClassification;
+			Real k = ( r.mStates[p] == Classifier::LOS ) ? pData->GetK( classification.mLinkPair, sources[p], 0, destinations[p], 0, classification.mFlipped ) : 0;
+			r.mK[p] = ( k >= DBL_MAX ) ? -1 : k;
+		}
+	}
+	r.mMilliseconds = ( GetWallTime() - start ) * 1000 / passes;
+
+	ofstream fout( outFile.c_str() );
+	if ( !fout.is_open() )
+		THROW_EXCEPTION( "Cannot open output file: %s", outFile.c_str() );
+	fout.precision( 17 );
+	fout << ( sizeof(Real) == sizeof(float) ? "single" : "double" ) << " " << pairCount << " " << r.mMilliseconds << "\n";
+	for ( int p = 0; p < pairCount; p++ )
+		fout << r.mStates[p] << " " << r.mPathloss[p] << " " << r.mK[p] << "\n";
+	fout.close();
+
+	cout << "Calculated " << pairCount << " pairs in " << r.mMilliseconds << " ms (" << ( sizeof(Real) == sizeof(float) ? "single" : "double" ) << " precision)\n";
+	delete pData;
+	return 0;
+
+}
+
+
+/*
+ * Method: void Read( const char *filename, Results &r );
+ * Description: Reads the output of a run.
+ */
+static void Read( const char *filename, Results &r ) {
+
+	ifstream fin( filename );
+	if ( !fin.is_open() )
+		THROW_EXCEPTION( "Cannot open results file: %s", filename );
+
+	size_t count;
+	fin >> r.mPrecision >> count >> r.mMilliseconds;
+	r.mStates.resize( count );
+	r.mPathloss.resize( count );
+	r.mK.resize( count );
+	for ( size_t p = 0; p < count; p++ )
+		fin >> r.mStates[p] >> r.mPathloss[p] >> r.mK[p];
+	if ( fin.fail() )
+		THROW_EXCEPTION( "Invalid results file: %s", filename );
+
+}
+
+
+/*
+ * Method: void PrintDifferences( const char *name, vector<double> &differences );
+ * Description: Prints the median and largest of the relative differences.
+ */
+static void PrintDifferences( const char *name, vector<double> &differences ) {
+
+	cout << name << ": " << differences.size() << " compared";
+	if ( !differences.empty() ) {
+		sort( differences.begin(), differences.end() );
+		cout << ", relative difference median " << differences[ differences.size() / 2 ] << ", largest " << differences.back();
+	}
+	cout << "\n";
+
+}
+
+
+/*
+ * Method: int Compare( const char *doubleFile, const char *singleFile );
+ * Description: The compare command.
+ */
+static int Compare( const char *doubleFile, const char *singleFile ) {
+
+	Results d, s;
+	Read( doubleFile, d );
+	Read( singleFile, s );
+	if ( d.mStates.size() != s.mStates.size() )
+		THROW_EXCEPTION( "The runs have different numbers of pairs" );
+
+	size_t stateDifferences = 0, infiniteDifferences = 0;
+	vector<double> pathloss, k;
+	for ( size_t p = 0; p < d.mStates.size(); p++ ) {
+
+		if ( d.mStates[p] != s.mStates[p] ) {
+			stateDifferences++;
+			continue;
+		}
+		if ( d.mPathloss[p] > 0 )
+			pathloss.push_back( fabs( s.mPathloss[p] - d.mPathloss[p] ) / d.mPathloss[p] );
+		if ( ( d.mK[p] < 0 ) != ( s.mK[p] < 0 ) )
+			infiniteDifferences++;
+		else if ( d.mK[p] > 0 )
+			k.push_back( fabs( s.mK[p] - d.mK[p] ) / d.mK[p] );
+
+	}
+
+	cout << d.mStates.size() << " pairs, " << d.mPrecision << " vs " << s.mPrecision << " precision\n";
+	cout << "States: " << stateDifferences << " differ\n";
+	PrintDifferences( "Pathloss", pathloss );
+	PrintDifferences( "K-factors", k );
+	if ( infiniteDifferences > 0 )
+		cout << "K-factors: " << infiniteDifferences << " infinite in one build only\n";
+	cout << "Time: " << d.mMilliseconds << " ms vs " << s.mMilliseconds << " ms\n";
+	return 0;
+
+}
+
+
+int main( int argc, char *pArgv[] ) {
+
+	if ( argc < 2 ) {
+		PrintUsage();
+		return -1;
+	}
+
+	string command = pArgv[1];
+
+	try {
+
+		if ( command == "run" )
+			return Run( argc, pArgv );
+		if ( command == "compare" && argc == 4 )
+			return Compare( pArgv[2], pArgv[3] );
+
+		PrintUsage();
+		return -1;
+
+	} catch ( Exception &e ) {
+
+		cout << e.What() << "\n";
+		return -1;
+
+	}
+
+}
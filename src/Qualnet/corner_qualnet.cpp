@@ -109,12 +109,11 @@ void CornerInitialize( Node* node, PropProfile* propProfile, const NodeInput* no
 				IO_ReadDouble(ANY_NODEID, ANY_ADDRESS, nodeInput, "PROPAGATION-CORNER-RICEAN-K-FACTOR", &retVal, &(propProfile->cornerK));
 				ERROR_Assert(retVal, "PROPAGATION-CORNER-RICEAN-K-FACTOR must be specified if using PROPAGATION-CORNER-USE-FADING\n");
 
-				//read in the gaussian components file
+				//read in the gaussian components file; without one, the components are generated
 				IO_ReadString(ANY_NODEID, ANY_ADDRESS, nodeInput, "PROPAGATION-FADING-GAUSSIAN-COMPONENTS-FILE", &retVal, compFile);
-				ERROR_Assert(retVal, "PROPAGATION-FADING-GAUSSIAN-COMPONENTS-FILE must be specified if using PROPAGATION-CORNER-USE-FADING\n");
 				
 				//initialise the Fading singleton
-				new Corner::Fading(compFile, node->globalSeed);
+				new Corner::Fading(retVal ? compFile : NULL, node->globalSeed);
 			} catch (Exception &e) {
 				ERROR_Assert(0, e.What().c_str());
 			}
@@ -152,7 +152,7 @@ bool Raytracer::CheckIntersection( RayPathComponent ray, VectorMath::Vector2D *i
 	};
 
 	// if we didn't find any intersections
-	if ( Dmin == DBL_MAX )
+	if ( Dmin >= DBL_MAX )
 		return false;
 
 	if ( *incidentAngle > M_PI/2 )
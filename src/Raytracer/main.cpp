@@ -218,6 +218,7 @@ void ParseArgs( int argc, char *pArgv[] ) {
 	Real laneWidth = 5;
 	string configFilename("config");
 	string rsuDefFile("none");
+	string kFormat("text");
 #ifdef USE_VISUALISER
 	bool useVisualiser = false;
 #endif // #ifdef USE_VISUALISER
@@ -274,6 +275,15 @@ void ParseArgs( int argc, char *pArgv[] ) {
 				laneWidth = atof(pArgv[a]);
 				break;
 
+			case 'k':
+				a++;
+				kFormat = pArgv[a];
+				if ( kFormat != "text" && kFormat != "float64" && kFormat != "float16" && kFormat != "log8" ) {
+					cout << "Unknown K-factor format '" << kFormat << "' (use text, float64, float16 or log8)\n";
+					return;
+				}
+				break;
+
 #ifdef USE_VISUALISER
 			case 'V':
 				useVisualiser = true;
@@ -304,6 +314,7 @@ void ParseArgs( int argc, char *pArgv[] ) {
 	cfg << "cores " << cores << "\n";
 	cfg << "rxGain " << rxGain << "\n";
 	cfg << "laneWidth " << laneWidth << "\n";
+	cfg << "kformat " << kFormat << "\n";
 #ifdef USE_VISUALISER
 	cfg << "useVisualiser " << ( useVisualiser ? "true" : "false" ) << "\n";
 #endif // #ifdef USE_VISUALISER
@@ -490,6 +501,7 @@ int main( int argc, char *pArgv[] ) {
 	Real rxGain = atof( runConfigs[runNumber]["rxGain"].c_str() );
 	Rect area = ParseRect( runConfigs[runNumber]["area"] );
 	Real laneWidth = atof( runConfigs[runNumber]["laneWidth"].c_str() );
+	string kFormat = runConfigs[runNumber]["kformat"];
 #ifdef USE_VISUALISER
 	gLaneWidth = laneWidth;
 	bool useVisualiser = ( runConfigs[runNumber]["useVisualiser"] == "true" );
@@ -512,9 +524,11 @@ int main( int argc, char *pArgv[] ) {
 			(basename+".corner.cls").c_str(),
 			(basename+".corner.bld").c_str(),
 			(basename+".corner.lnm").c_str(),
-			laneWidth, 0.124378109, 10.1666, 1142.9, pow(10,-11), 0.25, 1000
+			laneWidth, 0.124378109, 10.1666, 1142.9, pow(10,-11), 0.25, 1000, cores
 		);
 
+		log << "Load times:\n";
+		pUrae->PrintLoadTimings( log );
 		log << "Transmission range: " << pUrae->GetFreeSpaceRange() << "\n";
 		log.flush();
 		
@@ -797,6 +811,61 @@ int main( int argc, char *pArgv[] ) {
 	ofstream outputFile;
 	char strF[200];
 	sprintf( strF, "%s-%d.urae.k", basename.c_str(), runNumber );
+
+	if ( !kFormat.empty() && kFormat != "text" ) {
+
+		// Write the binary format directly. The maps are already in ascending order of link index.
+		try {
+
+			RiceData::Writer writer( strF, increment, RiceData::ParseValueFormat( kFormat.c_str() ) );
+
+			RiceFactorMap::iterator mapIt;
+			for ( AllInVector( mapIt, riceData ) ) {
+
+				writer.BeginLink( mapIt->first );
+				SourceLocationList::iterator srcLocIt;
+				for ( AllInVector( srcLocIt, mapIt->second ) ) {
+
+					writer.BeginLocation();
+					SourceLaneList::iterator srcLaneIt;
+					for ( AllInVector( srcLaneIt, (*srcLocIt) ) ) {
+
+						writer.BeginLane();
+						DestinationLookup::iterator destIt;
+						for ( AllInVector( destIt, (*srcLaneIt) ) ) {
+
+							writer.BeginDestination( destIt->first );
+							DestinationLocationList::iterator destLocIt;
+							for ( AllInVector( destLocIt, destIt->second ) ) {
+
+								writer.BeginDestinationLocation();
+								DestinationLaneList::iterator destLaneIt;
+								for ( AllInVector( destLaneIt, (*destLocIt) ) )
+									writer.AddValue( *destLaneIt );
+
+							}
+
+						}
+
+					}
+
+				}
+
+			}
+
+			writer.Finish();
+
+		} catch ( Exception &e ) {
+
+			log << "Could not write K-factors. " << e.What() << "\n";
+			return -1;
+
+		}
+
+		return 0;
+
+	}
+
 	outputFile.precision( 12 );
 	outputFile.open( strF );
 
@@ -842,7 +911,7 @@ int main( int argc, char *pArgv[] ) {
 						for ( AllInVector( destLaneIt, (*destLocIt) ) ) {
 
 							// Write the K-factor.
-							if ( *destLaneIt == DBL_MAX )
+							if ( *destLaneIt >= DBL_MAX )
 								outputFile << "inf\n";
 							else
 								outputFile << *destLaneIt << "\n";
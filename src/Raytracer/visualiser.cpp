@@ -415,7 +415,7 @@ int main( int argc, char **ppArgv ) {
 							rt->SetRayLength( raylength );
 						rt->Execute();
 						double kf = rt->ComputeK( rxPos, gain ).mFactorK;
-						if ( kf != DBL_MAX )
+						if ( kf < DBL_MAX )
 							outFile << t*l.GetDistance() << " " << kf << "\n";
 						delete rt;
 
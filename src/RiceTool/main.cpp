@@ -0,0 +1,114 @@
+/*
+ *  main.cpp - Conversion tool for pre-computed K-factor files
+ *  Copyright (C) 2012  C. S. Cooper, A. Mukunthan
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contact Details: Cooper - andor734@gmail.com
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Urae.h"
+
+using namespace std;
+using namespace Urae;
+
+
+void PrintUsage() {
+
+	cout << "Usage:\n";
+	cout << "  RiceTool convert [-f float64|float16|log8] <input.urae.k> <output.urae.k>\n";
+	cout << "      Convert the text K-factor output of the Raytracer to the binary format,\n";
+	cout << "      or re-encode a binary file. K-factors are stored as float64 unless -f is given.\n";
+	cout << "  RiceTool merge [-f float64|float16|log8] <output.urae.k> <input.urae.k>...\n";
+	cout << "      Merge K-factor files, e.g. the basename-<run>.urae.k output of each Raytracer run,\n";
+	cout << "      into one binary file. All inputs must have been computed with the same increment.\n";
+
+}
+
+
+int main( int argc, char *pArgv[] ) {
+
+	if ( argc < 2 ) {
+		PrintUsage();
+		return -1;
+	}
+
+	string command = pArgv[1];
+
+	try {
+
+		if ( command == "convert" && ( argc == 4 || ( argc == 6 && string( pArgv[2] ) == "-f" ) ) ) {
+
+			RiceData::ValueFormat format = RiceData::Float64;
+			int a = 2;
+			if ( argc == 6 ) {
+				format = RiceData::ParseValueFormat( pArgv[3] );
+				a = 4;
+			}
+
+			if ( RiceData::IsBinaryFile( pArgv[a] ) ) {
+
+				RiceData data;
+				data.Map( pArgv[a] );
+				if ( data.GetValueFormat() == format ) {
+					cout << "'" << pArgv[a] << "' is already a binary K-factor file in that format.\n";
+					return -1;
+				}
+				data.Write( pArgv[a+1], format );
+
+			} else {
+
+				RiceData::ConvertText( pArgv[a], pArgv[a+1], format );
+
+			}
+
+			cout << "Written binary K-factors to " << pArgv[a+1] << "\n";
+
+		} else if ( command == "merge" && ( argc >= 4 && ( string( pArgv[2] ) != "-f" || argc >= 6 ) ) ) {
+
+			RiceData::ValueFormat format = RiceData::Float64;
+			int a = 2;
+			if ( string( pArgv[2] ) == "-f" ) {
+				format = RiceData::ParseValueFormat( pArgv[3] );
+				a = 4;
+			}
+
+			std::vector<std::string> inputs( pArgv + a + 1, pArgv + argc );
+			uint64_t overlaps = RiceData::Merge( inputs, pArgv[a], format );
+
+			cout << "Merged " << inputs.size() << " K-factor files into " << pArgv[a] << "\n";
+			if ( overlaps > 0 )
+				cout << overlaps << " destination entries were in more than one file; the first file's were kept.\n";
+
+		} else {
+
+			PrintUsage();
+			return -1;
+
+		}
+
+	} catch ( Exception &e ) {
+
+		cout << e.What() << "\n";
+		return -1;
+
+	}
+
+	return 0;
+
+}
@@ -82,52 +82,51 @@ Real Classifier::CalculatePathloss( Vector2D source, Vector2D destination ) {
 			return ( pUraeData->GetLamdaBy4PiSq() / (source-destination).MagnitudeSq() );
 
 		case NLOS1: {
-			UraeData::Node *n1 = pUraeData->GetNode( mClassification.mNodeSet[0] );
-			Real rm2 = (source - n1->position ).MagnitudeSq();
+			UraeData::PathlossCoefficients scratch;
+			const UraeData::PathlossCoefficients *k = pUraeData->GetPathlossCoefficients( mClassification, &scratch );
+			Real rm2 = (source - k->mCorner[0] ).MagnitudeSq();
 			Real rm = sqrt(rm2);
-			Real rs2 = ( n1->position -  destination ).MagnitudeSq();
+			Real rs2 = ( k->mCorner[0] -  destination ).MagnitudeSq();
 			Real rs = sqrt(rs2);
-			Real Wm = mClassification.mMainStreetLaneCount * pUraeData->GetLaneWidth();
-			Real Ws = mClassification.mSideStreetLaneCount * pUraeData->GetLaneWidth();
 
-			unsigned int Nmin = (unsigned int)floor( 2 * sqrt( ( rm * rs ) / ( Ws * Wm ) ) );
+			unsigned int Nmin = (unsigned int)floor( 2 * sqrt( ( rm * rs ) / k->mSideMainWidth ) );
 			//calculate PLr
-			Real PL = (pUraeData->GetLamdaBy4PiSq() * pow(pUraeData->GetLossPerReflection(), 2 * Nmin)) / pow((rm+rs),2);
+			Real PL = (pUraeData->GetLamdaBy4PiSq() * pUraeData->GetReflectionLoss( Nmin )) / pow((rm+rs),2);
 			
 			//calculate PLd
 			if ( rm < rs )
-				return (PL + ((pUraeData->GetLamdaBy4PiSq() * pUraeData->GetWavelength()) / (4 * rm * rs2)) );
+				return (PL + (pUraeData->GetLambdaTerm(1) / (4 * rm * rs2)) );
 			else
-				return (PL + ((pUraeData->GetLamdaBy4PiSq() * pUraeData->GetWavelength()) / (4 * rs * rm2)) );
+				return (PL + (pUraeData->GetLambdaTerm(1) / (4 * rs * rm2)) );
 		}	
 		case NLOS2: {
-			UraeData::Node *n1 = pUraeData->GetNode( mClassification.mNodeSet[0] );
-			UraeData::Node *n2 = pUraeData->GetNode( mClassification.mNodeSet[1] );
+			UraeData::PathlossCoefficients scratch;
+			const UraeData::PathlossCoefficients *k = pUraeData->GetPathlossCoefficients( mClassification, &scratch );
 			
-			Real rm2 = ( source - n1->position ).MagnitudeSq();
+			Real rm2 = ( source - k->mCorner[0] ).MagnitudeSq();
 			Real rm = sqrt(rm2);
-			Real rs = ( n1->position - n2->position ).Magnitude();
-			Real rp2 = ( n2->position - destination ).MagnitudeSq();
+			Real rs = k->mCornerDistance;
+			Real rp2 = ( k->mCorner[1] - destination ).MagnitudeSq();
 			Real rp = sqrt(rp2);
 			Real rsp = rs + rp;
 			
-			Real Wm = mClassification.mMainStreetLaneCount * pUraeData->GetLaneWidth();
-			Real Ws = mClassification.mSideStreetLaneCount * pUraeData->GetLaneWidth();
-			Real Wp = mClassification.mParaStreetLaneCount * pUraeData->GetLaneWidth();
+			Real Wm = k->mMainWidth;
+			Real Ws = k->mSideWidth;
+			Real Wp = k->mParaWidth;
 
-			Real temp = sqrt( ( rs * Wm * Wp ) / ( Ws * ( rm * Wp + rp * Wm ) ) );
+			Real temp = sqrt( k->mCornerDistanceWidth / ( Ws * ( rm * Wp + rp * Wm ) ) );
 			unsigned int Nmin = (unsigned int)floor((rm * temp) / Wm + rs / (Ws * temp) + (rp * temp) / Wp);
-			Real rPow2Nmin = pow(pUraeData->GetLossPerReflection(), 2*Nmin);
-			unsigned int N = (unsigned int)floor( rp * rs / ( Wp * Ws ) );
+			Real rPow2Nmin = pUraeData->GetReflectionLoss( Nmin );
+			unsigned int N = (unsigned int)floor( rp * rs / k->mParaSideWidth );
 
 			//calculate PLr
 			Real PL = (pUraeData->GetLamdaBy4PiSq() * rPow2Nmin) / pow(rsp+rm, 2);
 			
 			//calculate PLdd
 			if ( rm < rs )
-				PL += (pUraeData->GetLamdaBy4PiSq() * pow(pUraeData->GetWavelength(),2)) / (16 * rm * rs * rp2) ; 
+				PL += pUraeData->GetLambdaTerm(2) / (16 * rm * rs * rp2) ; 
 			else
-				PL += (pUraeData->GetLamdaBy4PiSq() * pow(pUraeData->GetWavelength(),2)) / (16 * rm2 * rp * rs) ; 
+				PL += pUraeData->GetLambdaTerm(2) / (16 * rm2 * rp * rs) ; 
 
 			//calculate PLrd
 			if ( rs < rp )
@@ -137,9 +136,9 @@ Real Classifier::CalculatePathloss( Vector2D source, Vector2D destination ) {
 			
 			//calculate PLdr
 			if ( rm < rsp )
-				return (PL + (pow(pUraeData->GetLossPerReflection(),2*N) * pUraeData->GetLamdaBy4PiSq() * pUraeData->GetWavelength())/(4*rm*rsp*rsp));
+				return (PL + (pUraeData->GetReflectionLoss( N ) * pUraeData->GetLamdaBy4PiSq() * pUraeData->GetWavelength())/(4*rm*rsp*rsp));
 			else
-				return (PL + (pow(pUraeData->GetLossPerReflection(),2*N) * pUraeData->GetLamdaBy4PiSq() * pUraeData->GetWavelength())/(4*rsp*rm2));
+				return (PL + (pUraeData->GetReflectionLoss( N ) * pUraeData->GetLamdaBy4PiSq() * pUraeData->GetWavelength())/(4*rsp*rm2));
 		}
 		case OutOfRange:
 		default:
@@ -164,85 +163,23 @@ void Classifier::ComputeState( Vector2D source, Vector2D destination ) {
 	UraeData::LinkIndexSet txLinks;
 	UraeData::LinkIndexSet rxLinks;
 
-	// get the grid cells in which the transmitter and receiver are located
-	UraeData::Grid *gridSource = pUraeData->GetGrid( source );
-	UraeData::Grid *gridDestination = pUraeData->GetGrid( destination );
-	UraeData::LinkIndexSet::iterator linkIndexIt;
-
-	UraeData::Node *n1, *n2;
-	UraeData::Link *pLink = NULL;
-	double nodeDist = DBL_MAX, linkDist = DBL_MAX, d;
-
-	UraeData::Node *nearestNodeTx = NULL;
-	UraeData::Link *nearestLinkTx = NULL;
-
-	// scan through the nodes
-	for ( AllInVector( linkIndexIt, gridSource->linkList ) ) {
-
-		//printf( "Classifer::ComputeState: Transmitter - Current Link: %d\n", *linkIndexIt );
-		pLink = pUraeData->GetSummedLink( *linkIndexIt );
-		n1 = pUraeData->GetNode( pLink->nodeAindex );
-		n2 = pUraeData->GetNode( pLink->nodeBindex );
-		LineSegment l( n1->position, n2->position );
-		d = l.DistanceFromLine( source );
-		if ( d < linkDist && d < pUraeData->GetLaneWidth()*pLink->NumberOfLanes ) {
-			linkDist = d;
-			nearestLinkTx = pLink;
-		}
-
-		if ( nearestNodeTx != n1 && nearestNodeTx != n2 ) {
-			d = ( source - n1->position ).Magnitude();
-			if ( nodeDist > d && n1->mSize > d ) {
-				nearestNodeTx = n1;
-				nodeDist = d;
-			}
-			d = ( source - n2->position ).Magnitude();
-			if ( nodeDist > d && n2->mSize > d ) {
-				nearestNodeTx = n2;
-			}
-		}
-
+	// look up the nearest link and intersection of the transmitter and receiver in the link raster
+	int node;
+	int link = pUraeData->MatchPosition( source, &node );
+	if ( link >= 0 )
+		txLinks.push_back( link );
+	if ( node >= 0 ) {
+		UraeData::Node *pNode = pUraeData->GetNode( node );
+		txLinks.insert( txLinks.begin(), pNode->mConnectedLinks.begin(), pNode->mConnectedLinks.end() );
 	}
 
-	txLinks.push_back( nearestLinkTx->index );
-	if ( nearestNodeTx )
-		txLinks.insert( txLinks.begin(), nearestNodeTx->mConnectedLinks.begin(), nearestNodeTx->mConnectedLinks.end() );
-
-	nodeDist = DBL_MAX;
-	linkDist = DBL_MAX;
-	UraeData::Node *nearestNodeRx = NULL;
-	UraeData::Link *nearestLinkRx = NULL;
-
-	// scan through the nodes
-	for ( AllInVector( linkIndexIt, gridDestination->linkList ) ) {
-
-		//printf( "Classifer::ComputeState: Receiver - Current Link: %d\n", *linkIndexIt );
-		pLink = pUraeData->GetSummedLink( *linkIndexIt );
-		n1 = pUraeData->GetNode( pLink->nodeAindex );
-		n2 = pUraeData->GetNode( pLink->nodeBindex );
-		LineSegment l( n1->position, n2->position );
-		d = l.DistanceFromLine( destination );
-		if ( d < linkDist && d < pUraeData->GetLaneWidth()*pLink->NumberOfLanes ) {
-			linkDist = d;
-			nearestLinkRx = pLink;
-		}
-
-		if ( nearestNodeRx != n1 && nearestNodeRx != n2 ) {
-			d = ( destination - n1->position ).Magnitude();
-			if ( nodeDist > d && n1->mSize > d ) {
-				nearestNodeRx = n1;
-				nodeDist = d;
-			}
-			d = ( destination - n2->position ).Magnitude();
-			if ( nodeDist > d && n2->mSize > d  ) {
-				nearestNodeRx = n2;
-			}
-		}
-
+	link = pUraeData->MatchPosition( destination, &node );
+	if ( link >= 0 )
+		rxLinks.push_back( link );
+	if ( node >= 0 ) {
+		UraeData::Node *pNode = pUraeData->GetNode( node );
+		rxLinks.insert( rxLinks.begin(), pNode->mConnectedLinks.begin(), pNode->mConnectedLinks.end() );
 	}
-	rxLinks.push_back( nearestLinkRx->index );
-	if ( nearestNodeRx )
-		rxLinks.insert( rxLinks.begin(), nearestNodeRx->mConnectedLinks.begin(), nearestNodeRx->mConnectedLinks.end() );
 
 	UraeData::Classification c;
 	UraeData::LinkIndexSet::iterator rxLinkIndexIt, txLinkIndexIt;
@@ -23,17 +23,406 @@
 #include <stdlib.h>
 #include <fstream>
 #include <sstream>
-#include <algorithm>
 #include <math.h>
 #include <cfloat>
+#include <cstring>
+#include <algorithm>
+
+// The channel loop has an AVX2 version, which needs four sinusoids to a register.
+#if ( defined(__x86_64__) || defined(__i386__) ) && FADING_SINUSOIDS % 4 == 0
+#define FADING_X86
+#include <immintrin.h>
+#endif
 
 using namespace std;
 using namespace Urae;
 
 DECLARE_SINGLETON(Fading);
 
+
+// The increment of a SplitMix64 generator's state.
+#define SPLITMIX64_GAMMA	0x9E3779B97F4A7C15ULL
+
+// The second word of the Philox key of the fading of time slots; the first is the seed.
+#define FADING_PHILOX_KEY	0x46414445U
+
+/*
+ * Method: uint64_t SplitMix64Output( uint64_t z );
+ * Description: The number a SplitMix64 generator gives for the state z. The n'th number after state s is the
+ * 				output of s + n*SPLITMIX64_GAMMA, so a run of them can be made in any order.
+ */
+static inline uint64_t SplitMix64Output(uint64_t z) {
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+/*
+ * Method: uint64_t SplitMix64( uint64_t &state );
+ * Description: Advances the state of a SplitMix64 generator and returns its next number.
+ */
+static inline uint64_t SplitMix64(uint64_t &state) {
+	return SplitMix64Output(state += SPLITMIX64_GAMMA);
+}
+
+
+/*
+ * Method: double UniformTurn( uint64_t random );
+ * Description: A uniform angle in [-1/2,1/2) turns, from a random number.
+ */
+static inline double UniformTurn(uint64_t random) {
+	return (random >> 11) * 0x1.0p-53 - 0.5;
+}
+
+
+/*
+ * Method: double UniformBits( uint64_t random );
+ * Description: A uniform number in [1,2), from the top 52 bits of a random number. Unlike a conversion from an
+ * 				integer, this vectorises.
+ */
+static inline double UniformBits(uint64_t random) {
+	uint64_t bits = (random >> 12) | 0x3FF0000000000000ULL;
+	double d;
+	memcpy(&d, &bits, sizeof(d));
+	return d;
+}
+
+
+/*
+ * Method: void SinCosTurn( double turns, double &sine, double &cosine );
+ * Description: Sine and cosine of an angle given in turns. Whole turns are removed exactly, which keeps the
+ * 				phases of long simulations accurate, and there are no calls or branches, so loops of it vectorise.
+ */
+static inline __attribute__((always_inline)) void SinCosTurn(double turns, double &sine, double &cosine) {
+	const double Round = 0x1.8p52;		// adding then subtracting this rounds to the nearest integer
+	turns -= (turns + Round) - Round;								// in [-1/2,1/2]
+	double quadrant = (4*turns + Round) - Round;
+	double x = (turns - 0.25*quadrant) * (2*M_PI);					// in [-pi/4,pi/4]
+	double x2 = x*x;
+
+	// the polynomials of fdlibm's kernels
+	double s = x + x*x2*(-1.66666666666666324348e-01 + x2*(8.33333333332248946124e-03 + x2*(-1.98412698298579493134e-04
+				+ x2*(2.75573137070700676789e-06 + x2*(-2.50507602534068634195e-08 + x2*1.58969099521155010221e-10)))));
+	double c = 1 - 0.5*x2 + x2*x2*(4.16666666666666019037e-02 + x2*(-1.38888888888741095749e-03 + x2*(2.48015872894767294178e-05
+				+ x2*(-2.75573143513906633035e-07 + x2*(2.08757232129817482790e-09 + x2*-1.13596475577881948265e-11)))));
+
+	// sin(x + q pi/2) and cos(x + q pi/2), with cos(q pi/2) and sin(q pi/2) as polynomials in q = -2..2
+	double q2 = quadrant*quadrant;
+	double cosQ = 1 + q2*(q2 - 7)*(1.0/6);
+	double sinQ = quadrant*(4 - q2)*(1.0/3);
+	sine = s*cosQ + c*sinQ;
+	cosine = c*cosQ - s*sinQ;
+}
+
+
+/*
+ * Method: double LogUnit( double u );
+ * Description: Natural logarithm of u in (0,1], with fdlibm's polynomial and no calls or branches, so loops of it vectorise.
+ */
+static inline __attribute__((always_inline)) double LogUnit(double u) {
+	uint64_t bits;
+	memcpy(&bits, &u, sizeof(bits));
+
+	// u = 2^e m, with m in [sqrt(1/2),sqrt(2)); the offset keeps the exponent positive, so only logical shifts are needed
+	const uint64_t RootHalf = 0x3FE6A09E667F3BCDULL;
+	uint64_t offset = bits - RootHalf;
+	uint64_t exponentBits = ((offset + (2048ULL << 52)) >> 52) | 0x4330000000000000ULL;	// 2^52 + 2048 + e
+	bits -= offset & 0xFFF0000000000000ULL;
+	double m, e;
+	memcpy(&m, &bits, sizeof(m));
+	memcpy(&e, &exponentBits, sizeof(e));
+	e -= 0x1p52 + 2048;
+
+	double f = m - 1;
+	double s = f / (2 + f);
+	double z = s*s, w = z*z;
+	double r = z*(6.666666666666735130e-01 + w*(2.857142874366239149e-01 + w*(1.818357216161805012e-01 + w*1.479819860511658591e-01)))
+			 + w*(3.999999999940941908e-01 + w*(2.222219843214978396e-01 + w*1.531383769920937332e-01));
+	double hfsq = 0.5*f*f;
+	return e*6.93147180369123816490e-01 + ((f - (hfsq - s*(hfsq + r))) + e*1.90821492927058770002e-10);
+}
+
+
+/*
+ * Method: double Envelope( int classification, double rootTwoK, double losScale, double c1, double c2 );
+ * Description: Rician fading for LOS, or Rayleigh fading for NLOS1/2, given the two gaussian components,
+ * 				sqrt(2K) and 1/2(K+1).
+ */
+static inline double Envelope(int classification, double rootTwoK, double losScale, double c1, double c2) {
+	if (classification == 0)
+		return ((c1+rootTwoK)*(c1+rootTwoK)+c2*c2)*losScale;
+	return (c1*c1+c2*c2)*0.5;
+}
+
+
+/*
+ * Method: void Phasors( const double *pFrequency, const double *pPhase, double dopplerFrequency, double time, double *pRe, double *pIm );
+ * Description: The phasors of the sinusoids of a channel at the given time or, without phases, their rotation over that time.
+ */
+static inline __attribute__((always_inline)) void Phasors(const double *pFrequency, const double *pPhase, double dopplerFrequency, double time, double *pRe, double *pIm) {
+	double turns[2*FADING_SINUSOIDS];
+	int m;
+	for (m = 0; m < 2*FADING_SINUSOIDS; m++)
+		turns[m] = dopplerFrequency*pFrequency[m]*time + (pPhase ? pPhase[m] : 0);
+	for (m = 0; m < 2*FADING_SINUSOIDS; m++)
+		SinCosTurn(turns[m], pIm[m], pRe[m]);
+}
+
+
+// The phasors are recalculated every this many samples, so rounding cannot build up.
+#define FADING_PHASOR_BLOCK		256
+
+typedef void (*ChannelKernel)(const double*, const double*, int, double, double, double, double, size_t, double*);
+
+/*
+ * Method: void FillChannelScalar( const double *pFrequency, const double *pPhase, int classification, double kFactor, ... );
+ * Description: The work of Fading::Channel::CalculateFading: each sample sums the sinusoids, whose phasors are then
+ * 				rotated on to the next sample.
+ */
+static void FillChannelScalar(const double *pFrequency, const double *pPhase, int classification, double kFactor,
+							  double startTime, double interval, double dopplerFrequency, size_t count, double *pOut) {
+	const int M = 2*FADING_SINUSOIDS;
+	double scale = sqrt(2.0/FADING_SINUSOIDS), rootTwoK = sqrt(2.0*kFactor), losScale = 1/(2*(kFactor+1));
+	double re[M], im[M], stepRe[M], stepIm[M];
+	int m;
+
+	Phasors(pFrequency, NULL, dopplerFrequency, interval, stepRe, stepIm);
+	for (size_t start = 0; start < count; start += FADING_PHASOR_BLOCK) {
+
+		Phasors(pFrequency, pPhase, dopplerFrequency, startTime + start*interval, re, im);
+		size_t end = std::min(count, start + FADING_PHASOR_BLOCK);
+		for (size_t s = start; s < end; s++) {
+			// the in-phase component is the sum of cosines, the quadrature the sum of sines
+			double c1 = 0, c2 = 0;
+			for (m = 0; m < FADING_SINUSOIDS; m++) {
+				c1 += re[m];
+				c2 += im[FADING_SINUSOIDS+m];
+			}
+			pOut[s] = Envelope(classification, rootTwoK, losScale, c1*scale, c2*scale);
+
+			for (m = 0; m < M; m++) {
+				double r = re[m]*stepRe[m] - im[m]*stepIm[m];
+				im[m] = re[m]*stepIm[m] + im[m]*stepRe[m];
+				re[m] = r;
+			}
+		}
+
+	}
+}
+
+
+#ifdef FADING_X86
+
+/*
+ * Method: void FillChannelAvx2( const double *pFrequency, const double *pPhase, int classification, double kFactor, ... );
+ * Description: FillChannelScalar with the phasors held four to a register.
+ */
+__attribute__((target("avx2,fma")))
+static void FillChannelAvx2(const double *pFrequency, const double *pPhase, int classification, double kFactor,
+							double startTime, double interval, double dopplerFrequency, size_t count, double *pOut) {
+	const int V = 2*FADING_SINUSOIDS/4, H = V/2;		// registers of phasors, the first H in-phase, the rest quadrature
+	double scale = sqrt(2.0/FADING_SINUSOIDS), rootTwoK = sqrt(2.0*kFactor), losScale = 1/(2*(kFactor+1));
+	double re[4*V], im[4*V];
+	__m256d zRe[V], zIm[V], stepRe[V], stepIm[V];
+	int v;
+
+	Phasors(pFrequency, NULL, dopplerFrequency, interval, re, im);
+	for (v = 0; v < V; v++) {
+		stepRe[v] = _mm256_loadu_pd(re + 4*v);
+		stepIm[v] = _mm256_loadu_pd(im + 4*v);
+	}
+
+	for (size_t start = 0; start < count; start += FADING_PHASOR_BLOCK) {
+
+		Phasors(pFrequency, pPhase, dopplerFrequency, startTime + start*interval, re, im);
+		for (v = 0; v < V; v++) {
+			zRe[v] = _mm256_loadu_pd(re + 4*v);
+			zIm[v] = _mm256_loadu_pd(im + 4*v);
+		}
+
+		size_t end = std::min(count, start + FADING_PHASOR_BLOCK);
+		for (size_t s = start; s < end; s++) {
+			__m256d c1 = zRe[0], c2 = zIm[H];
+			for (v = 1; v < H; v++) {
+				c1 = _mm256_add_pd(c1, zRe[v]);
+				c2 = _mm256_add_pd(c2, zIm[H+v]);
+			}
+			__m256d pairs = _mm256_hadd_pd(c1, c2);
+			__m128d sums = _mm_add_pd(_mm256_castpd256_pd128(pairs), _mm256_extractf128_pd(pairs, 1));
+			pOut[s] = Envelope(classification, rootTwoK, losScale, _mm_cvtsd_f64(sums)*scale, _mm_cvtsd_f64(_mm_unpackhi_pd(sums, sums))*scale);
+
+			for (v = 0; v < V; v++) {
+				__m256d r = _mm256_fmsub_pd(zRe[v], stepRe[v], _mm256_mul_pd(zIm[v], stepIm[v]));
+				zIm[v] = _mm256_fmadd_pd(zRe[v], stepIm[v], _mm256_mul_pd(zIm[v], stepRe[v]));
+				zRe[v] = r;
+			}
+		}
+
+	}
+}
+
+#endif // #ifdef FADING_X86
+
+
+/*
+ * Method: void Philox4x32( uint32_t key0, uint32_t key1, uint32_t *pCounter );
+ * Description: The Philox4x32-10 counter-based generator of Salmon et al.: replaces the four words of the counter with
+ * 				the random numbers for that counter and key. It keeps no state, so a loop over counters vectorises.
+ */
+static inline __attribute__((always_inline)) void Philox4x32(uint32_t key0, uint32_t key1, uint32_t *pCounter) {
+	uint32_t x0 = pCounter[0], x1 = pCounter[1], x2 = pCounter[2], x3 = pCounter[3];
+	for (int round = 0; round < 10; round++) {
+		uint64_t p0 = (uint64_t)0xD2511F53U * x0, p1 = (uint64_t)0xCD9E8D57U * x2;
+		x0 = (uint32_t)(p1 >> 32) ^ x1 ^ key0;
+		x1 = (uint32_t)p1;
+		x2 = (uint32_t)(p0 >> 32) ^ x3 ^ key1;
+		x3 = (uint32_t)p0;
+		key0 += 0x9E3779B9U;
+		key1 += 0xBB67AE85U;
+	}
+	pCounter[0] = x0; pCounter[1] = x1; pCounter[2] = x2; pCounter[3] = x3;
+}
+
+
+/* struct SplitMix64Pairs
+ * The random numbers of a stream: pair i is the next 2i+1'th and 2i+2'th numbers of its SplitMix64 generator.
+ */
+struct SplitMix64Pairs {
+	uint64_t mState;
+	inline void operator()(size_t i, uint64_t &r1, uint64_t &r2) const {
+		r1 = SplitMix64Output(mState + (2*i+1)*SPLITMIX64_GAMMA);
+		r2 = SplitMix64Output(mState + (2*i+2)*SPLITMIX64_GAMMA);
+	}
+};
+
+
+/* struct PhiloxPairs
+ * The random numbers of a pair of hosts: pair i is the Philox output for their IDs and the time slot mSlot + i.
+ */
+struct PhiloxPairs {
+	uint32_t mKey[2];
+	uint32_t mTxId, mRxId;
+	uint64_t mSlot;
+	inline void operator()(size_t i, uint64_t &r1, uint64_t &r2) const {
+		uint64_t slot = mSlot + i;
+		uint32_t x[4] = { mTxId, mRxId, (uint32_t)slot, (uint32_t)(slot >> 32) };
+		Philox4x32(mKey[0], mKey[1], x);
+		r1 = ((uint64_t)x[1] << 32) | x[0];
+		r2 = ((uint64_t)x[3] << 32) | x[2];
+	}
+};
+
+
+/*
+ * Method: void BoxMuller( size_t n, const Generator &generator, double *pC1, double *pC2 );
+ * Description: Fills pC1 and pC2 with n pairs of independent unit gaussians, from the n pairs of random numbers of
+ * 				the generator. Each pair depends only on its index, so the loops vectorise.
+ */
+template <class Generator>
+static inline __attribute__((always_inline)) void BoxMuller(size_t n, const Generator &generator, double *pC1, double *pC2) {
+	size_t i;
+	for (i = 0; i < n; i++) {
+		uint64_t r1, r2;
+		generator(i, r1, r2);
+		pC1[i] = -2*LogUnit(2 - UniformBits(r1));		// of a uniform number in (0,1]
+		pC2[i] = UniformBits(r2) - 1.5;					// in turns
+	}
+	// the square roots are taken in a loop of their own, as their errno check keeps a loop from vectorising
+	for (i = 0; i < n; i++)
+		pC1[i] = sqrt(pC1[i]);
+	for (i = 0; i < n; i++) {
+		double sine, cosine;
+		SinCosTurn(pC2[i], sine, cosine);
+		pC2[i] = pC1[i]*sine;
+		pC1[i] *= cosine;
+	}
+}
+
+
+template <class Generator>
+static void BoxMullerScalar(size_t n, const Generator &generator, double *pC1, double *pC2) {
+	BoxMuller(n, generator, pC1, pC2);
+}
+
+#ifdef FADING_X86
+template <class Generator>
+__attribute__((target("avx2,fma")))
+static void BoxMullerAvx2(size_t n, const Generator &generator, double *pC1, double *pC2) {
+	BoxMuller(n, generator, pC1, pC2);
+}
+#endif // #ifdef FADING_X86
+
+
+/*
+ * Method: bool HasAvx2();
+ * Description: Returns true if the CPU (and this build) supports the AVX2 versions of the loops, which also use FMA.
+ */
+static bool HasAvx2() {
+#ifdef FADING_X86
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+	return false;
+#endif // #ifdef FADING_X86
+}
+
+
+/*
+ * Method: ChannelKernel SelectChannelKernel();
+ * Description: The version of the channel loop for the best instruction set the CPU supports.
+ */
+static ChannelKernel SelectChannelKernel() {
+#ifdef FADING_X86
+	if (HasAvx2())
+		return &FillChannelAvx2;
+#endif // #ifdef FADING_X86
+	return &FillChannelScalar;
+}
+
+
+/*
+ * Method: void (*SelectGaussianKernel())( size_t n, const Generator &generator, double *pC1, double *pC2 );
+ * Description: The version of the Box-Muller loop for the best instruction set the CPU supports.
+ */
+template <class Generator>
+static void (*SelectGaussianKernel())(size_t, const Generator&, double*, double*) {
+#ifdef FADING_X86
+	if (HasAvx2())
+		return &BoxMullerAvx2<Generator>;
+#endif // #ifdef FADING_X86
+	return &BoxMullerScalar<Generator>;
+}
+
+
+/*
+ * Method: void GaussianComponents( size_t count, const Generator &generator, double *pC1, double *pC2 );
+ * Description: Fills pC1 and pC2 with count pairs of gaussian components, from the generator's random numbers.
+ */
+template <class Generator>
+static void GaussianComponents(size_t count, const Generator &generator, double *pC1, double *pC2) {
+	static void (*const kernel)(size_t, const Generator&, double*, double*) = SelectGaussianKernel<Generator>();
+	kernel(count, generator, pC1, pC2);
+}
+
+
 Fading::Fading(const char* componentsFile, int seed) {
-	srand(seed);
+	mSeed = seed;
+	mSamplingRate = 0;
+	mBaseDopplerFrequency = 0;
+	mNumGaussianComponents = 0;
+	if (componentsFile && *componentsFile)
+		LoadComponents(componentsFile);
+
+	pthread_key_create(&mThreadStreamKey, NULL);
+	pthread_mutex_init(&mThreadStreamMutex, NULL);
+}
+
+
+/*
+ * Method: void LoadComponents( const char* componentsFile );
+ * Description: Reads the gaussian component lists from the given file.
+ */
+void Fading::LoadComponents(const char* componentsFile) {
 	ifstream fin;
 	fin.open(componentsFile);
 	
@@ -44,8 +433,7 @@ Fading::Fading(const char* componentsFile, int seed) {
 	string buffer;
 	double temp;
 
-	while (1) {
-		getline(fin, buffer);
+	while (getline(fin, buffer)) {
 		istringstream sfin(buffer);
 		if (sfin.peek() == '#') {
 			continue;
@@ -71,50 +459,255 @@ Fading::Fading(const char* componentsFile, int seed) {
 		mComponents1.push_back(temp);
 		fin>>temp;
 		mComponents2.push_back(temp);
+		if (fin.fail())
+			break;
 	}
 	
-	random_shuffle(mComponents1.begin(), mComponents1.end());
-	random_shuffle(mComponents2.begin(), mComponents2.end());
-	mCurrentIndex = 0;
-	pthread_mutex_init(&mListMutex, NULL);
-	
-	
+	if (mNumGaussianComponents <= 0 || fin.fail()) {
+		THROW_EXCEPTION("Too few gaussian components in file: %s\n", componentsFile);
+	}
 	fin.close();
 }
 
 Fading::~Fading() {
-	pthread_mutex_destroy(&mListMutex);
+	for (size_t i = 0; i < mThreadStreams.size(); i++)
+		delete mThreadStreams[i];
+	pthread_key_delete(mThreadStreamKey);
+	pthread_mutex_destroy(&mThreadStreamMutex);
 }
-	
 
-void Fading::SetArrayIdx() {
-	if (mCurrentIndex < mNumGaussianComponents) {
-		//just increment the array index
-		pthread_mutex_lock(&mListMutex);
-		++mCurrentIndex;
-		pthread_mutex_unlock(&mListMutex);
-	} else {
-		//reset the index to 0 and reshuffle the array
-		pthread_mutex_lock(&mListMutex);
-		mCurrentIndex = 0;
-		random_shuffle(mComponents1.begin(), mComponents1.end());
-		random_shuffle(mComponents2.begin(), mComponents2.end());
-		pthread_mutex_unlock(&mListMutex);
+
+/*
+ * Method: Stream *GetThreadStream();
+ * Description: Get the calling thread's stream, creating it on its first call.
+ */
+Fading::Stream *Fading::GetThreadStream() {
+	Stream *pStream = (Stream*)pthread_getspecific(mThreadStreamKey);
+	if (!pStream) {
+		// threads are numbered in the order they first ask for fading
+		pthread_mutex_lock(&mThreadStreamMutex);
+		pStream = new Stream(this, mThreadStreams.size());
+		mThreadStreams.push_back(pStream);
+		pthread_mutex_unlock(&mThreadStreamMutex);
+		pthread_setspecific(mThreadStreamKey, pStream);
 	}
+	return pStream;
 }
 
+
+/*
+ * Method: double CalculateFading( int classification, double kFactor );
+ * Description: Draws a sample from the calling thread's own stream, which is created on its first call.
+ */
 double Fading::CalculateFading(int classification, double kFactor) {
-	if ( kFactor == DBL_MAX )
-		return 1;
-	if (classification == 0) {
-		//rician fading for LOS		
-		SetArrayIdx();
-		return ((pow((mComponents1[mCurrentIndex]+sqrt(2.0*kFactor)),2)+pow(mComponents2[mCurrentIndex],2))/(2*(kFactor+1)));
-	} else if (classification <= 2) {
-		//rayleigh fading for NLOS1/2
-		SetArrayIdx();
-		return ((pow(mComponents1[mCurrentIndex],2)+pow(mComponents2[mCurrentIndex],2))/2);
-	} else {
-		return 0;
+	return GetThreadStream()->CalculateFading(classification, kFactor);
+}
+
+
+/*
+ * Method: void CalculateFading( int classification, double kFactor, size_t count, double *pOut );
+ * Description: Fills pOut with count samples from the calling thread's own stream.
+ */
+void Fading::CalculateFading(int classification, double kFactor, size_t count, double *pOut) {
+	GetThreadStream()->CalculateFading(classification, kFactor, count, pOut);
+}
+
+
+/*
+ * Method: double CalculateFading( int classification, double kFactor, uint32_t txId, uint32_t rxId, uint64_t slot ) const;
+ * Description: The fading of the pair of hosts in the given time slot.
+ */
+double Fading::CalculateFading(int classification, double kFactor, uint32_t txId, uint32_t rxId, uint64_t slot) const {
+	double f;
+	CalculateFading(classification, kFactor, txId, rxId, slot, 1, &f);
+	return f;
+}
+
+
+/*
+ * Method: void CalculateFading( int classification, double kFactor, uint32_t txId, uint32_t rxId, uint64_t firstSlot, ... ) const;
+ * Description: Fills pOut with the fading of the pair of hosts in count time slots from firstSlot. The components of
+ * 				each slot are made by the Box-Muller transform from the Philox numbers for the seed, hosts and slot.
+ */
+void Fading::CalculateFading(int classification, double kFactor, uint32_t txId, uint32_t rxId, uint64_t firstSlot, size_t count, double *pOut) const {
+	if ( kFactor >= DBL_MAX || classification > 2 ) {
+		for (size_t s = 0; s < count; s++)
+			pOut[s] = ( kFactor >= DBL_MAX ) ? 1 : 0;
+		return;
+	}
+
+	const size_t Block = 64;
+	double rootTwoK = sqrt(2.0*kFactor), losScale = 1/(2*(kFactor+1));
+	double c1[Block], c2[Block];
+	PhiloxPairs generator = { { (uint32_t)mSeed, FADING_PHILOX_KEY }, txId, rxId, firstSlot };
+	for (size_t start = 0; start < count; start += Block) {
+		size_t n = std::min(count - start, Block);
+		GaussianComponents(n, generator, c1, c2);
+		generator.mSlot += n;
+		for (size_t i = 0; i < n; i++)
+			pOut[start+i] = Envelope(classification, rootTwoK, losScale, c1[i], c2[i]);
+	}
+}
+
+
+Fading::Stream::Stream() {
+	m_pFading = NULL;
+	mState = 0;
+	mPosition[0] = mPosition[1] = 0;
+	mStride[0] = mStride[1] = 1;
+	mRemaining = 0;
+}
+
+
+Fading::Stream::Stream(const Fading *pFading, uint64_t streamId) {
+	m_pFading = pFading;
+	// mix the seed before adding the stream ID, so neighbouring IDs give unrelated streams
+	mState = (uint64_t)(uint32_t)pFading->mSeed;
+	mState = NextRandom() ^ streamId;
+	mPosition[0] = mPosition[1] = 0;
+	mStride[0] = mStride[1] = 1;
+	mRemaining = 0;
+}
+
+
+/*
+ * Method: uint64_t NextRandom();
+ * Description: The next number of the stream's own generator.
+ */
+uint64_t Fading::Stream::NextRandom() {
+	return SplitMix64(mState);
+}
+
+
+/*
+ * Method: void NextPass();
+ * Description: Chooses the start and stride through each list for the next pass. A stride with no factor in
+ * 				common with the number of components visits each of them once before returning to the start.
+ */
+void Fading::Stream::NextPass() {
+	unsigned int n = m_pFading->mNumGaussianComponents;
+	for (int j = 0; j < 2; j++) {
+		mPosition[j] = NextRandom() % n;
+		unsigned int stride = (n > 1) ? 1 + NextRandom() % (n - 1) : 1;
+		for (;;) {
+			unsigned int a = n, b = stride;
+			while (b) {
+				unsigned int t = a % b;
+				a = b;
+				b = t;
+			}
+			if (a == 1)
+				break;
+			stride = stride % (n - 1) + 1;
+		}
+		mStride[j] = stride;
+	}
+	mRemaining = n;
+}
+
+
+double Fading::Stream::CalculateFading(int classification, double kFactor) {
+	double f;
+	CalculateFading(classification, kFactor, 1, &f);
+	return f;
+}
+
+
+/*
+ * Method: void CalculateFading( int classification, double kFactor, size_t count, double *pOut );
+ * Description: Fills pOut with the next count samples.
+ */
+void Fading::Stream::CalculateFading(int classification, double kFactor, size_t count, double *pOut) {
+	if ( !m_pFading || kFactor >= DBL_MAX || classification > 2 ) {
+		for (size_t s = 0; s < count; s++)
+			pOut[s] = ( !m_pFading || kFactor >= DBL_MAX ) ? 1 : 0;
+		return;
+	}
+
+	const size_t Block = 64;
+	double rootTwoK = sqrt(2.0*kFactor), losScale = 1/(2*(kFactor+1));
+	double c1[Block], c2[Block];
+	for (size_t start = 0; start < count; start += Block) {
+		size_t n = std::min(count - start, Block);
+		NextComponents(n, c1, c2);
+		for (size_t i = 0; i < n; i++)
+			pOut[start+i] = Envelope(classification, rootTwoK, losScale, c1[i], c2[i]);
+	}
+}
+
+
+/*
+ * Method: void NextComponents( size_t count, double *pC1, double *pC2 );
+ * Description: The next count pairs of gaussian components, from the lists or generated.
+ */
+void Fading::Stream::NextComponents(size_t count, double *pC1, double *pC2) {
+	size_t i;
+	if (m_pFading->mNumGaussianComponents == 0) {
+		SplitMix64Pairs generator = { mState };
+		GaussianComponents(count, generator, pC1, pC2);
+		mState += 2*count*SPLITMIX64_GAMMA;
+		return;
+	}
+
+	unsigned int n = m_pFading->mNumGaussianComponents;
+	for (i = 0; i < count; i++) {
+		if (mRemaining == 0)
+			NextPass();
+		pC1[i] = m_pFading->mComponents1[mPosition[0]];
+		pC2[i] = m_pFading->mComponents2[mPosition[1]];
+		for (int j = 0; j < 2; j++) {
+			mPosition[j] += mStride[j];
+			if (mPosition[j] >= n)
+				mPosition[j] -= n;
+		}
+		mRemaining--;
 	}
 }
+
+
+Fading::Channel::Channel() {
+	for (int m = 0; m < 2*FADING_SINUSOIDS; m++) {
+		mFrequency[m] = 0;
+		mPhase[m] = 0;
+	}
+}
+
+
+Fading::Channel::Channel(int seed, uint64_t channelId) {
+	uint64_t state = (uint64_t)(uint32_t)seed;
+	state = SplitMix64(state) ^ channelId;
+
+	// angles of arrival 2 pi (n - 1/2 + theta) / 4M, with one random theta for the channel, and independent phases
+	double theta = UniformTurn(SplitMix64(state));
+	for (int n = 0; n < FADING_SINUSOIDS; n++)
+		SinCosTurn((n + 0.5 + theta) / (4*FADING_SINUSOIDS), mFrequency[FADING_SINUSOIDS+n], mFrequency[n]);
+	for (int m = 0; m < 2*FADING_SINUSOIDS; m++)
+		mPhase[m] = UniformTurn(SplitMix64(state));
+}
+
+
+/*
+ * Method: double CalculateFading( int classification, double kFactor, double time, double dopplerFrequency ) const;
+ * Description: The fading at the given time (in s), for the given maximum Doppler frequency (in Hz).
+ */
+double Fading::Channel::CalculateFading(int classification, double kFactor, double time, double dopplerFrequency) const {
+	double f;
+	CalculateFading(classification, kFactor, time, 0, dopplerFrequency, 1, &f);
+	return f;
+}
+
+
+/*
+ * Method: void CalculateFading( int classification, double kFactor, double startTime, double interval, ... ) const;
+ * Description: Fills pOut with the fading at count times, interval apart.
+ */
+void Fading::Channel::CalculateFading(int classification, double kFactor, double startTime, double interval, double dopplerFrequency, size_t count, double *pOut) const {
+	if ( kFactor >= DBL_MAX || classification > 2 ) {
+		for (size_t s = 0; s < count; s++)
+			pOut[s] = ( kFactor >= DBL_MAX ) ? 1 : 0;
+		return;
+	}
+
+	static const ChannelKernel kernel = SelectChannelKernel();
+	kernel(mFrequency, mPhase, classification, kFactor, startTime, interval, dopplerFrequency, count, pOut);
+}
@@ -0,0 +1,449 @@
+/*
+ *  GraphClassifier.cpp - Classifies link pairs from the road graph when the classification file has no entry for them.
+ *  Copyright (C) 2012  C. S. Cooper, A. Mukunthan
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contact Details: Cooper - andor734@gmail.com
+ */
+
+#include <cmath>
+#include <climits>
+#include <algorithm>
+
+#include "Urae.h"
+#include "GraphClassifier.h"
+
+
+using namespace std;
+using namespace VectorMath;
+using namespace Urae;
+
+
+// Links meeting at a node continue the same street if they turn by no more than this (30 degrees).
+static const Real StraightCosine = -0.866025403784;
+
+typedef std::unordered_map<int,UraeData::ClassificationRecord> RouteMap;
+
+
+/*
+ * Method: UraeData::ClassificationRecord MakeRoute( int classification, int nodeCount, int n1, int n2, Real main, Real side, Real para );
+ * Description: Fills in a classification record.
+ */
+static UraeData::ClassificationRecord MakeRoute( int classification, int nodeCount, int n1, int n2, Real main, Real side, Real para ) {
+
+	UraeData::ClassificationRecord r;
+	r.mNodeSet[0] = n1;
+	r.mNodeSet[1] = n2;
+	r.mFullNodeCount = nodeCount;
+	r.mMainStreetLaneCount = main;
+	r.mSideStreetLaneCount = side;
+	r.mParaStreetLaneCount = para;
+	r.mClassification = classification;
+	r.mPadding[0] = r.mPadding[1] = r.mPadding[2] = 0;
+	return r;
+
+}
+
+
+/*
+ * Method: void OfferRoute( RouteMap &routes, int other, const UraeData::ClassificationRecord &route );
+ * Description: Keeps the route to the other link if it has a lower classification, or the same and fewer nodes,
+ * 				than the best found so far. Of equal routes the first found is kept.
+ */
+static void OfferRoute( RouteMap &routes, int other, const UraeData::ClassificationRecord &route ) {
+
+	std::pair<RouteMap::iterator,bool> ins = routes.insert( std::make_pair( other, route ) );
+	if ( ins.second )
+		return;
+
+	UraeData::ClassificationRecord &best = ins.first->second;
+	if ( route.mClassification < best.mClassification || ( route.mClassification == best.mClassification && route.mFullNodeCount < best.mFullNodeCount ) )
+		best = route;
+
+}
+
+
+GraphClassifier::GraphClassifier( UraeData *pData, Real range ) {
+
+	m_pData = pData;
+	mRange = range;
+	m_pAllRows = NULL;
+	mNextLink = 0;
+
+	for ( int s = 0; s < ShardCount; s++ )
+		pthread_mutex_init( &mShards[s].mMutex, NULL );
+
+	ComputeContinuations();
+
+}
+
+
+GraphClassifier::~GraphClassifier() {
+
+	for ( int s = 0; s < ShardCount; s++ ) {
+		std::unordered_map<int,Row*>::iterator it;
+		for ( it = mShards[s].mRows.begin(); it != mShards[s].mRows.end(); it++ )
+			delete it->second;
+		pthread_mutex_destroy( &mShards[s].mMutex );
+	}
+
+}
+
+
+/*
+ * Method: bool Classify( const VectorMath::OrderedIndexPair &linkPair, UraeData::ClassificationRecord *pRecord );
+ * Description: Writes the classification of the given pair of summed links to pRecord, computing the classifications
+ * 				of the first link if they are not in the cache. Returns false if the links are out of range.
+ */
+bool GraphClassifier::Classify( const OrderedIndexPair &linkPair, UraeData::ClassificationRecord *pRecord ) {
+
+	if ( linkPair.first < 0 || linkPair.second >= m_pData->GetSummedLinkCount() )
+		return false;
+
+	CacheShard &shard = mShards[ ( (uint64_t)linkPair.first * 0x9E3779B97F4A7C15ULL ) >> 58 ];
+
+	pthread_mutex_lock( &shard.mMutex );
+	std::unordered_map<int,Row*>::const_iterator it = shard.mRows.find( linkPair.first );
+	const Row *pRow = ( it != shard.mRows.end() ) ? it->second : NULL;
+	pthread_mutex_unlock( &shard.mMutex );
+
+	if ( !pRow ) {
+
+		// Computed without the lock. If another thread got there first, its row (which is the same) is kept.
+		Row *pNewRow = new Row;
+		ClassifyFrom( linkPair.first, &pNewRow->mOthers, &pNewRow->mRecords );
+		pthread_mutex_lock( &shard.mMutex );
+		std::pair<std::unordered_map<int,Row*>::iterator,bool> ins = shard.mRows.insert( std::make_pair( linkPair.first, pNewRow ) );
+		pthread_mutex_unlock( &shard.mMutex );
+		if ( !ins.second )
+			delete pNewRow;
+		pRow = ins.first->second;
+
+	}
+
+	// Rows are never changed once they are in the cache, so this needs no lock.
+	std::vector<int32_t>::const_iterator other = std::lower_bound( pRow->mOthers.begin(), pRow->mOthers.end(), linkPair.second );
+	if ( other == pRow->mOthers.end() || *other != linkPair.second )
+		return false;
+
+	*pRecord = pRow->mRecords[ other - pRow->mOthers.begin() ];
+	return true;
+
+}
+
+
+/*
+ * Method: void ClassifyFrom( int link, std::vector<int32_t> *pOthers, std::vector<UraeData::ClassificationRecord> *pRecords ) const;
+ * Description: Appends the links not less than the given one which are in range of it, in ascending order, and their classifications.
+ */
+void GraphClassifier::ClassifyFrom( int link, std::vector<int32_t> *pOthers, std::vector<UraeData::ClassificationRecord> *pRecords ) const {
+
+	UraeData::Link *pLink = m_pData->GetSummedLink( link );
+	LineSegment from = GetSegment( link );
+	Real main = pLink->NumberOfLanes;
+	RouteMap routes;
+
+	// The nodes along the street of the link, in both directions.
+	StreetNodeList street, side, para;
+	WalkStreet( link, pLink->nodeAindex, from, &street );
+	WalkStreet( link, pLink->nodeBindex, from, &street );
+
+	// LOS: links on the same street.
+	StreetNodeList::const_iterator it, sideIt, paraIt;
+	for ( AllInVector( it, street ) )
+		OfferRoute( routes, it->mLink, MakeRoute( Classifier::LOS, it->mNodeCount - 1, -1, -1, main, 0, 0 ) );
+
+	for ( AllInVector( it, street ) ) {
+
+		if ( !it->mInRange )
+			continue;
+
+		// NLOS1: links on the streets crossing at each junction.
+		int on = GetContinuation( it->mLink, it->mNode );
+		UraeData::Node *pNode = m_pData->GetNode( it->mNode );
+		UraeData::LinkIndexSet::const_iterator sideLink;
+		for ( AllInVector( sideLink, pNode->mConnectedLinks ) ) {
+
+			if ( *sideLink == it->mLink || *sideLink == on )
+				continue;
+
+			UraeData::Link *pSide = m_pData->GetSummedLink( *sideLink );
+			side.clear();
+			WalkStreet( *sideLink, pSide->nodeAindex == it->mNode ? pSide->nodeBindex : pSide->nodeAindex, from, &side );
+
+			for ( AllInVector( sideIt, side ) ) {
+
+				Real lanes = m_pData->GetSummedLink( sideIt->mLink )->NumberOfLanes;
+				OfferRoute( routes, sideIt->mLink, MakeRoute( Classifier::NLOS1, it->mNodeCount + sideIt->mNodeCount - 1, it->mNode, -1, main, lanes, 0 ) );
+				if ( !sideIt->mInRange || sideIt->mNode == it->mNode )
+					continue;
+
+				// NLOS2: links on the streets crossing the side street at each of its junctions.
+				int sideOn = GetContinuation( sideIt->mLink, sideIt->mNode );
+				UraeData::Node *pSideNode = m_pData->GetNode( sideIt->mNode );
+				UraeData::LinkIndexSet::const_iterator paraLink;
+				for ( AllInVector( paraLink, pSideNode->mConnectedLinks ) ) {
+
+					if ( *paraLink == sideIt->mLink || *paraLink == sideOn )
+						continue;
+
+					UraeData::Link *pPara = m_pData->GetSummedLink( *paraLink );
+					para.clear();
+					WalkStreet( *paraLink, pPara->nodeAindex == sideIt->mNode ? pPara->nodeBindex : pPara->nodeAindex, from, &para );
+
+					for ( AllInVector( paraIt, para ) )
+						OfferRoute( routes, paraIt->mLink, MakeRoute( Classifier::NLOS2, it->mNodeCount + sideIt->mNodeCount + paraIt->mNodeCount - 1,
+																	  it->mNode, sideIt->mNode, main, pSide->NumberOfLanes,
+																	  m_pData->GetSummedLink( paraIt->mLink )->NumberOfLanes ) );
+
+				}
+
+			}
+
+		}
+
+	}
+
+	// Only the pairs this link heads are kept, as in the classification table.
+	std::vector<int32_t> others;
+	RouteMap::const_iterator route;
+	for ( route = routes.begin(); route != routes.end(); route++ ) {
+		if ( route->first < link )
+			continue;
+		if ( mRange > 0 && from.DistanceFromSegment( GetSegment( route->first ) ) > mRange )
+			continue;
+		others.push_back( route->first );
+	}
+
+	std::sort( others.begin(), others.end() );
+	std::vector<int32_t>::const_iterator other;
+	for ( AllInVector( other, others ) ) {
+		pOthers->push_back( *other );
+		pRecords->push_back( routes.find( *other )->second );
+	}
+
+}
+
+
+/*
+ * Method: void ClassifyAll( unsigned int threads, std::vector<uint64_t> *pRowOffsets, std::vector<int32_t> *pOthers, std::vector<UraeData::ClassificationRecord> *pRecords );
+ * Description: Classifies every link with ClassifyFrom, sharing the links between the given number of threads,
+ * 				and fills in a table of compressed rows, one per link. The table is the same whatever the thread count.
+ */
+void GraphClassifier::ClassifyAll( unsigned int threads, std::vector<uint64_t> *pRowOffsets, std::vector<int32_t> *pOthers, std::vector<UraeData::ClassificationRecord> *pRecords ) {
+
+	int linkCount = m_pData->GetSummedLinkCount();
+	std::vector<Row> rows( linkCount );
+	m_pAllRows = &rows;
+	mNextLink = 0;
+
+	if ( threads < 1 )
+		threads = 1;
+	if ( threads > (unsigned int)linkCount )
+		threads = linkCount;
+
+	pthread_mutex_init( &mNextLinkMutex, NULL );
+
+	pthread_t *pThreads = new pthread_t[threads];
+	unsigned int started;
+	for ( started = 0; started < threads; started++ ) {
+		if ( pthread_create( &pThreads[started], NULL, &GraphClassifier::ClassifierThread, this ) )
+			break;
+	}
+
+	// If no thread could be created, this thread does all the work.
+	if ( started == 0 )
+		ClassifierThread( this );
+
+	for ( unsigned int i = 0; i < started; i++ )
+		pthread_join( pThreads[i], NULL );
+
+	delete[] pThreads;
+	pthread_mutex_destroy( &mNextLinkMutex );
+	m_pAllRows = NULL;
+
+	// Join the rows in link order.
+	pRowOffsets->assign( 1, 0 );
+	pOthers->clear();
+	pRecords->clear();
+	for ( int l = 0; l < linkCount; l++ ) {
+		pOthers->insert( pOthers->end(), rows[l].mOthers.begin(), rows[l].mOthers.end() );
+		pRecords->insert( pRecords->end(), rows[l].mRecords.begin(), rows[l].mRecords.end() );
+		pRowOffsets->push_back( pOthers->size() );
+	}
+
+}
+
+
+/*
+ * Method: static void *ClassifierThread( void *pArg );
+ * Description: Worker thread of ClassifyAll, which takes links until every one has been classified.
+ */
+void *GraphClassifier::ClassifierThread( void *pArg ) {
+
+	GraphClassifier *pClassifier = (GraphClassifier*)pArg;
+	int linkCount = pClassifier->m_pAllRows->size();
+
+	while ( true ) {
+
+		pthread_mutex_lock( &pClassifier->mNextLinkMutex );
+		int link = pClassifier->mNextLink++;
+		pthread_mutex_unlock( &pClassifier->mNextLinkMutex );
+		if ( link >= linkCount )
+			break;
+
+		Row &row = (*pClassifier->m_pAllRows)[link];
+		pClassifier->ClassifyFrom( link, &row.mOthers, &row.mRecords );
+
+	}
+
+	return NULL;
+
+}
+
+
+/*
+ * Method: size_t GetCachedLinkCount();
+ * Description: Get the number of links whose classifications are in the cache.
+ */
+size_t GraphClassifier::GetCachedLinkCount() {
+
+	size_t count = 0;
+	for ( int s = 0; s < ShardCount; s++ ) {
+		pthread_mutex_lock( &mShards[s].mMutex );
+		count += mShards[s].mRows.size();
+		pthread_mutex_unlock( &mShards[s].mMutex );
+	}
+	return count;
+
+}
+
+
+/*
+ * Method: void ComputeContinuations();
+ * Description: Finds the link which continues the street of each summed link at each of its ends.
+ */
+void GraphClassifier::ComputeContinuations() {
+
+	int linkCount = m_pData->GetSummedLinkCount();
+	mContinuations.assign( linkCount * 2, -1 );
+
+	// The straightest way on from each end of each link, if it is straight enough.
+	std::vector<int32_t> straightest( linkCount * 2, -1 );
+	for ( int l = 0; l < linkCount; l++ ) {
+
+		UraeData::Link *pLink = m_pData->GetSummedLink( l );
+		for ( int end = 0; end < 2; end++ ) {
+
+			int node = end == 0 ? pLink->nodeAindex : pLink->nodeBindex;
+			int other = end == 0 ? pLink->nodeBindex : pLink->nodeAindex;
+			UraeData::Node *pNode = m_pData->GetNode( node );
+			Vector2D in = ( m_pData->GetNode( other )->position - pNode->position ).Unitise();
+
+			Real best = StraightCosine;
+			UraeData::LinkIndexSet::iterator it;
+			for ( AllInVector( it, pNode->mConnectedLinks ) ) {
+
+				if ( *it == l )
+					continue;
+				UraeData::Link *pNext = m_pData->GetSummedLink( *it );
+				int far = pNext->nodeAindex == node ? pNext->nodeBindex : pNext->nodeAindex;
+				Real c = in.DotProduct( ( m_pData->GetNode( far )->position - pNode->position ).Unitise() );
+				if ( c <= best ) {
+					best = c;
+					straightest[ l * 2 + end ] = *it;
+				}
+
+			}
+
+		}
+
+	}
+
+	// A street only goes on through a node if both links are each other's straightest way on,
+	// so that crossing streets are never joined.
+	for ( int l = 0; l < linkCount; l++ ) {
+		UraeData::Link *pLink = m_pData->GetSummedLink( l );
+		for ( int end = 0; end < 2; end++ ) {
+			int next = straightest[ l * 2 + end ];
+			if ( next < 0 )
+				continue;
+			int node = end == 0 ? pLink->nodeAindex : pLink->nodeBindex;
+			int nextEnd = m_pData->GetSummedLink( next )->nodeAindex == node ? 0 : 1;
+			if ( straightest[ next * 2 + nextEnd ] == l )
+				mContinuations[ l * 2 + end ] = next;
+		}
+	}
+
+}
+
+
+/*
+ * Method: int GetContinuation( int link, int node ) const;
+ * Description: Returns the link continuing the street of the given link through the given end node, or -1.
+ */
+int GraphClassifier::GetContinuation( int link, int node ) const {
+
+	return mContinuations[ link * 2 + ( m_pData->GetSummedLink( link )->nodeAindex == node ? 0 : 1 ) ];
+
+}
+
+
+/*
+ * Method: VectorMath::LineSegment GetSegment( int link ) const;
+ * Description: Get the line between the nodes of the given summed link.
+ */
+LineSegment GraphClassifier::GetSegment( int link ) const {
+
+	UraeData::Link *pLink = m_pData->GetSummedLink( link );
+	return LineSegment( m_pData->GetNode( pLink->nodeAindex )->position, m_pData->GetNode( pLink->nodeBindex )->position );
+
+}
+
+
+/*
+ * Method: void WalkStreet( int link, int node, VectorMath::LineSegment from, StreetNodeList *pNodes ) const;
+ * Description: Appends the nodes reached by following the street of the given link through the given end node,
+ * 				up to and including the first node further than the range from the given line.
+ */
+void GraphClassifier::WalkStreet( int link, int node, LineSegment from, StreetNodeList *pNodes ) const {
+
+	StreetNode s;
+	s.mNode = node;
+	s.mNodeCount = 1;
+	s.mLink = link;
+
+	// A street may be a ring, so stop on coming back to the first link.
+	int start = link;
+	int steps = m_pData->GetSummedLinkCount();
+	while ( true ) {
+
+		s.mInRange = ( mRange <= 0 || from.DistanceFromPoint( m_pData->GetNode( s.mNode )->position ) <= mRange );
+		pNodes->push_back( s );
+		if ( !s.mInRange || steps-- <= 0 )
+			break;
+
+		int next = GetContinuation( s.mLink, s.mNode );
+		if ( next < 0 || next == start )
+			break;
+
+		UraeData::Link *pNext = m_pData->GetSummedLink( next );
+		s.mNode = pNext->nodeAindex == s.mNode ? pNext->nodeBindex : pNext->nodeAindex;
+		s.mNodeCount++;
+		s.mLink = next;
+
+	}
+
+}
@@ -0,0 +1,261 @@
+/*
+ *  PathlossBatch.cpp - Classifies and calculates the pathloss of many transmitter/receiver pairs at once.
+ *  Copyright (C) 2012  C. S. Cooper, A. Mukunthan
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contact Details: Cooper - andor734@gmail.com
+ */
+
+#include <cmath>
+
+#include "Urae.h"
+#include "PathlossBatch.h"
+#include "PathlossKernels.h"
+
+
+using namespace std;
+using namespace VectorMath;
+using namespace Urae;
+
+
+PathlossBatch::PathlossBatch( bool refine ) {
+
+	m_pData = UraeData::GetSingleton();
+	if ( !m_pData )
+		THROW_EXCEPTION( "Could not find an initialised UraeData Singleton, needed by PathlossBatch." );
+
+	mRefine = refine;
+
+}
+
+
+PathlossBatch::~PathlossBatch() { }
+
+
+/*
+ * Method: void Calculate( size_t count, const int *pTxLinks, const int *pRxLinks, ..., VectorMath::Real *pK );
+ * Description: Calculates count pairs, given their summed links, positions and lanes.
+ */
+void PathlossBatch::Calculate( size_t count, const int *pTxLinks, const int *pRxLinks, const Vector2D *pTxPos, const Vector2D *pRxPos,
+							   const int *pTxLanes, const int *pRxLanes, int *pStates, Real *pPathloss, Real *pK ) {
+
+	mClassifications.resize( count );
+	for ( size_t i = 0; i < count; i++ )
+		mClassifications[i] = m_pData->GetClassification( pTxLinks[i], pRxLinks[i] );
+
+	CalculateClassified( count, pTxPos, pRxPos, pTxLanes, pRxLanes, pStates, pPathloss, pK );
+
+}
+
+
+/*
+ * Method: void CalculateForRoads( size_t count, const UraeData::RoadId *pTxRoads, const UraeData::RoadId *pRxRoads, ... );
+ * Description: As Calculate, given the road IDs of the pairs.
+ */
+void PathlossBatch::CalculateForRoads( size_t count, const UraeData::RoadId *pTxRoads, const UraeData::RoadId *pRxRoads, const Vector2D *pTxPos, const Vector2D *pRxPos,
+									   const int *pTxLanes, const int *pRxLanes, int *pStates, Real *pPathloss, Real *pK ) {
+
+	mClassifications.resize( count );
+	for ( size_t i = 0; i < count; i++ )
+		mClassifications[i] = m_pData->GetClassification( pTxRoads[i], pRxRoads[i], pTxPos[i], pRxPos[i] );
+
+	CalculateClassified( count, pTxPos, pRxPos, pTxLanes, pRxLanes, pStates, pPathloss, pK );
+
+}
+
+
+/*
+ * Method: void CalculateFromTransmitter( int txLink, const VectorMath::Vector2D &txPos, int txLane, size_t count, const int *pRxLinks, ... );
+ * Description: As Calculate, for one transmitter and many receivers.
+ */
+void PathlossBatch::CalculateFromTransmitter( int txLink, const Vector2D &txPos, int txLane, size_t count, const int *pRxLinks,
+											  const Real *pRxX, const Real *pRxY, const int *pRxLanes, int *pStates, Real *pPathloss, Real *pK ) {
+
+	mClassifications.resize( count );
+	for ( size_t i = 0; i < count; i++ )
+		mClassifications[i] = m_pData->GetClassification( txLink, pRxLinks[i] );
+
+	SetTransmitter( txPos, txLane, count, pRxX, pRxY );
+	CalculateClassified( count, mTxPos.data(), mRxPos.data(), mTxLanes.data(), pRxLanes, pStates, pPathloss, pK );
+
+}
+
+
+/*
+ * Method: void CalculateFromTransmitterForRoads( const UraeData::RoadId &txRoad, const VectorMath::Vector2D &txPos, int txLane, size_t count, ... );
+ * Description: As CalculateFromTransmitter, given the road IDs of the transmitter and receivers.
+ */
+void PathlossBatch::CalculateFromTransmitterForRoads( const UraeData::RoadId &txRoad, const Vector2D &txPos, int txLane, size_t count, const UraeData::RoadId *pRxRoads,
+													  const Real *pRxX, const Real *pRxY, const int *pRxLanes, int *pStates, Real *pPathloss, Real *pK ) {
+
+	SetTransmitter( txPos, txLane, count, pRxX, pRxY );
+
+	mClassifications.resize( count );
+	for ( size_t i = 0; i < count; i++ )
+		mClassifications[i] = m_pData->GetClassification( txRoad, pRxRoads[i], mTxPos[i], mRxPos[i] );
+
+	CalculateClassified( count, mTxPos.data(), mRxPos.data(), mTxLanes.data(), pRxLanes, pStates, pPathloss, pK );
+
+}
+
+
+/*
+ * Method: void CalculateClassified( size_t count, const VectorMath::Vector2D *pTxPos, ..., VectorMath::Real *pK );
+ * Description: Refines the classifications of the pairs, groups them by state and calculates each group.
+ */
+void PathlossBatch::CalculateClassified( size_t count, const Vector2D *pTxPos, const Vector2D *pRxPos,
+										 const int *pTxLanes, const int *pRxLanes, int *pStates, Real *pPathloss, Real *pK ) {
+
+	size_t i, g;
+	if ( count == 0 )
+		return;
+
+	// Refine, and count the pairs in each state.
+	size_t groupStart[Classifier::OutOfRange+2] = { 0 };
+	for ( i = 0; i < count; i++ ) {
+
+		UraeData::Classification &c = mClassifications[i];
+		if ( mRefine ) {
+			Vector2D s = pTxPos[i], d = pRxPos[i];
+			m_pData->RefineClassification( c, s, d );
+		}
+
+		if ( c.mClassification < Classifier::LOS || c.mClassification > Classifier::OutOfRange )
+			c.mClassification = Classifier::OutOfRange;
+		pStates[i] = c.mClassification;
+		groupStart[ c.mClassification + 1 ]++;
+
+	}
+
+	for ( int s = 0; s <= Classifier::OutOfRange; s++ )
+		groupStart[s+1] += groupStart[s];
+
+	mOrder.resize( count );
+	size_t groupFill[Classifier::OutOfRange+1];
+	std::copy( groupStart, groupStart + Classifier::OutOfRange + 1, groupFill );
+	for ( i = 0; i < count; i++ )
+		mOrder[ groupFill[ pStates[i] ]++ ] = i;
+
+	PathlossConstants k;
+	k.mLambdaBy4PiSq = m_pData->GetLamdaBy4PiSq();
+	k.mWavelength = m_pData->GetWavelength();
+	k.mLossPerReflection = m_pData->GetLossPerReflection();
+	k.m_pReflectionLoss = m_pData->GetReflectionLossTable( &k.mReflectionLossCount );
+	UraeData::PathlossCoefficients scratch;
+
+	// LOS
+	const size_t *pGroup = &mOrder[0] + groupStart[Classifier::LOS];
+	size_t n = groupStart[Classifier::LOS+1] - groupStart[Classifier::LOS];
+	if ( n > 0 ) {
+
+		Real *pDistSq = Scratch( 0, n ), *pOut = Scratch( 1, n );
+		for ( g = 0; g < n; g++ )
+			pDistSq[g] = ( pTxPos[ pGroup[g] ] - pRxPos[ pGroup[g] ] ).MagnitudeSq();
+
+		PathlossKernels::Los( n, pDistSq, k, pOut );
+
+		for ( g = 0; g < n; g++ ) {
+			i = pGroup[g];
+			pPathloss[i] = pOut[g];
+			if ( pK ) {
+				UraeData::Classification &c = mClassifications[i];
+				pK[i] = m_pData->GetK( c.mLinkPair, pTxPos[i], pTxLanes ? pTxLanes[i] : 0, pRxPos[i], pRxLanes ? pRxLanes[i] : 0, c.mFlipped );
+			}
+		}
+
+	}
+
+	// NLOS1
+	pGroup = &mOrder[0] + groupStart[Classifier::NLOS1];
+	n = groupStart[Classifier::NLOS1+1] - groupStart[Classifier::NLOS1];
+	if ( n > 0 ) {
+
+		Real *pRm2 = Scratch( 0, n ), *pRs2 = Scratch( 1, n ), *pWm = Scratch( 2, n ), *pWs = Scratch( 3, n ), *pOut = Scratch( 4, n );
+		for ( g = 0; g < n; g++ ) {
+			i = pGroup[g];
+			const UraeData::PathlossCoefficients *pCoefficients = m_pData->GetPathlossCoefficients( mClassifications[i], &scratch );
+			pRm2[g] = ( pTxPos[i] - pCoefficients->mCorner[0] ).MagnitudeSq();
+			pRs2[g] = ( pCoefficients->mCorner[0] - pRxPos[i] ).MagnitudeSq();
+			pWm[g] = pCoefficients->mMainWidth;
+			pWs[g] = pCoefficients->mSideWidth;
+		}
+
+		PathlossKernels::Nlos1( n, pRm2, pRs2, pWm, pWs, k, pOut );
+
+		for ( g = 0; g < n; g++ )
+			pPathloss[ pGroup[g] ] = pOut[g];
+
+	}
+
+	// NLOS2
+	pGroup = &mOrder[0] + groupStart[Classifier::NLOS2];
+	n = groupStart[Classifier::NLOS2+1] - groupStart[Classifier::NLOS2];
+	if ( n > 0 ) {
+
+		Real *pRm2 = Scratch( 0, n ), *pRs2 = Scratch( 1, n ), *pRp2 = Scratch( 2, n ), *pWm = Scratch( 3, n ), *pWs = Scratch( 4, n ), *pWp = Scratch( 5, n ), *pOut = Scratch( 6, n );
+		for ( g = 0; g < n; g++ ) {
+			i = pGroup[g];
+			const UraeData::PathlossCoefficients *pCoefficients = m_pData->GetPathlossCoefficients( mClassifications[i], &scratch );
+			pRm2[g] = ( pTxPos[i] - pCoefficients->mCorner[0] ).MagnitudeSq();
+			pRs2[g] = ( pCoefficients->mCorner[0] - pCoefficients->mCorner[1] ).MagnitudeSq();
+			pRp2[g] = ( pCoefficients->mCorner[1] - pRxPos[i] ).MagnitudeSq();
+			pWm[g] = pCoefficients->mMainWidth;
+			pWs[g] = pCoefficients->mSideWidth;
+			pWp[g] = pCoefficients->mParaWidth;
+		}
+
+		PathlossKernels::Nlos2( n, pRm2, pRs2, pRp2, pWm, pWs, pWp, k, pOut );
+
+		for ( g = 0; g < n; g++ )
+			pPathloss[ pGroup[g] ] = pOut[g];
+
+	}
+
+	// Out of range, and no K-factor outside LOS.
+	for ( g = groupStart[Classifier::OutOfRange]; g < count; g++ )
+		pPathloss[ mOrder[g] ] = 0;
+	if ( pK )
+		for ( g = groupStart[Classifier::NLOS1]; g < count; g++ )
+			pK[ mOrder[g] ] = 0;
+
+}
+
+
+/*
+ * Method: void SetTransmitter( const VectorMath::Vector2D &txPos, int txLane, size_t count, const VectorMath::Real *pRxX, const VectorMath::Real *pRxY );
+ * Description: Fills the pair positions and transmitter lanes for one transmitter and count receivers.
+ */
+void PathlossBatch::SetTransmitter( const Vector2D &txPos, int txLane, size_t count, const Real *pRxX, const Real *pRxY ) {
+
+	mTxPos.assign( count, txPos );
+	mTxLanes.assign( count, txLane );
+	mRxPos.resize( count );
+	for ( size_t i = 0; i < count; i++ )
+		mRxPos[i] = Vector2D( pRxX[i], pRxY[i] );
+
+}
+
+
+/*
+ * Method: VectorMath::Real *Scratch( int array, size_t count );
+ * Description: Get one of the scratch arrays, with room for count values.
+ */
+Real *PathlossBatch::Scratch( int array, size_t count ) {
+
+	if ( mScratch[array].size() < count )
+		mScratch[array].resize( count );
+	return &mScratch[array][0];
+
+}
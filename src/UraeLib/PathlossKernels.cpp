@@ -0,0 +1,590 @@
+/*
+ *  PathlossKernels.cpp - Loops calculating the CORNER pathloss of many pairs, with vector versions chosen at run time.
+ *  Copyright (C) 2012  C. S. Cooper, A. Mukunthan
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contact Details: Cooper - andor734@gmail.com
+ */
+
+#include <cmath>
+#include <pthread.h>
+
+#include "PathlossKernels.h"
+
+// The vector versions work on doubles, so single precision builds use the scalar versions.
+#if ( defined(__x86_64__) || defined(__i386__) ) && !defined(URAE_SINGLE_PRECISION)
+#define PATHLOSS_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+
+using namespace std;
+using namespace VectorMath;
+using namespace Urae;
+
+
+/*
+ * Method: Real ReflectionLoss( const PathlossConstants &k, unsigned int n );
+ * Description: The loss per reflection to the power 2n, from the table if it holds it.
+ */
+static inline Real ReflectionLoss( const PathlossConstants &k, unsigned int n ) {
+
+	return ( n < k.mReflectionLossCount ) ? k.m_pReflectionLoss[n] : pow( k.mLossPerReflection, 2 * n );
+
+}
+
+
+/*
+ * Method: void LosScalar( size_t n, const Real *pDistSq, const PathlossConstants &k, Real *pOut );
+ * Description: Pathloss of pairs in line of sight, one at a time.
+ */
+static void LosScalar( size_t n, const Real *pDistSq, const PathlossConstants &k, Real *pOut ) {
+
+	for ( size_t i = 0; i < n; i++ )
+		pOut[i] = k.mLambdaBy4PiSq / pDistSq[i];
+
+}
+
+
+/*
+ * Method: void Nlos1Scalar( size_t n, const Real *pRm2, const Real *pRs2, const Real *pWm, const Real *pWs, const PathlossConstants &k, Real *pOut );
+ * Description: Pathloss of pairs around one corner, one at a time.
+ */
+static void Nlos1Scalar( size_t n, const Real *pRm2, const Real *pRs2, const Real *pWm, const Real *pWs, const PathlossConstants &k, Real *pOut ) {
+
+	for ( size_t i = 0; i < n; i++ ) {
+
+		Real rm2 = pRm2[i], rs2 = pRs2[i];
+		Real rm = sqrt(rm2);
+		Real rs = sqrt(rs2);
+
+		unsigned int Nmin = (unsigned int)floor( 2 * sqrt( ( rm * rs ) / ( pWs[i] * pWm[i] ) ) );
+		//calculate PLr
+		Real PL = (k.mLambdaBy4PiSq * ReflectionLoss( k, Nmin )) / pow((rm+rs),2);
+
+		//calculate PLd
+		Real PLd = ( rm < rs ) ? ((k.mLambdaBy4PiSq * k.mWavelength) / (4 * rm * rs2)) : ((k.mLambdaBy4PiSq * k.mWavelength) / (4 * rs * rm2));
+		pOut[i] = PL + PLd;
+
+	}
+
+}
+
+
+/*
+ * Method: void Nlos2Scalar( size_t n, const Real *pRm2, const Real *pRs2, const Real *pRp2, const Real *pWm, const Real *pWs, const Real *pWp, const PathlossConstants &k, Real *pOut );
+ * Description: Pathloss of pairs on parallel streets, one at a time.
+ */
+static void Nlos2Scalar( size_t n, const Real *pRm2, const Real *pRs2, const Real *pRp2, const Real *pWm, const Real *pWs, const Real *pWp, const PathlossConstants &k, Real *pOut ) {
+
+	for ( size_t i = 0; i < n; i++ ) {
+
+		Real rm2 = pRm2[i], rp2 = pRp2[i];
+		Real Wm = pWm[i], Ws = pWs[i], Wp = pWp[i];
+		Real rm = sqrt(rm2);
+		Real rs = sqrt(pRs2[i]);
+		Real rp = sqrt(rp2);
+		Real rsp = rs + rp;
+
+		Real temp = sqrt( ( rs * Wm * Wp ) / ( Ws * ( rm * Wp + rp * Wm ) ) );
+		unsigned int Nmin = (unsigned int)floor((rm * temp) / Wm + rs / (Ws * temp) + (rp * temp) / Wp);
+		Real rPow2Nmin = ReflectionLoss( k, Nmin );
+		unsigned int N = (unsigned int)floor( rp * rs / ( Wp * Ws ) );
+
+		//calculate PLr
+		Real PL = (k.mLambdaBy4PiSq * rPow2Nmin) / pow(rsp+rm, 2);
+
+		//calculate PLdd
+		PL += ( rm < rs ) ? (k.mLambdaBy4PiSq * pow(k.mWavelength,2)) / (16 * rm * rs * rp2) : (k.mLambdaBy4PiSq * pow(k.mWavelength,2)) / (16 * rm2 * rp * rs);
+
+		//calculate PLrd
+		PL += ( rs < rp ) ? (k.mLambdaBy4PiSq * rPow2Nmin * k.mWavelength * rs) / (4 * pow(rs+rm, 2) * rp2) : (k.mLambdaBy4PiSq * rPow2Nmin * k.mWavelength) / (4 * pow(rs+rm, 2) * rp);
+
+		//calculate PLdr
+		pOut[i] = PL + ( ( rm < rsp ) ? (ReflectionLoss( k, N ) * k.mLambdaBy4PiSq * k.mWavelength)/(4*rm*rsp*rsp) : (ReflectionLoss( k, N ) * k.mLambdaBy4PiSq * k.mWavelength)/(4*rsp*rm2) );
+
+	}
+
+}
+
+
+#ifdef PATHLOSS_KERNELS_X86
+
+// The vector versions follow the scalar formulas operation for operation. Only the powers of the loss per
+// reflection may differ: they are looked up in the table while every lane's count is in it, and otherwise found
+// by repeated squaring instead of with pow, so the results agree to within rounding.
+// Reflection counts are capped where the power has long since underflowed. The base is the same in every lane,
+// so once it underflows the remaining powers are all 0.
+static const double MaxReflections = 1073741824.0;
+
+
+/*
+ * Method: __m256d PowAvx2( __m256d base, __m256d e );
+ * Description: Raises base (the same in every lane) to the whole, non-negative powers e.
+ */
+__attribute__((target("avx2")))
+static inline __m256d PowAvx2( __m256d base, __m256d e ) {
+
+	const __m256d zero = _mm256_setzero_pd();
+	const __m256i one = _mm256_set1_epi64x( 1 );
+	__m256d result = _mm256_set1_pd( 1.0 );
+	__m256i bits = _mm256_cvtepi32_epi64( _mm256_cvttpd_epi32( _mm256_min_pd( e, _mm256_set1_pd( MaxReflections ) ) ) );
+
+	while ( !_mm256_testz_si256( bits, bits ) ) {
+		if ( _mm256_cvtsd_f64( base ) == 0 )
+			return _mm256_blendv_pd( result, zero, _mm256_castsi256_pd( _mm256_cmpgt_epi64( bits, _mm256_setzero_si256() ) ) );
+		__m256d odd = _mm256_castsi256_pd( _mm256_cmpeq_epi64( _mm256_and_si256( bits, one ), one ) );
+		result = _mm256_blendv_pd( result, _mm256_mul_pd( result, base ), odd );
+		base = _mm256_mul_pd( base, base );
+		bits = _mm256_srli_epi64( bits, 1 );
+	}
+
+	return result;
+
+}
+
+
+/*
+ * Method: __m256d ReflectionLossAvx2( const PathlossConstants &k, __m256d lpr2, __m256d n );
+ * Description: The loss per reflection (lpr2 being its square) to the powers 2n.
+ */
+__attribute__((target("avx2")))
+static inline __m256d ReflectionLossAvx2( const PathlossConstants &k, __m256d lpr2, __m256d n ) {
+
+	if ( k.m_pReflectionLoss && _mm256_movemask_pd( _mm256_cmp_pd( n, _mm256_set1_pd( (double)k.mReflectionLossCount ), _CMP_LT_OQ ) ) == 0xF )
+		return _mm256_mask_i32gather_pd( _mm256_setzero_pd(), k.m_pReflectionLoss, _mm256_cvttpd_epi32( n ),
+										 _mm256_castsi256_pd( _mm256_set1_epi64x( -1 ) ), 8 );
+
+	return PowAvx2( lpr2, n );
+
+}
+
+
+__attribute__((target("avx2")))
+static void LosAvx2( size_t n, const Real *pDistSq, const PathlossConstants &k, Real *pOut ) {
+
+	const __m256d c = _mm256_set1_pd( k.mLambdaBy4PiSq );
+	size_t i = 0;
+	for ( ; i + 4 <= n; i += 4 )
+		_mm256_storeu_pd( pOut + i, _mm256_div_pd( c, _mm256_loadu_pd( pDistSq + i ) ) );
+
+	LosScalar( n - i, pDistSq + i, k, pOut + i );
+
+}
+
+
+__attribute__((target("avx2")))
+static void Nlos1Avx2( size_t n, const Real *pRm2, const Real *pRs2, const Real *pWm, const Real *pWs, const PathlossConstants &k, Real *pOut ) {
+
+	const __m256d c = _mm256_set1_pd( k.mLambdaBy4PiSq );
+	const __m256d cl = _mm256_set1_pd( k.mLambdaBy4PiSq * k.mWavelength );
+	const __m256d lpr2 = _mm256_set1_pd( k.mLossPerReflection * k.mLossPerReflection );
+	const __m256d two = _mm256_set1_pd( 2.0 ), four = _mm256_set1_pd( 4.0 );
+
+	size_t i = 0;
+	for ( ; i + 4 <= n; i += 4 ) {
+
+		__m256d rm2 = _mm256_loadu_pd( pRm2 + i ), rs2 = _mm256_loadu_pd( pRs2 + i );
+		__m256d rm = _mm256_sqrt_pd( rm2 ), rs = _mm256_sqrt_pd( rs2 );
+
+		__m256d Nmin = _mm256_floor_pd( _mm256_mul_pd( two, _mm256_sqrt_pd( _mm256_div_pd( _mm256_mul_pd( rm, rs ), _mm256_mul_pd( _mm256_loadu_pd( pWs + i ), _mm256_loadu_pd( pWm + i ) ) ) ) ) );
+		__m256d sum = _mm256_add_pd( rm, rs );
+		__m256d PL = _mm256_div_pd( _mm256_mul_pd( c, ReflectionLossAvx2( k, lpr2, Nmin ) ), _mm256_mul_pd( sum, sum ) );
+
+		__m256d near = _mm256_cmp_pd( rm, rs, _CMP_LT_OQ );
+		__m256d den = _mm256_blendv_pd( _mm256_mul_pd( _mm256_mul_pd( four, rs ), rm2 ), _mm256_mul_pd( _mm256_mul_pd( four, rm ), rs2 ), near );
+		_mm256_storeu_pd( pOut + i, _mm256_add_pd( PL, _mm256_div_pd( cl, den ) ) );
+
+	}
+
+	Nlos1Scalar( n - i, pRm2 + i, pRs2 + i, pWm + i, pWs + i, k, pOut + i );
+
+}
+
+
+__attribute__((target("avx2")))
+static void Nlos2Avx2( size_t n, const Real *pRm2, const Real *pRs2, const Real *pRp2, const Real *pWm, const Real *pWs, const Real *pWp, const PathlossConstants &k, Real *pOut ) {
+
+	const __m256d c = _mm256_set1_pd( k.mLambdaBy4PiSq );
+	const __m256d cl2 = _mm256_set1_pd( k.mLambdaBy4PiSq * ( k.mWavelength * k.mWavelength ) );
+	const __m256d lambda = _mm256_set1_pd( k.mWavelength );
+	const __m256d lpr2 = _mm256_set1_pd( k.mLossPerReflection * k.mLossPerReflection );
+	const __m256d four = _mm256_set1_pd( 4.0 ), sixteen = _mm256_set1_pd( 16.0 );
+
+	size_t i = 0;
+	for ( ; i + 4 <= n; i += 4 ) {
+
+		__m256d rm2 = _mm256_loadu_pd( pRm2 + i ), rp2 = _mm256_loadu_pd( pRp2 + i );
+		__m256d Wm = _mm256_loadu_pd( pWm + i ), Ws = _mm256_loadu_pd( pWs + i ), Wp = _mm256_loadu_pd( pWp + i );
+		__m256d rm = _mm256_sqrt_pd( rm2 ), rs = _mm256_sqrt_pd( _mm256_loadu_pd( pRs2 + i ) ), rp = _mm256_sqrt_pd( rp2 );
+		__m256d rsp = _mm256_add_pd( rs, rp );
+
+		__m256d temp = _mm256_sqrt_pd( _mm256_div_pd( _mm256_mul_pd( _mm256_mul_pd( rs, Wm ), Wp ),
+													  _mm256_mul_pd( Ws, _mm256_add_pd( _mm256_mul_pd( rm, Wp ), _mm256_mul_pd( rp, Wm ) ) ) ) );
+		__m256d Nmin = _mm256_floor_pd( _mm256_add_pd( _mm256_add_pd( _mm256_div_pd( _mm256_mul_pd( rm, temp ), Wm ),
+																	  _mm256_div_pd( rs, _mm256_mul_pd( Ws, temp ) ) ),
+													   _mm256_div_pd( _mm256_mul_pd( rp, temp ), Wp ) ) );
+		__m256d rPow2Nmin = ReflectionLossAvx2( k, lpr2, Nmin );
+		__m256d N = _mm256_floor_pd( _mm256_div_pd( _mm256_mul_pd( rp, rs ), _mm256_mul_pd( Wp, Ws ) ) );
+
+		//calculate PLr
+		__m256d rspm = _mm256_add_pd( rsp, rm );
+		__m256d PL = _mm256_div_pd( _mm256_mul_pd( c, rPow2Nmin ), _mm256_mul_pd( rspm, rspm ) );
+
+		//calculate PLdd
+		__m256d mask = _mm256_cmp_pd( rm, rs, _CMP_LT_OQ );
+		__m256d den = _mm256_blendv_pd( _mm256_mul_pd( _mm256_mul_pd( _mm256_mul_pd( sixteen, rm2 ), rp ), rs ),
+										_mm256_mul_pd( _mm256_mul_pd( _mm256_mul_pd( sixteen, rm ), rs ), rp2 ), mask );
+		PL = _mm256_add_pd( PL, _mm256_div_pd( cl2, den ) );
+
+		//calculate PLrd
+		__m256d rsm = _mm256_add_pd( rs, rm );
+		__m256d num = _mm256_mul_pd( _mm256_mul_pd( c, rPow2Nmin ), lambda );
+		__m256d den4 = _mm256_mul_pd( four, _mm256_mul_pd( rsm, rsm ) );
+		mask = _mm256_cmp_pd( rs, rp, _CMP_LT_OQ );
+		PL = _mm256_add_pd( PL, _mm256_blendv_pd( _mm256_div_pd( num, _mm256_mul_pd( den4, rp ) ),
+												  _mm256_div_pd( _mm256_mul_pd( num, rs ), _mm256_mul_pd( den4, rp2 ) ), mask ) );
+
+		//calculate PLdr
+		num = _mm256_mul_pd( _mm256_mul_pd( ReflectionLossAvx2( k, lpr2, N ), c ), lambda );
+		mask = _mm256_cmp_pd( rm, rsp, _CMP_LT_OQ );
+		den = _mm256_blendv_pd( _mm256_mul_pd( _mm256_mul_pd( four, rsp ), rm2 ),
+								_mm256_mul_pd( _mm256_mul_pd( _mm256_mul_pd( four, rm ), rsp ), rsp ), mask );
+		_mm256_storeu_pd( pOut + i, _mm256_add_pd( PL, _mm256_div_pd( num, den ) ) );
+
+	}
+
+	Nlos2Scalar( n - i, pRm2 + i, pRs2 + i, pRp2 + i, pWm + i, pWs + i, pWp + i, k, pOut + i );
+
+}
+
+
+/*
+ * Method: __m128d FloorSse2( __m128d x );
+ * Description: Rounds down non-negative values, capped at MaxReflections (SSE2 has no floor).
+ */
+static inline __m128d FloorSse2( __m128d x ) {
+
+	return _mm_cvtepi32_pd( _mm_cvttpd_epi32( _mm_min_pd( x, _mm_set1_pd( MaxReflections ) ) ) );
+
+}
+
+
+/*
+ * Method: __m128d SelectSse2( __m128d mask, __m128d a, __m128d b );
+ * Description: Takes a where the mask is set, and b elsewhere.
+ */
+static inline __m128d SelectSse2( __m128d mask, __m128d a, __m128d b ) {
+
+	return _mm_or_pd( _mm_and_pd( mask, a ), _mm_andnot_pd( mask, b ) );
+
+}
+
+
+/*
+ * Method: __m128d PowSse2( __m128d base, __m128d e );
+ * Description: Raises base (the same in every lane) to the whole, non-negative powers e.
+ */
+static inline __m128d PowSse2( __m128d base, __m128d e ) {
+
+	const __m128i zero = _mm_setzero_si128(), one = _mm_set1_epi32( 1 );
+	__m128d result = _mm_set1_pd( 1.0 );
+	// each count in both halves of its lane, so the 32 bit compares give whole lane masks
+	__m128i bits = _mm_shuffle_epi32( _mm_cvttpd_epi32( _mm_min_pd( e, _mm_set1_pd( MaxReflections ) ) ), _MM_SHUFFLE( 1, 1, 0, 0 ) );
+
+	while ( _mm_movemask_epi8( _mm_cmpeq_epi32( bits, zero ) ) != 0xFFFF ) {
+		if ( _mm_cvtsd_f64( base ) == 0 )
+			return _mm_and_pd( _mm_castsi128_pd( _mm_cmpeq_epi32( bits, zero ) ), result );
+		__m128d odd = _mm_castsi128_pd( _mm_cmpeq_epi32( _mm_and_si128( bits, one ), one ) );
+		result = SelectSse2( odd, _mm_mul_pd( result, base ), result );
+		base = _mm_mul_pd( base, base );
+		bits = _mm_srli_epi32( bits, 1 );
+	}
+
+	return result;
+
+}
+
+
+/*
+ * Method: __m128d ReflectionLossSse2( const PathlossConstants &k, __m128d lpr2, __m128d n );
+ * Description: The loss per reflection (lpr2 being its square) to the powers 2n.
+ */
+static inline __m128d ReflectionLossSse2( const PathlossConstants &k, __m128d lpr2, __m128d n ) {
+
+	if ( k.m_pReflectionLoss && _mm_movemask_pd( _mm_cmplt_pd( n, _mm_set1_pd( (double)k.mReflectionLossCount ) ) ) == 0x3 ) {
+		__m128i index = _mm_cvttpd_epi32( n );
+		return _mm_set_pd( k.m_pReflectionLoss[ _mm_cvtsi128_si32( _mm_shuffle_epi32( index, 1 ) ) ], k.m_pReflectionLoss[ _mm_cvtsi128_si32( index ) ] );
+	}
+
+	return PowSse2( lpr2, n );
+
+}
+
+
+static void LosSse2( size_t n, const Real *pDistSq, const PathlossConstants &k, Real *pOut ) {
+
+	const __m128d c = _mm_set1_pd( k.mLambdaBy4PiSq );
+	size_t i = 0;
+	for ( ; i + 2 <= n; i += 2 )
+		_mm_storeu_pd( pOut + i, _mm_div_pd( c, _mm_loadu_pd( pDistSq + i ) ) );
+
+	LosScalar( n - i, pDistSq + i, k, pOut + i );
+
+}
+
+
+static void Nlos1Sse2( size_t n, const Real *pRm2, const Real *pRs2, const Real *pWm, const Real *pWs, const PathlossConstants &k, Real *pOut ) {
+
+	const __m128d c = _mm_set1_pd( k.mLambdaBy4PiSq );
+	const __m128d cl = _mm_set1_pd( k.mLambdaBy4PiSq * k.mWavelength );
+	const __m128d lpr2 = _mm_set1_pd( k.mLossPerReflection * k.mLossPerReflection );
+	const __m128d two = _mm_set1_pd( 2.0 ), four = _mm_set1_pd( 4.0 );
+
+	size_t i = 0;
+	for ( ; i + 2 <= n; i += 2 ) {
+
+		__m128d rm2 = _mm_loadu_pd( pRm2 + i ), rs2 = _mm_loadu_pd( pRs2 + i );
+		__m128d rm = _mm_sqrt_pd( rm2 ), rs = _mm_sqrt_pd( rs2 );
+
+		__m128d Nmin = FloorSse2( _mm_mul_pd( two, _mm_sqrt_pd( _mm_div_pd( _mm_mul_pd( rm, rs ), _mm_mul_pd( _mm_loadu_pd( pWs + i ), _mm_loadu_pd( pWm + i ) ) ) ) ) );
+		__m128d sum = _mm_add_pd( rm, rs );
+		__m128d PL = _mm_div_pd( _mm_mul_pd( c, ReflectionLossSse2( k, lpr2, Nmin ) ), _mm_mul_pd( sum, sum ) );
+
+		__m128d near = _mm_cmplt_pd( rm, rs );
+		__m128d den = SelectSse2( near, _mm_mul_pd( _mm_mul_pd( four, rm ), rs2 ), _mm_mul_pd( _mm_mul_pd( four, rs ), rm2 ) );
+		_mm_storeu_pd( pOut + i, _mm_add_pd( PL, _mm_div_pd( cl, den ) ) );
+
+	}
+
+	Nlos1Scalar( n - i, pRm2 + i, pRs2 + i, pWm + i, pWs + i, k, pOut + i );
+
+}
+
+
+static void Nlos2Sse2( size_t n, const Real *pRm2, const Real *pRs2, const Real *pRp2, const Real *pWm, const Real *pWs, const Real *pWp, const PathlossConstants &k, Real *pOut ) {
+
+	const __m128d c = _mm_set1_pd( k.mLambdaBy4PiSq );
+	const __m128d cl2 = _mm_set1_pd( k.mLambdaBy4PiSq * ( k.mWavelength * k.mWavelength ) );
+	const __m128d lambda = _mm_set1_pd( k.mWavelength );
+	const __m128d lpr2 = _mm_set1_pd( k.mLossPerReflection * k.mLossPerReflection );
+	const __m128d four = _mm_set1_pd( 4.0 ), sixteen = _mm_set1_pd( 16.0 );
+
+	size_t i = 0;
+	for ( ; i + 2 <= n; i += 2 ) {
+
+		__m128d rm2 = _mm_loadu_pd( pRm2 + i ), rp2 = _mm_loadu_pd( pRp2 + i );
+		__m128d Wm = _mm_loadu_pd( pWm + i ), Ws = _mm_loadu_pd( pWs + i ), Wp = _mm_loadu_pd( pWp + i );
+		__m128d rm = _mm_sqrt_pd( rm2 ), rs = _mm_sqrt_pd( _mm_loadu_pd( pRs2 + i ) ), rp = _mm_sqrt_pd( rp2 );
+		__m128d rsp = _mm_add_pd( rs, rp );
+
+		__m128d temp = _mm_sqrt_pd( _mm_div_pd( _mm_mul_pd( _mm_mul_pd( rs, Wm ), Wp ),
+												_mm_mul_pd( Ws, _mm_add_pd( _mm_mul_pd( rm, Wp ), _mm_mul_pd( rp, Wm ) ) ) ) );
+		__m128d Nmin = FloorSse2( _mm_add_pd( _mm_add_pd( _mm_div_pd( _mm_mul_pd( rm, temp ), Wm ),
+														  _mm_div_pd( rs, _mm_mul_pd( Ws, temp ) ) ),
+											  _mm_div_pd( _mm_mul_pd( rp, temp ), Wp ) ) );
+		__m128d rPow2Nmin = ReflectionLossSse2( k, lpr2, Nmin );
+		__m128d N = FloorSse2( _mm_div_pd( _mm_mul_pd( rp, rs ), _mm_mul_pd( Wp, Ws ) ) );
+
+		//calculate PLr
+		__m128d rspm = _mm_add_pd( rsp, rm );
+		__m128d PL = _mm_div_pd( _mm_mul_pd( c, rPow2Nmin ), _mm_mul_pd( rspm, rspm ) );
+
+		//calculate PLdd
+		__m128d mask = _mm_cmplt_pd( rm, rs );
+		__m128d den = SelectSse2( mask, _mm_mul_pd( _mm_mul_pd( _mm_mul_pd( sixteen, rm ), rs ), rp2 ),
+										_mm_mul_pd( _mm_mul_pd( _mm_mul_pd( sixteen, rm2 ), rp ), rs ) );
+		PL = _mm_add_pd( PL, _mm_div_pd( cl2, den ) );
+
+		//calculate PLrd
+		__m128d rsm = _mm_add_pd( rs, rm );
+		__m128d num = _mm_mul_pd( _mm_mul_pd( c, rPow2Nmin ), lambda );
+		__m128d den4 = _mm_mul_pd( four, _mm_mul_pd( rsm, rsm ) );
+		mask = _mm_cmplt_pd( rs, rp );
+		PL = _mm_add_pd( PL, SelectSse2( mask, _mm_div_pd( _mm_mul_pd( num, rs ), _mm_mul_pd( den4, rp2 ) ),
+											   _mm_div_pd( num, _mm_mul_pd( den4, rp ) ) ) );
+
+		//calculate PLdr
+		num = _mm_mul_pd( _mm_mul_pd( ReflectionLossSse2( k, lpr2, N ), c ), lambda );
+		mask = _mm_cmplt_pd( rm, rsp );
+		den = SelectSse2( mask, _mm_mul_pd( _mm_mul_pd( _mm_mul_pd( four, rm ), rsp ), rsp ),
+								_mm_mul_pd( _mm_mul_pd( four, rsp ), rm2 ) );
+		_mm_storeu_pd( pOut + i, _mm_add_pd( PL, _mm_div_pd( num, den ) ) );
+
+	}
+
+	Nlos2Scalar( n - i, pRm2 + i, pRs2 + i, pRp2 + i, pWm + i, pWs + i, pWp + i, k, pOut + i );
+
+}
+
+#endif // #ifdef PATHLOSS_KERNELS_X86
+
+
+PathlossKernels::InstructionSet PathlossKernels::mInstructionSet = PathlossKernels::Scalar;
+PathlossKernels::LosKernel PathlossKernels::m_pLos = &LosScalar;
+PathlossKernels::Nlos1Kernel PathlossKernels::m_pNlos1 = &Nlos1Scalar;
+PathlossKernels::Nlos2Kernel PathlossKernels::m_pNlos2 = &Nlos2Scalar;
+
+static pthread_once_t gSelectOnce = PTHREAD_ONCE_INIT;
+
+
+/*
+ * Method: static InstructionSet GetInstructionSet();
+ * Description: Get the instruction set the kernels are using.
+ */
+PathlossKernels::InstructionSet PathlossKernels::GetInstructionSet() {
+
+	pthread_once( &gSelectOnce, &PathlossKernels::Select );
+	return mInstructionSet;
+
+}
+
+
+/*
+ * Method: static bool SetInstructionSet( InstructionSet set );
+ * Description: Use the given instruction set. Returns false, and changes nothing, if the CPU does not support it.
+ */
+bool PathlossKernels::SetInstructionSet( InstructionSet set ) {
+
+	pthread_once( &gSelectOnce, &PathlossKernels::Select );
+	if ( !IsSupported( set ) )
+		return false;
+
+	Use( set );
+	return true;
+
+}
+
+
+/*
+ * Method: static const char *GetInstructionSetName( InstructionSet set );
+ * Description: Get the name of the given instruction set.
+ */
+const char *PathlossKernels::GetInstructionSetName( InstructionSet set ) {
+
+	switch ( set ) {
+		case SSE2:	return "SSE2";
+		case AVX2:	return "AVX2";
+		default:	return "scalar";
+	}
+
+}
+
+
+/*
+ * Method: static bool IsSupported( InstructionSet set );
+ * Description: Returns true if the CPU (and this build) supports the given instruction set.
+ */
+bool PathlossKernels::IsSupported( InstructionSet set ) {
+
+	switch ( set ) {
+		case Scalar:
+			return true;
+#ifdef PATHLOSS_KERNELS_X86
+		case SSE2:
+			__builtin_cpu_init();
+			return __builtin_cpu_supports( "sse2" );
+		case AVX2:
+			__builtin_cpu_init();
+			return __builtin_cpu_supports( "avx2" );
+#endif // #ifdef PATHLOSS_KERNELS_X86
+		default:
+			return false;
+	}
+
+}
+
+
+/*
+ * Method: static void Select();
+ * Description: Chooses the best supported instruction set. Run once, before a kernel is first used.
+ */
+void PathlossKernels::Select() {
+
+	if ( IsSupported( AVX2 ) )
+		Use( AVX2 );
+	else if ( IsSupported( SSE2 ) )
+		Use( SSE2 );
+	else
+		Use( Scalar );
+
+}
+
+
+/*
+ * Method: static void Use( InstructionSet set );
+ * Description: Points the kernels at the versions for the given instruction set.
+ */
+void PathlossKernels::Use( InstructionSet set ) {
+
+	mInstructionSet = set;
+	switch ( set ) {
+#ifdef PATHLOSS_KERNELS_X86
+		case AVX2:
+			m_pLos = &LosAvx2;
+			m_pNlos1 = &Nlos1Avx2;
+			m_pNlos2 = &Nlos2Avx2;
+			break;
+		case SSE2:
+			m_pLos = &LosSse2;
+			m_pNlos1 = &Nlos1Sse2;
+			m_pNlos2 = &Nlos2Sse2;
+			break;
+#endif // #ifdef PATHLOSS_KERNELS_X86
+		default:
+			mInstructionSet = Scalar;
+			m_pLos = &LosScalar;
+			m_pNlos1 = &Nlos1Scalar;
+			m_pNlos2 = &Nlos2Scalar;
+			break;
+	}
+
+}
+
+
+/*
+ * Method: static void Los( size_t n, const VectorMath::Real *pDistSq, const PathlossConstants &k, VectorMath::Real *pOut );
+ * Description: Pathloss of pairs in line of sight, given the squared distances between them.
+ */
+void PathlossKernels::Los( size_t n, const Real *pDistSq, const PathlossConstants &k, Real *pOut ) {
+
+	pthread_once( &gSelectOnce, &PathlossKernels::Select );
+	m_pLos( n, pDistSq, k, pOut );
+
+}
+
+
+/*
+ * Method: static void Nlos1( size_t n, const VectorMath::Real *pRm2, const VectorMath::Real *pRs2, ..., VectorMath::Real *pOut );
+ * Description: Pathloss of pairs around one corner.
+ */
+void PathlossKernels::Nlos1( size_t n, const Real *pRm2, const Real *pRs2, const Real *pWm, const Real *pWs, const PathlossConstants &k, Real *pOut ) {
+
+	pthread_once( &gSelectOnce, &PathlossKernels::Select );
+	m_pNlos1( n, pRm2, pRs2, pWm, pWs, k, pOut );
+
+}
+
+
+/*
+ * Method: static void Nlos2( size_t n, const VectorMath::Real *pRm2, const VectorMath::Real *pRs2, const VectorMath::Real *pRp2, ..., VectorMath::Real *pOut );
+ * Description: Pathloss of pairs on parallel streets.
+ */
+void PathlossKernels::Nlos2( size_t n, const Real *pRm2, const Real *pRs2, const Real *pRp2, const Real *pWm, const Real *pWs, const Real *pWp, const PathlossConstants &k, Real *pOut ) {
+
+	pthread_once( &gSelectOnce, &PathlossKernels::Select );
+	m_pNlos2( n, pRm2, pRs2, pRp2, pWm, pWs, pWp, k, pOut );
+
+}
@@ -0,0 +1,1370 @@
+/*
+ *  RiceData.cpp - Indexed storage for the pre-computed K-factors of a road network.
+ *  Copyright (C) 2012  C. S. Cooper, A. Mukunthan
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contact Details: Cooper - andor734@gmail.com
+ */
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <charconv>
+#include <vector>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <string>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "Singleton.h"
+#include "VectorMath.h"
+#include "RiceData.h"
+#include "TextParser.h"
+
+using namespace std;
+using namespace VectorMath;
+using namespace Urae;
+
+
+
+// Size in bytes of one element of each section. The size of the K-factors depends on the value format.
+static const size_t gSectionElementSize[RiceData::SectionCount] = {
+	sizeof(uint64_t),	// LinkLocations
+	sizeof(uint64_t),	// LocationLanes
+	sizeof(uint64_t),	// LaneDestinations
+	sizeof(int32_t),	// DestinationLinks
+	sizeof(uint64_t),	// DestinationLocations
+	sizeof(uint64_t),	// LocationValues
+	0					// Values
+};
+
+
+// Sections are aligned to 8 bytes so that they can be accessed in place.
+static uint64_t AlignSection( uint64_t offset ) {
+	return ( offset + 7 ) & ~(uint64_t)7;
+}
+
+
+
+/*
+ * Writer Constructor Arguments:
+ * 		1. filename - name of the binary file to write
+ * 		2. increment - distance between K-factor calculations along the links
+ * 		3. format - encoding of the K-factors
+ */
+RiceData::Writer::Writer( const char *filename, Real increment, ValueFormat format ) {
+
+	mFilename = filename;
+	memset( &mHeader, 0, sizeof(FileHeader) );
+	memcpy( mHeader.mMagic, RICE_FILE_MAGIC, sizeof(mHeader.mMagic) );
+	mHeader.mVersion = RICE_FILE_VERSION;
+	mHeader.mValueFormat = format;
+	mHeader.mIncrement = increment;
+	mNextLink = 0;
+	mLastDestination = -1;
+
+	for ( int s = 0; s < SectionCount; s++ ) {
+		m_pSections[s] = tmpfile();
+		if ( !m_pSections[s] )
+			THROW_EXCEPTION( "Cannot create temporary file for K-factor section %d", s );
+	}
+
+}
+
+
+RiceData::Writer::~Writer() {
+
+	for ( int s = 0; s < SectionCount; s++ )
+		if ( m_pSections[s] )
+			fclose( m_pSections[s] );
+
+}
+
+
+void RiceData::Writer::BeginLink( int linkIndex ) {
+
+	if ( linkIndex < mNextLink )
+		THROW_EXCEPTION( "K-factor source links must be ascending (link %d)", linkIndex );
+
+	// Links without data get an empty range in the table.
+	for ( ; mNextLink <= linkIndex; mNextLink++ )
+		fwrite( &mHeader.mLocationCount, sizeof(uint64_t), 1, m_pSections[LinkLocations] );
+
+	mHeader.mLinkCount = mNextLink;
+
+}
+
+
+void RiceData::Writer::BeginLocation() {
+
+	fwrite( &mHeader.mLaneCount, sizeof(uint64_t), 1, m_pSections[LocationLanes] );
+	mHeader.mLocationCount++;
+
+}
+
+
+void RiceData::Writer::BeginLane() {
+
+	fwrite( &mHeader.mDestinationCount, sizeof(uint64_t), 1, m_pSections[LaneDestinations] );
+	mHeader.mLaneCount++;
+	mLastDestination = -1;
+
+}
+
+
+void RiceData::Writer::BeginDestination( int linkIndex ) {
+
+	if ( linkIndex <= mLastDestination )
+		THROW_EXCEPTION( "K-factor destination links must be ascending (link %d)", linkIndex );
+	mLastDestination = linkIndex;
+
+	int32_t index = linkIndex;
+	fwrite( &index, sizeof(int32_t), 1, m_pSections[DestinationLinks] );
+	fwrite( &mHeader.mDestLocationCount, sizeof(uint64_t), 1, m_pSections[DestinationLocations] );
+	mHeader.mDestinationCount++;
+
+}
+
+
+void RiceData::Writer::BeginDestinationLocation() {
+
+	fwrite( &mHeader.mValueCount, sizeof(uint64_t), 1, m_pSections[LocationValues] );
+	mHeader.mDestLocationCount++;
+
+}
+
+
+void RiceData::Writer::AddValue( double k ) {
+
+	uint8_t encoded[sizeof(double)];
+	EncodeValue( k, (ValueFormat)mHeader.mValueFormat, encoded );
+	fwrite( encoded, GetValueSize( (ValueFormat)mHeader.mValueFormat ), 1, m_pSections[Values] );
+	mHeader.mValueCount++;
+
+}
+
+
+/*
+ * Method: void Finish();
+ * Description: Writes the header and the spooled sections to the output file.
+ */
+void RiceData::Writer::Finish() {
+
+	FILE *pOut = fopen( mFilename.c_str(), "wb" );
+	if ( !pOut )
+		THROW_EXCEPTION( "Cannot open K-factor file for writing: %s", mFilename.c_str() );
+
+	try {
+		Finish( pOut );
+	} catch ( ... ) {
+		fclose( pOut );
+		throw;
+	}
+
+	bool failed = ferror( pOut );
+	fclose( pOut );
+	if ( failed )
+		THROW_EXCEPTION( "Error writing K-factor file: %s", mFilename.c_str() );
+
+}
+
+
+/*
+ * Method: void Finish( FILE *pOut );
+ * Description: Writes the header and the spooled sections at the current position of the given file,
+ * 				which must be a multiple of 8 bytes. The section offsets are relative to that position.
+ */
+void RiceData::Writer::Finish( FILE *pOut ) {
+
+	// Terminate each prefix table with the total count of the next level.
+	fwrite( &mHeader.mLocationCount, sizeof(uint64_t), 1, m_pSections[LinkLocations] );
+	fwrite( &mHeader.mLaneCount, sizeof(uint64_t), 1, m_pSections[LocationLanes] );
+	fwrite( &mHeader.mDestinationCount, sizeof(uint64_t), 1, m_pSections[LaneDestinations] );
+	fwrite( &mHeader.mDestLocationCount, sizeof(uint64_t), 1, m_pSections[DestinationLocations] );
+	fwrite( &mHeader.mValueCount, sizeof(uint64_t), 1, m_pSections[LocationValues] );
+
+	long start = ftell( pOut );
+	if ( start < 0 || start % 8 != 0 )
+		THROW_EXCEPTION( "K-factors must be written at an 8 byte boundary" );
+
+	uint64_t offset = AlignSection( sizeof(FileHeader) );
+	for ( int s = 0; s < SectionCount; s++ ) {
+		mHeader.mSectionOffset[s] = offset;
+		offset = AlignSection( offset + ftell( m_pSections[s] ) );
+	}
+
+	fwrite( &mHeader, sizeof(FileHeader), 1, pOut );
+
+	char buffer[65536];
+	for ( int s = 0; s < SectionCount; s++ ) {
+
+		// Pad up to the start of the section.
+		while ( (uint64_t)( ftell( pOut ) - start ) < mHeader.mSectionOffset[s] )
+			fputc( 0, pOut );
+
+		rewind( m_pSections[s] );
+		size_t n;
+		while ( ( n = fread( buffer, 1, sizeof(buffer), m_pSections[s] ) ) > 0 )
+			fwrite( buffer, 1, n, pOut );
+
+	}
+
+	// Pad the end, so whatever follows is aligned too.
+	while ( ( ftell( pOut ) - start ) % 8 != 0 )
+		fputc( 0, pOut );
+
+}
+
+
+
+/*
+ * Name: TableBuilder
+ * Description: Appends nested entries to the in-memory tables, mirroring the Writer.
+ */
+class RiceData::TableBuilder {
+
+public:
+	TableBuilder( Tables &t, ValueFormat format ) : mTables( t ), mFormat( format ), mValueCount( 0 ), mLastDestination( -1 ) {  }
+
+	void BeginLink( int linkIndex ) {
+		if ( (size_t)linkIndex < mTables.mLinkLocations.size() )
+			THROW_EXCEPTION( "K-factor source links must be ascending (link %d)", linkIndex );
+		mTables.mLinkLocations.resize( linkIndex+1, mTables.mLocationLanes.size() );
+	}
+
+	void BeginLocation() {
+		mTables.mLocationLanes.push_back( mTables.mLaneDestinations.size() );
+	}
+
+	void BeginLane() {
+		mTables.mLaneDestinations.push_back( mTables.mDestinationLinks.size() );
+		mLastDestination = -1;
+	}
+
+	void BeginDestination( int linkIndex ) {
+		if ( linkIndex <= mLastDestination )
+			THROW_EXCEPTION( "K-factor destination links must be ascending (link %d)", linkIndex );
+		mLastDestination = linkIndex;
+		mTables.mDestinationLinks.push_back( linkIndex );
+		mTables.mDestinationLocations.push_back( mTables.mLocationValues.size() );
+	}
+
+	void BeginDestinationLocation() {
+		mTables.mLocationValues.push_back( mValueCount );
+	}
+
+	void AddValue( double k ) {
+		size_t size = GetValueSize( mFormat );
+		mTables.mValues.resize( mTables.mValues.size() + size );
+		EncodeValue( k, mFormat, &mTables.mValues[ mTables.mValues.size() - size ] );
+		mValueCount++;
+	}
+
+	void Finish() {
+		mTables.mLinkLocations.push_back( mTables.mLocationLanes.size() );
+		mTables.mLocationLanes.push_back( mTables.mLaneDestinations.size() );
+		mTables.mLaneDestinations.push_back( mTables.mDestinationLinks.size() );
+		mTables.mDestinationLocations.push_back( mTables.mLocationValues.size() );
+		mTables.mLocationValues.push_back( mValueCount );
+	}
+
+protected:
+	Tables &mTables;
+	ValueFormat mFormat;
+	uint64_t mValueCount;
+	int mLastDestination;
+
+};
+
+
+
+
+RiceData::RiceData() {
+
+	memset( &mHeader, 0, sizeof(FileHeader) );
+	mLoaded = false;
+	m_pBase = NULL;
+	mMappedSize = 0;
+	mOwnsMapping = false;
+
+	mFile = -1;
+	mFileFormat = Float64;
+	mCacheBudget = 0;
+	mCacheBytes = 0;
+	mCacheHits = mCacheMisses = 0;
+	pthread_mutex_init( &mCacheMutex, NULL );
+
+}
+
+
+RiceData::~RiceData() {
+
+	Unload();
+	pthread_mutex_destroy( &mCacheMutex );
+
+}
+
+
+/*
+ * Method: static bool IsBinaryFile( const char *filename );
+ * Description: Returns true if the given file starts with the binary K-factor header.
+ */
+bool RiceData::IsBinaryFile( const char *filename ) {
+
+	char magic[8];
+	ifstream stream( filename, ios::binary );
+	if ( !stream.read( magic, sizeof(magic) ) )
+		return false;
+	return memcmp( magic, RICE_FILE_MAGIC, sizeof(magic) ) == 0;
+
+}
+
+
+/*
+ * Method: void Load( const char *filename, ValueFormat format, size_t cacheBytes );
+ * Description: Maps the file if it is binary, otherwise parses it as text.
+ * 				The K-factors are kept in the given format, so a file in any other
+ * 				format is re-encoded into memory rather than mapped.
+ * 				If cacheBytes is not 0, a binary file is neither mapped nor re-encoded whole;
+ * 				it is paged through an LRU cache of about cacheBytes of source link blocks,
+ * 				each re-encoded as it is read. Text files have no index to page from, so
+ * 				they are always loaded whole.
+ */
+void RiceData::Load( const char *filename, ValueFormat format, size_t cacheBytes ) {
+
+	if ( IsBinaryFile( filename ) && cacheBytes > 0 ) {
+		Page( filename, cacheBytes, format );
+	} else if ( IsBinaryFile( filename ) ) {
+		Map( filename );
+		if ( GetValueFormat() != format )
+			CopyTables( format );
+	} else {
+		LoadText( filename, format );
+	}
+
+}
+
+
+/*
+ * Method: void Map( const char *filename );
+ * Description: Maps the given binary K-factor file read-only.
+ */
+void RiceData::Map( const char *filename ) {
+
+	Unload();
+
+	int fd = open( filename, O_RDONLY );
+	if ( fd < 0 )
+		THROW_EXCEPTION( "Cannot open Rice datafile: %s", filename );
+
+	struct stat st;
+	if ( fstat( fd, &st ) != 0 || (size_t)st.st_size < sizeof(FileHeader) ) {
+		close( fd );
+		THROW_EXCEPTION( "Rice datafile is truncated: %s", filename );
+	}
+
+	void *pBase = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+	close( fd );
+	if ( pBase == MAP_FAILED )
+		THROW_EXCEPTION( "Cannot map Rice datafile: %s", filename );
+
+	try {
+		MapRegion( pBase, st.st_size, filename );
+	} catch ( ... ) {
+		munmap( pBase, st.st_size );
+		throw;
+	}
+	mOwnsMapping = true;
+
+}
+
+
+/*
+ * Method: void MapRegion( const void *pBase, size_t size, const char *name );
+ * Description: Uses a binary K-factor file which is already in memory, e.g. as part of a larger mapping.
+ * 				The memory is not owned, and must outlive this object or the next Unload.
+ */
+void RiceData::MapRegion( const void *pBase, size_t size, const char *name ) {
+
+	Unload();
+
+	if ( size < sizeof(FileHeader) )
+		THROW_EXCEPTION( "Rice datafile is truncated: %s", name );
+
+	memcpy( &mHeader, pBase, sizeof(FileHeader) );
+	if ( !CheckHeader( mHeader, size ) )
+		THROW_EXCEPTION( "Unsupported or truncated Rice datafile: %s", name );
+
+	m_pBase = const_cast<void*>( pBase );
+	mMappedSize = size;
+	mOwnsMapping = false;
+	mLoaded = true;
+
+	const char *p = (const char*)m_pBase;
+	mLinkLocations        = (const uint64_t*)( p + mHeader.mSectionOffset[LinkLocations] );
+	mLocationLanes        = (const uint64_t*)( p + mHeader.mSectionOffset[LocationLanes] );
+	mLaneDestinations     = (const uint64_t*)( p + mHeader.mSectionOffset[LaneDestinations] );
+	mDestinationLinks     = (const  int32_t*)( p + mHeader.mSectionOffset[DestinationLinks] );
+	mDestinationLocations = (const uint64_t*)( p + mHeader.mSectionOffset[DestinationLocations] );
+	mLocationValues       = (const uint64_t*)( p + mHeader.mSectionOffset[LocationValues] );
+	m_pValues             = (const     void*)( p + mHeader.mSectionOffset[Values] );
+
+	if ( !CheckTables() ) {
+		Unload();
+		THROW_EXCEPTION( "Corrupt Rice datafile: %s", name );
+	}
+
+}
+
+
+/*
+ * Method: static bool CheckHeader( const FileHeader &header, uint64_t fileSize );
+ * Description: Returns true if the header is a supported version and every section lies within the file.
+ */
+bool RiceData::CheckHeader( const FileHeader &header, uint64_t fileSize ) {
+
+	if ( memcmp( header.mMagic, RICE_FILE_MAGIC, sizeof(header.mMagic) ) != 0 || header.mVersion != RICE_FILE_VERSION || header.mValueFormat > Log8 )
+		return false;
+
+	// The prefix offset tables have one more entry than the records they index.
+	uint64_t counts[SectionCount] = {
+		header.mLinkCount,
+		header.mLocationCount,
+		header.mLaneCount,
+		header.mDestinationCount,
+		header.mDestinationCount,
+		header.mDestLocationCount,
+		header.mValueCount
+	};
+	static const uint64_t extra[SectionCount] = { 1, 1, 1, 0, 1, 1, 0 };
+	for ( int s = 0; s < SectionCount; s++ ) {
+		size_t elementSize = ( s == Values ? GetValueSize( (ValueFormat)header.mValueFormat ) : gSectionElementSize[s] );
+		if ( header.mSectionOffset[s] % 8 != 0 || header.mSectionOffset[s] < sizeof(FileHeader) || header.mSectionOffset[s] > fileSize )
+			return false;
+		uint64_t available = ( fileSize - header.mSectionOffset[s] ) / elementSize;
+		if ( available < extra[s] || counts[s] > available - extra[s] )
+			return false;
+	}
+
+	return true;
+
+}
+
+
+/*
+ * Method: bool CheckOffsets( Section section, uint64_t count, uint64_t total );
+ * Description: Returns true if a prefix offset table of count entries starts at 0, never decreases,
+ * 				and ends at the number of records it indexes. A paged file is read in chunks.
+ */
+bool RiceData::CheckOffsets( Section section, uint64_t count, uint64_t total ) const {
+
+	uint64_t chunk[4096];
+	uint64_t previous = 0;
+
+	for ( uint64_t i = 0; i < count; i += sizeof(chunk) / sizeof(uint64_t) ) {
+		uint64_t n = min<uint64_t>( count - i, sizeof(chunk) / sizeof(uint64_t) );
+		const uint64_t *pOffsets = chunk;
+		if ( m_pBase )
+			pOffsets = (const uint64_t*)( (const char*)m_pBase + mHeader.mSectionOffset[section] ) + i;
+		else
+			ReadSection( section, i, n, chunk );
+		if ( i == 0 && pOffsets[0] != 0 )
+			return false;
+		for ( uint64_t j = 0; j < n; j++ ) {
+			if ( pOffsets[j] < previous )
+				return false;
+			previous = pOffsets[j];
+		}
+	}
+
+	return previous == total;
+
+}
+
+
+/*
+ * Method: bool CheckTables();
+ * Description: Returns true if every prefix offset table of the mapped or paged file is consistent,
+ * 				so that lookups never index past the sections.
+ */
+bool RiceData::CheckTables() const {
+
+	return CheckOffsets( LinkLocations, mHeader.mLinkCount + 1, mHeader.mLocationCount )
+		&& CheckOffsets( LocationLanes, mHeader.mLocationCount + 1, mHeader.mLaneCount )
+		&& CheckOffsets( LaneDestinations, mHeader.mLaneCount + 1, mHeader.mDestinationCount )
+		&& CheckOffsets( DestinationLocations, mHeader.mDestinationCount + 1, mHeader.mDestLocationCount )
+		&& CheckOffsets( LocationValues, mHeader.mDestLocationCount + 1, mHeader.mValueCount );
+
+}
+
+
+/*
+ * Method: void Page( const char *filename, size_t cacheBytes, ValueFormat format );
+ * Description: Opens the given binary K-factor file for paging, keeping at most about cacheBytes
+ * 				of source link blocks in memory. Blocks are re-encoded to the given format as they are read.
+ */
+void RiceData::Page( const char *filename, size_t cacheBytes, ValueFormat format ) {
+
+	Unload();
+
+	int fd = open( filename, O_RDONLY );
+	if ( fd < 0 )
+		THROW_EXCEPTION( "Cannot open Rice datafile: %s", filename );
+
+	struct stat st;
+	FileHeader header;
+	if ( fstat( fd, &st ) != 0 || pread( fd, &header, sizeof(FileHeader), 0 ) != sizeof(FileHeader) || !CheckHeader( header, st.st_size ) ) {
+		close( fd );
+		THROW_EXCEPTION( "Unsupported or truncated Rice datafile: %s", filename );
+	}
+
+	mHeader = header;
+	mFile = fd;
+	mFileFormat = (ValueFormat)header.mValueFormat;
+	mHeader.mValueFormat = format;
+
+	// Only the source link table stays resident.
+	bool valid;
+	try {
+		mLinkTable.resize( mHeader.mLinkCount + 1 );
+		ReadSection( LinkLocations, 0, mHeader.mLinkCount + 1, &mLinkTable[0] );
+		valid = CheckTables();
+	} catch ( ... ) {
+		Unload();
+		throw;
+	}
+
+	if ( !valid ) {
+		Unload();
+		THROW_EXCEPTION( "Corrupt Rice datafile: %s", filename );
+	}
+
+	mLinkLocations = &mLinkTable[0];
+	mBlocks.assign( mHeader.mLinkCount, (Block*)NULL );
+	mCacheBudget = cacheBytes;
+	mLoaded = true;
+
+}
+
+
+/*
+ * Method: void ReadSection( Section section, uint64_t first, uint64_t count, void *pOut );
+ * Description: Reads count elements of a section of the paged file, starting at the given element.
+ */
+void RiceData::ReadSection( Section section, uint64_t first, uint64_t count, void *pOut ) const {
+
+	size_t elementSize = ( section == Values ? GetValueSize( mFileFormat ) : gSectionElementSize[section] );
+	size_t remaining = count * elementSize;
+	off_t offset = mHeader.mSectionOffset[section] + first * elementSize;
+	char *p = (char*)pOut;
+
+	while ( remaining > 0 ) {
+		ssize_t n = pread( mFile, p, remaining, offset );
+		if ( n <= 0 )
+			THROW_EXCEPTION( "Cannot read section %d of the Rice datafile", (int)section );
+		p += n;
+		offset += n;
+		remaining -= n;
+	}
+
+}
+
+
+/*
+ * Method: Block *GetBlock( int srcLink );
+ * Description: Returns the block of the given source link, reading it if it is not cached. Call with mCacheMutex held.
+ */
+RiceData::Block *RiceData::GetBlock( int srcLink ) const {
+
+	Block *pBlock = mBlocks[srcLink];
+	if ( pBlock ) {
+		mCacheHits++;
+		mLru.splice( mLru.begin(), mLru, pBlock->mLruPosition );
+		return pBlock;
+	}
+
+	mCacheMisses++;
+	pBlock = new Block;
+
+	try {
+
+		// Each level gives the range of the next, down to the values.
+		uint64_t first = mLinkTable[srcLink], last = mLinkTable[srcLink+1];
+		pBlock->mLocationBase = first;
+		pBlock->mLocationLanes.resize( last - first + 1 );
+		ReadSection( LocationLanes, first, last - first + 1, &pBlock->mLocationLanes[0] );
+
+		first = pBlock->mLocationLanes.front();
+		last = pBlock->mLocationLanes.back();
+		pBlock->mLaneBase = first;
+		pBlock->mLaneDestinations.resize( last - first + 1 );
+		ReadSection( LaneDestinations, first, last - first + 1, &pBlock->mLaneDestinations[0] );
+
+		first = pBlock->mLaneDestinations.front();
+		last = pBlock->mLaneDestinations.back();
+		pBlock->mDestinationBase = first;
+		pBlock->mDestinationLinks.resize( last - first );
+		pBlock->mDestinationLocations.resize( last - first + 1 );
+		if ( last > first )
+			ReadSection( DestinationLinks, first, last - first, &pBlock->mDestinationLinks[0] );
+		ReadSection( DestinationLocations, first, last - first + 1, &pBlock->mDestinationLocations[0] );
+
+		first = pBlock->mDestinationLocations.front();
+		last = pBlock->mDestinationLocations.back();
+		pBlock->mDestLocationBase = first;
+		pBlock->mLocationValues.resize( last - first + 1 );
+		ReadSection( LocationValues, first, last - first + 1, &pBlock->mLocationValues[0] );
+
+		first = pBlock->mLocationValues.front();
+		last = pBlock->mLocationValues.back();
+		pBlock->mValueBase = first;
+		pBlock->mValues.resize( ( last - first ) * GetValueSize( mFileFormat ) );
+		if ( last > first )
+			ReadSection( Values, first, last - first, &pBlock->mValues[0] );
+
+		if ( mFileFormat != GetValueFormat() ) {
+			std::vector<uint8_t> encoded( ( last - first ) * GetValueSize( GetValueFormat() ) );
+			for ( uint64_t v = 0; v < last - first; v++ )
+				EncodeValue( DecodeValue( &pBlock->mValues[0], v, mFileFormat ), GetValueFormat(), &encoded[ v * GetValueSize( GetValueFormat() ) ] );
+			pBlock->mValues.swap( encoded );
+		}
+
+	} catch ( ... ) {
+
+		delete pBlock;
+		throw;
+
+	}
+
+	pBlock->mBytes = sizeof(Block)
+				   + pBlock->mLocationLanes.capacity() * sizeof(uint64_t)
+				   + pBlock->mLaneDestinations.capacity() * sizeof(uint64_t)
+				   + pBlock->mDestinationLinks.capacity() * sizeof(int32_t)
+				   + pBlock->mDestinationLocations.capacity() * sizeof(uint64_t)
+				   + pBlock->mLocationValues.capacity() * sizeof(uint64_t)
+				   + pBlock->mValues.capacity();
+
+	mLru.push_front( srcLink );
+	pBlock->mLruPosition = mLru.begin();
+	mBlocks[srcLink] = pBlock;
+	mCacheBytes += pBlock->mBytes;
+
+	// Evict the least recently used blocks, always keeping the one just read.
+	while ( mCacheBytes > mCacheBudget && mLru.size() > 1 ) {
+		int victim = mLru.back();
+		mLru.pop_back();
+		mCacheBytes -= mBlocks[victim]->mBytes;
+		delete mBlocks[victim];
+		mBlocks[victim] = NULL;
+	}
+
+	return pBlock;
+
+}
+
+
+/*
+ * Method: void GetCacheStatistics( uint64_t *pHits, uint64_t *pMisses, size_t *pResidentBytes );
+ * Description: Returns the block cache hits and misses, and the bytes of blocks in memory, when paged.
+ */
+void RiceData::GetCacheStatistics( uint64_t *pHits, uint64_t *pMisses, size_t *pResidentBytes ) const {
+
+	pthread_mutex_lock( &mCacheMutex );
+	*pHits = mCacheHits;
+	*pMisses = mCacheMisses;
+	*pResidentBytes = mCacheBytes;
+	pthread_mutex_unlock( &mCacheMutex );
+
+}
+
+
+/*
+ * Method: void LoadText( const char *filename, ValueFormat format );
+ * Description: Parses the text K-factor output of the Raytracer into memory.
+ */
+void RiceData::LoadText( const char *filename, ValueFormat format ) {
+
+	Unload();
+
+	TextParser parser;
+	if ( !parser.Open( filename ) ) {
+		THROW_EXCEPTION( "Cannot open Rice datafile: %s", filename );
+	}
+
+	int numRice;
+	parser >> mHeader.mIncrement;
+	parser >> numRice;
+	mHeader.mValueFormat = format;
+
+	TableBuilder builder( mTables, format );
+	ParseText( parser, numRice, filename, builder );
+	builder.Finish();
+	parser.Close();
+
+	SetTablePointers();
+	mLoaded = true;
+
+}
+
+
+/*
+ * Method: void SetTablePointers();
+ * Description: Points the lookup arrays at the parsed tables.
+ */
+void RiceData::SetTablePointers() {
+
+	mHeader.mLinkCount         = mTables.mLinkLocations.size() - 1;
+	mHeader.mLocationCount     = mTables.mLocationLanes.size() - 1;
+	mHeader.mLaneCount         = mTables.mLaneDestinations.size() - 1;
+	mHeader.mDestinationCount  = mTables.mDestinationLinks.size();
+	mHeader.mDestLocationCount = mTables.mLocationValues.size() - 1;
+	mHeader.mValueCount        = mTables.mValues.size() / GetValueSize( GetValueFormat() );
+
+	mLinkLocations        = &mTables.mLinkLocations[0];
+	mLocationLanes        = &mTables.mLocationLanes[0];
+	mLaneDestinations     = &mTables.mLaneDestinations[0];
+	mDestinationLinks     = mTables.mDestinationLinks.empty() ? NULL : &mTables.mDestinationLinks[0];
+	mDestinationLocations = &mTables.mDestinationLocations[0];
+	mLocationValues       = &mTables.mLocationValues[0];
+	m_pValues             = mTables.mValues.empty() ? NULL : &mTables.mValues[0];
+
+}
+
+
+/*
+ * Method: void CopyTables( ValueFormat format );
+ * Description: Copies the mapped arrays into memory, re-encoding the K-factors.
+ */
+void RiceData::CopyTables( ValueFormat format ) {
+
+	Tables tables;
+	tables.mLinkLocations.assign( mLinkLocations, mLinkLocations + mHeader.mLinkCount + 1 );
+	tables.mLocationLanes.assign( mLocationLanes, mLocationLanes + mHeader.mLocationCount + 1 );
+	tables.mLaneDestinations.assign( mLaneDestinations, mLaneDestinations + mHeader.mLaneCount + 1 );
+	tables.mDestinationLinks.assign( mDestinationLinks, mDestinationLinks + mHeader.mDestinationCount );
+	tables.mDestinationLocations.assign( mDestinationLocations, mDestinationLocations + mHeader.mDestinationCount + 1 );
+	tables.mLocationValues.assign( mLocationValues, mLocationValues + mHeader.mDestLocationCount + 1 );
+
+	size_t size = GetValueSize( format );
+	tables.mValues.resize( mHeader.mValueCount * size );
+	for ( uint64_t v = 0; v < mHeader.mValueCount; v++ )
+		EncodeValue( DecodeValue( m_pValues, v, GetValueFormat() ), format, &tables.mValues[ v * size ] );
+
+	if ( m_pBase && mOwnsMapping )
+		munmap( m_pBase, mMappedSize );
+	m_pBase = NULL;
+	mMappedSize = 0;
+	mOwnsMapping = false;
+
+	mTables = tables;
+	mHeader.mValueFormat = format;
+	SetTablePointers();
+
+}
+
+
+/*
+ * Method: void Unload();
+ * Description: Releases the mapped file or the parsed tables.
+ */
+void RiceData::Unload() {
+
+	if ( m_pBase && mOwnsMapping )
+		munmap( m_pBase, mMappedSize );
+	m_pBase = NULL;
+	mMappedSize = 0;
+	mOwnsMapping = false;
+	mLoaded = false;
+	mTables = Tables();
+
+	if ( mFile >= 0 )
+		close( mFile );
+	mFile = -1;
+	for ( size_t b = 0; b < mBlocks.size(); b++ )
+		delete mBlocks[b];
+	mBlocks.clear();
+	mLru.clear();
+	mLinkTable.clear();
+	mCacheBytes = 0;
+	mCacheHits = mCacheMisses = 0;
+
+}
+
+
+/*
+ * Method: size_t GetMemoryUsage();
+ * Description: Returns the number of bytes used by the tables.
+ */
+size_t RiceData::GetMemoryUsage() const {
+
+	if ( m_pBase )
+		return mMappedSize;
+
+	if ( mFile >= 0 )
+		return mLinkTable.capacity() * sizeof(uint64_t) + mBlocks.capacity() * sizeof(Block*) + mCacheBytes;
+
+	return mTables.mLinkLocations.capacity() * sizeof(uint64_t)
+		 + mTables.mLocationLanes.capacity() * sizeof(uint64_t)
+		 + mTables.mLaneDestinations.capacity() * sizeof(uint64_t)
+		 + mTables.mDestinationLinks.capacity() * sizeof(int32_t)
+		 + mTables.mDestinationLocations.capacity() * sizeof(uint64_t)
+		 + mTables.mLocationValues.capacity() * sizeof(uint64_t)
+		 + mTables.mValues.capacity();
+
+}
+
+
+/*
+ * Method: VectorMath::Real GetK( int srcLink, unsigned int srcPos, int srcLane, int destLink, unsigned int destPos, int destLane );
+ * Description: Get the K-factor for the given indices, or 0 (Rayleigh) if there is no entry.
+ */
+Real RiceData::GetK( int srcLink, unsigned int srcPos, int srcLane, int destLink, unsigned int destPos, int destLane ) const {
+
+	if ( !mLoaded || srcLink < 0 || (uint64_t)srcLink >= mHeader.mLinkCount || srcLane < 0 || destLane < 0 )
+		return 0;	// Don't know this link, so assume Rayleigh.
+
+	uint64_t location = mLinkLocations[srcLink] + srcPos;
+	if ( location >= mLinkLocations[srcLink+1] )
+		return 0;	// Non-indexable position on source link, so assume Rayleigh.
+
+	if ( mFile < 0 ) {
+		TableView view = { mLocationLanes, mLaneDestinations, mDestinationLinks, mDestinationLocations, mLocationValues, m_pValues, 0, 0, 0, 0, 0 };
+		return Lookup( view, GetValueFormat(), location, srcLane, destLink, destPos, destLane );
+	}
+
+	// Paged, so find the block of this source link.
+	pthread_mutex_lock( &mCacheMutex );
+	double k;
+	try {
+
+		Block *pBlock = GetBlock( srcLink );
+		TableView view = {
+			&pBlock->mLocationLanes[0], &pBlock->mLaneDestinations[0], pBlock->mDestinationLinks.data(), &pBlock->mDestinationLocations[0],
+			&pBlock->mLocationValues[0], pBlock->mValues.data(),
+			pBlock->mLocationBase, pBlock->mLaneBase, pBlock->mDestinationBase, pBlock->mDestLocationBase, pBlock->mValueBase
+		};
+		k = Lookup( view, GetValueFormat(), location, srcLane, destLink, destPos, destLane );
+
+	} catch ( ... ) {
+
+		pthread_mutex_unlock( &mCacheMutex );
+		throw;
+
+	}
+	pthread_mutex_unlock( &mCacheMutex );
+
+	return k;
+
+}
+
+
+/*
+ * Method: static double Lookup( const TableView &view, ValueFormat format, uint64_t location, int srcLane, int destLink, unsigned int destPos, int destLane );
+ * Description: Finds the K-factor below the given source location, or 0 if there is none.
+ */
+double RiceData::Lookup( const TableView &view, ValueFormat format, uint64_t location, int srcLane, int destLink, unsigned int destPos, int destLane ) {
+
+	const uint64_t *pLanes = view.mLocationLanes + ( location - view.mLocationBase );
+	uint64_t lane = pLanes[0] + srcLane;
+	if ( lane >= pLanes[1] )
+		return 0;	// Non-indexable lane on source link, so assume Rayleigh.
+
+	const uint64_t *pDestinations = view.mLaneDestinations + ( lane - view.mLaneBase );
+	const int32_t *pFirst = view.mDestinationLinks + ( pDestinations[0] - view.mDestinationBase );
+	const int32_t *pLast  = view.mDestinationLinks + ( pDestinations[1] - view.mDestinationBase );
+	const int32_t *pDest  = lower_bound( pFirst, pLast, destLink );
+	if ( pDest == pLast || *pDest != destLink )
+		return 0;	// No connection between this source and destination, so assume Rayleigh.
+
+	const uint64_t *pDestLocations = view.mDestinationLocations + ( pDest - view.mDestinationLinks );
+	uint64_t destLocation = pDestLocations[0] + destPos;
+	if ( destLocation >= pDestLocations[1] )
+		return 0;	// Non-indexable position on destination link, so assume Rayleigh.
+
+	const uint64_t *pValues = view.mLocationValues + ( destLocation - view.mDestLocationBase );
+	uint64_t value = pValues[0] + destLane;
+	if ( value >= pValues[1] )
+		return 0;	// Non-indexable lane on destination link, so assume Rayleigh.
+
+	return DecodeValue( view.m_pValues, value - view.mValueBase, format );
+
+}
+
+
+/*
+ * Method: void ParseText( TextParser &parser, int numRice, const char *filename, Sink &sink );
+ * Description: Parses the source link entries of a text K-factor file into a Writer or into Tables.
+ */
+template <class Sink> void RiceData::ParseText( TextParser &parser, int numRice, const char *filename, Sink &sink ) {
+
+	// One source lane is buffered at a time so its destinations can be sorted.
+	typedef std::vector<double> DestinationLaneList;
+	typedef std::vector<DestinationLaneList> DestinationLocationList;
+	typedef std::pair<int,DestinationLocationList> DestinationEntry;
+	std::vector<DestinationEntry> destinations;
+
+	for ( int r = 0; r < numRice; r++ ) {
+
+		// Read the index of the source link and number of locations.
+		int srcId, srcLocCount;
+		parser >> srcId >> srcLocCount;
+		sink.BeginLink( srcId );
+		for ( int srcLoc = 0; srcLoc < srcLocCount; srcLoc++ ) {
+
+			// Read the number of source lanes.
+			int srcLaneCount;
+			parser >> srcLaneCount;
+			sink.BeginLocation();
+			for ( int srcLane = 0; srcLane < srcLaneCount; srcLane++ ) {
+
+				// Read the number of destination links.
+				int destLinkCount;
+				parser >> destLinkCount;
+				destinations.resize( destLinkCount );
+				for ( int destLink = 0; destLink < destLinkCount; destLink++ ) {
+
+					// Read the index of the destination link and the number of locations therein.
+					int destLocCount;
+					parser >> destinations[destLink].first >> destLocCount;
+					DestinationLocationList &destLocList = destinations[destLink].second;
+					destLocList.resize( destLocCount );
+					for ( int destLoc = 0; destLoc < destLocCount; destLoc++ ) {
+
+						// Read the number of destination lanes.
+						int destLaneCount;
+						parser >> destLaneCount;
+						destLocList[destLoc].resize( destLaneCount );
+						for ( int destLane = 0; destLane < destLaneCount; destLane++ ) {
+
+							// Read the K-Factor. Like atof, anything unparsable reads as 0.
+							std::string_view kStr = parser.ReadToken();
+							double k = 0;
+							if ( "inf" == kStr )
+								k = DBL_MAX;
+							else if ( !kStr.empty() )
+								std::from_chars( kStr.data() + ( kStr[0] == '+' ), kStr.data() + kStr.size(), k );
+							destLocList[destLoc][destLane] = k;
+
+						}
+
+					}
+
+				}
+
+				if ( parser.Fail() )
+					THROW_EXCEPTION( "Malformed Rice datafile: %s", filename );
+
+				std::sort( destinations.begin(), destinations.end() );
+
+				sink.BeginLane();
+				std::vector<DestinationEntry>::iterator destIt;
+				for ( AllInVector( destIt, destinations ) ) {
+
+					sink.BeginDestination( destIt->first );
+					DestinationLocationList::iterator destLocIt;
+					for ( AllInVector( destLocIt, destIt->second ) ) {
+
+						sink.BeginDestinationLocation();
+						DestinationLaneList::iterator destLaneIt;
+						for ( AllInVector( destLaneIt, (*destLocIt) ) )
+							sink.AddValue( *destLaneIt );
+
+					}
+
+				}
+
+			}
+
+		}
+
+	}
+
+}
+
+
+/*
+ * Method: static void ConvertText( const char *textFile, const char *binaryFile, ValueFormat format );
+ * Description: Converts the text K-factor output of the Raytracer to the binary format.
+ */
+void RiceData::ConvertText( const char *textFile, const char *binaryFile, ValueFormat format ) {
+
+	TextParser parser;
+	if ( !parser.Open( textFile ) ) {
+		THROW_EXCEPTION( "Cannot open Rice datafile: %s", textFile );
+	}
+
+	Real increment;
+	int numRice;
+	parser >> increment;
+	parser >> numRice;
+
+	Writer writer( binaryFile, increment, format );
+	ParseText( parser, numRice, textFile, writer );
+	parser.Close();
+	writer.Finish();
+
+}
+
+
+/*
+ * Method: static uint64_t Merge( const std::vector<std::string> &inputs, const char *outFile, ValueFormat format );
+ * Description: Merges K-factor files (text or binary), e.g. the per-area outputs of the Raytracer, into one binary file.
+ * 				The inputs are streamed rather than loaded, and must all have the same increment.
+ * 				Source links found in several inputs have their destination links combined; where the same
+ * 				destination appears more than once, the earliest input wins. Returns the number of such overlaps.
+ */
+uint64_t RiceData::Merge( const std::vector<std::string> &inputs, const char *outFile, ValueFormat format ) {
+
+	if ( inputs.empty() )
+		THROW_EXCEPTION( "No K-factor files to merge" );
+
+	std::vector<RiceData> shards( inputs.size() );
+	uint64_t linkCount = 0;
+	unsigned int i;
+
+	for ( i = 0; i < inputs.size(); i++ ) {
+
+		if ( IsBinaryFile( inputs[i].c_str() ) ) {
+
+			shards[i].Map( inputs[i].c_str() );
+
+		} else {
+
+			// Text has no index, so stream it into a temporary binary file first.
+			// The mapping keeps the file alive once it has been unlinked.
+			const char *tmpDir = getenv( "TMPDIR" );
+			std::string tempFile = std::string( tmpDir ? tmpDir : "/tmp" ) + "/urae-merge-XXXXXX";
+			std::vector<char> tempName( tempFile.begin(), tempFile.end() );
+			tempName.push_back( 0 );
+			int fd = mkstemp( &tempName[0] );
+			if ( fd < 0 )
+				THROW_EXCEPTION( "Cannot create temporary file for %s", inputs[i].c_str() );
+			close( fd );
+
+			try {
+				ConvertText( inputs[i].c_str(), &tempName[0], Float64 );
+				shards[i].Map( &tempName[0] );
+			} catch ( ... ) {
+				unlink( &tempName[0] );
+				throw;
+			}
+			unlink( &tempName[0] );
+
+		}
+
+		// The text files are written with 6 significant figures, so allow for rounding.
+		Real increment = shards[0].GetIncrement();
+		if ( fabs( shards[i].GetIncrement() - increment ) > 1e-6 * fabs( increment ) )
+			THROW_EXCEPTION( "Increment differs from the first file (%g, not %g): %s", shards[i].GetIncrement(), increment, inputs[i].c_str() );
+
+		linkCount = max( linkCount, shards[i].mHeader.mLinkCount );
+
+	}
+
+	Writer writer( outFile, shards[0].GetIncrement(), format );
+	uint64_t overlaps = 0;
+
+	// Cursors into the destinations of the current source lane of each shard.
+	std::vector<uint64_t> dest( shards.size() ), destEnd( shards.size() );
+
+	for ( uint64_t link = 0; link < linkCount; link++ ) {
+
+		uint64_t locationCount = 0;
+		for ( i = 0; i < shards.size(); i++ )
+			if ( link < shards[i].mHeader.mLinkCount )
+				locationCount = max( locationCount, shards[i].mLinkLocations[link+1] - shards[i].mLinkLocations[link] );
+
+		if ( locationCount == 0 )
+			continue;
+
+		writer.BeginLink( link );
+		for ( uint64_t l = 0; l < locationCount; l++ ) {
+
+			uint64_t laneCount = 0;
+			for ( i = 0; i < shards.size(); i++ ) {
+				const RiceData &shard = shards[i];
+				if ( link < shard.mHeader.mLinkCount && l < shard.mLinkLocations[link+1] - shard.mLinkLocations[link] ) {
+					uint64_t location = shard.mLinkLocations[link] + l;
+					laneCount = max( laneCount, shard.mLocationLanes[location+1] - shard.mLocationLanes[location] );
+				}
+			}
+
+			writer.BeginLocation();
+			for ( uint64_t n = 0; n < laneCount; n++ ) {
+
+				for ( i = 0; i < shards.size(); i++ ) {
+					const RiceData &shard = shards[i];
+					dest[i] = destEnd[i] = 0;
+					if ( link < shard.mHeader.mLinkCount && l < shard.mLinkLocations[link+1] - shard.mLinkLocations[link] ) {
+						uint64_t location = shard.mLinkLocations[link] + l;
+						if ( n < shard.mLocationLanes[location+1] - shard.mLocationLanes[location] ) {
+							uint64_t lane = shard.mLocationLanes[location] + n;
+							dest[i] = shard.mLaneDestinations[lane];
+							destEnd[i] = shard.mLaneDestinations[lane+1];
+						}
+					}
+				}
+
+				writer.BeginLane();
+				while ( true ) {
+
+					// Take the lowest destination link of all the shards.
+					int best = -1;
+					for ( i = 0; i < shards.size(); i++ )
+						if ( dest[i] < destEnd[i] && ( best < 0 || shards[i].mDestinationLinks[dest[i]] < shards[best].mDestinationLinks[dest[best]] ) )
+							best = i;
+
+					if ( best < 0 )
+						break;
+
+					const RiceData &shard = shards[best];
+					int32_t destLink = shard.mDestinationLinks[dest[best]];
+					writer.BeginDestination( destLink );
+					for ( uint64_t d = shard.mDestinationLocations[dest[best]]; d < shard.mDestinationLocations[dest[best]+1]; d++ ) {
+						writer.BeginDestinationLocation();
+						for ( uint64_t v = shard.mLocationValues[d]; v < shard.mLocationValues[d+1]; v++ )
+							writer.AddValue( DecodeValue( shard.m_pValues, v, shard.GetValueFormat() ) );
+					}
+
+					// Later shards with the same destination are overlaps.
+					for ( i = 0; i < shards.size(); i++ ) {
+						if ( dest[i] < destEnd[i] && shards[i].mDestinationLinks[dest[i]] == destLink ) {
+							if ( (int)i != best )
+								overlaps++;
+							dest[i]++;
+						}
+					}
+
+				}
+
+			}
+
+		}
+
+	}
+
+	writer.Finish();
+	return overlaps;
+
+}
+
+
+/*
+ * Method: void Write( const char *filename, ValueFormat format );
+ * Description: Writes the loaded K-factors to a binary file in the given format.
+ */
+void RiceData::Write( const char *filename, ValueFormat format ) const {
+
+	if ( !mLoaded || mFile >= 0 )
+		THROW_EXCEPTION( "No mapped or loaded K-factors to write to %s", filename );
+
+	Writer writer( filename, mHeader.mIncrement, format );
+	CopyInto( writer );
+	writer.Finish();
+
+}
+
+
+/*
+ * Method: void Write( FILE *pOut, ValueFormat format );
+ * Description: Writes the loaded K-factors in the given format at the current position of the given file.
+ */
+void RiceData::Write( FILE *pOut, ValueFormat format ) const {
+
+	if ( !mLoaded || mFile >= 0 )
+		THROW_EXCEPTION( "No mapped or loaded K-factors to write" );
+
+	Writer writer( "", mHeader.mIncrement, format );
+	CopyInto( writer );
+	writer.Finish( pOut );
+
+}
+
+
+/*
+ * Method: void CopyInto( Writer &writer );
+ * Description: Passes every loaded K-factor to the given writer, in file order.
+ */
+void RiceData::CopyInto( Writer &writer ) const {
+
+	for ( uint64_t link = 0; link < mHeader.mLinkCount; link++ ) {
+
+		writer.BeginLink( link );
+		for ( uint64_t location = mLinkLocations[link]; location < mLinkLocations[link+1]; location++ ) {
+
+			writer.BeginLocation();
+			for ( uint64_t lane = mLocationLanes[location]; lane < mLocationLanes[location+1]; lane++ ) {
+
+				writer.BeginLane();
+				for ( uint64_t dest = mLaneDestinations[lane]; dest < mLaneDestinations[lane+1]; dest++ ) {
+
+					writer.BeginDestination( mDestinationLinks[dest] );
+					for ( uint64_t destLocation = mDestinationLocations[dest]; destLocation < mDestinationLocations[dest+1]; destLocation++ ) {
+
+						writer.BeginDestinationLocation();
+						for ( uint64_t value = mLocationValues[destLocation]; value < mLocationValues[destLocation+1]; value++ )
+							writer.AddValue( DecodeValue( m_pValues, value, GetValueFormat() ) );
+
+					}
+
+				}
+
+			}
+
+		}
+
+	}
+
+}
+
+
+/*
+ * Method: static ValueFormat ParseValueFormat( const char *name );
+ * Description: Returns the format called "float64", "float16" or "log8".
+ */
+RiceData::ValueFormat RiceData::ParseValueFormat( const char *name ) {
+
+	if ( strcmp( name, "float64" ) == 0 )
+		return Float64;
+	if ( strcmp( name, "float16" ) == 0 )
+		return Float16;
+	if ( strcmp( name, "log8" ) == 0 )
+		return Log8;
+
+	THROW_EXCEPTION( "Unknown K-factor format '%s' (use float64, float16 or log8)", name );
+
+}
+
+
+/*
+ * Method: static size_t GetValueSize( ValueFormat format );
+ * Description: Returns the number of bytes taken by one K-factor in the given format.
+ */
+size_t RiceData::GetValueSize( ValueFormat format ) {
+
+	switch ( format ) {
+		case Float16:	return sizeof(uint16_t);
+		case Log8:		return sizeof(uint8_t);
+		default:		return sizeof(double);
+	}
+
+}
+
+
+// Ratio between consecutive codes of the log-scale encoding.
+static const double gLog8Step = log( RICE_LOG8_MAX / RICE_LOG8_MIN ) / 253;
+
+
+/*
+ * Name: Log8Table
+ * Description: The K-factor of each code of the log-scale encoding, so decoding is one lookup.
+ */
+struct Log8Table {
+
+	double mValues[256];
+
+	Log8Table() {
+		mValues[0] = 0;
+		for ( int c = 1; c < 255; c++ )
+			mValues[c] = RICE_LOG8_MIN * exp( ( c - 1 ) * gLog8Step );
+		mValues[255] = DBL_MAX;
+	}
+
+};
+
+
+/*
+ * Method: static void EncodeValue( double k, ValueFormat format, void *pOut );
+ * Description: Stores a K-factor in the given format. pOut must hold GetValueSize( format ) bytes.
+ */
+void RiceData::EncodeValue( double k, ValueFormat format, void *pOut ) {
+
+	if ( format == Float16 ) {
+
+		// K-factors are never negative, so the sign bit is unused.
+		uint16_t half;
+		if ( k >= DBL_MAX ) {
+			half = 0x7C00;		// infinity
+		} else if ( !( k > 0 ) ) {
+			half = 0;
+		} else {
+			int e;
+			double m = frexp( k, &e );		// k = m * 2^e, with m in [0.5,1)
+			int biased = e + 14;
+			uint32_t bits;
+			if ( biased <= 0 )
+				bits = (uint32_t)lrint( ldexp( k, 24 ) );						// subnormal
+			else
+				bits = ( biased << 10 ) + (uint32_t)lrint( ( 2*m - 1 ) * 1024 );	// rounding up carries into the exponent
+			half = ( bits >= 0x7C00 ? 0x7BFF : bits );						// saturate rather than become infinite
+		}
+		memcpy( pOut, &half, sizeof(half) );
+
+	} else if ( format == Log8 ) {
+
+		uint8_t code;
+		if ( k >= DBL_MAX )
+			code = 255;
+		else if ( !( k > 0 ) )
+			code = 0;
+		else if ( k <= RICE_LOG8_MIN )
+			code = 1;
+		else if ( k >= RICE_LOG8_MAX )
+			code = 254;
+		else
+			code = 1 + (uint8_t)lrint( log( k / RICE_LOG8_MIN ) / gLog8Step );
+		*(uint8_t*)pOut = code;
+
+	} else {
+
+		memcpy( pOut, &k, sizeof(double) );
+
+	}
+
+}
+
+
+/*
+ * Method: static double DecodeValue( const void *pValues, uint64_t index, ValueFormat format );
+ * Description: Reads the K-factor at the given index of an array in the given format.
+ */
+double RiceData::DecodeValue( const void *pValues, uint64_t index, ValueFormat format ) {
+
+	if ( format == Float16 ) {
+
+		uint16_t half = ((const uint16_t*)pValues)[index];
+		int exponent = ( half >> 10 ) & 0x1F;
+		int mantissa = half & 0x3FF;
+		if ( exponent == 0x1F )
+			return DBL_MAX;
+		if ( exponent == 0 )
+			return ldexp( (double)mantissa, -24 );
+		return ldexp( (double)( 1024 + mantissa ), exponent - 25 );
+
+	} else if ( format == Log8 ) {
+
+		static const Log8Table table;
+		return table.mValues[ ((const uint8_t*)pValues)[index] ];
+
+	}
+
+	return ((const double*)pValues)[index];
+
+}
@@ -0,0 +1,679 @@
+/*
+ *  ScenarioBundle.cpp - Single binary file holding a compiled URAE scenario.
+ *  Copyright (C) 2012  C. S. Cooper, A. Mukunthan
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contact Details: Cooper - andor734@gmail.com
+ */
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <map>
+
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "Singleton.h"
+#include "VectorMath.h"
+#include "UraeData.h"
+#include "ScenarioBundle.h"
+
+using namespace std;
+using namespace VectorMath;
+using namespace Urae;
+
+
+
+/*
+ * Method: void BeginSection( FILE *pOut, uint64_t *pOffset );
+ * Description: Pads the file to the next 8 byte boundary, and records the offset of the section starting there.
+ */
+static void BeginSection( FILE *pOut, uint64_t *pOffset ) {
+
+	while ( ftell( pOut ) % 8 != 0 )
+		fputc( 0, pOut );
+	*pOffset = ftell( pOut );
+
+}
+
+
+/*
+ * Method: void WriteSection( FILE *pOut, const std::vector<T> &records, uint64_t *pOffset, uint64_t *pCount );
+ * Description: Writes a section of records, recording where it starts and how many records it has.
+ */
+template <class T>
+static void WriteSection( FILE *pOut, const std::vector<T> &records, uint64_t *pOffset, uint64_t *pCount ) {
+
+	BeginSection( pOut, pOffset );
+	*pCount = records.size();
+	if ( !records.empty() )
+		fwrite( &records[0], sizeof(T), records.size(), pOut );
+
+}
+
+
+/*
+ * Method: void AddName( const std::string &name, std::vector<char> &names, uint64_t *pOffset, uint32_t *pLength );
+ * Description: Appends a name to the shared name characters.
+ */
+static void AddName( const std::string &name, std::vector<char> &names, uint64_t *pOffset, uint32_t *pLength ) {
+
+	*pOffset = names.size();
+	*pLength = name.size();
+	names.insert( names.end(), name.begin(), name.end() );
+
+}
+
+
+/*
+ * Method: bool CheckOffsets( const uint64_t *pOffsets, uint64_t count, uint64_t expected, uint64_t total );
+ * Description: Returns true if a prefix offset table has the expected number of entries, never decreases,
+ * 				and ends at the number of records it indexes.
+ */
+static bool CheckOffsets( const uint64_t *pOffsets, uint64_t count, uint64_t expected, uint64_t total ) {
+
+	if ( count != expected || pOffsets[0] != 0 || pOffsets[count-1] != total )
+		return false;
+
+	for ( uint64_t i = 1; i < count; i++ )
+		if ( pOffsets[i] < pOffsets[i-1] )
+			return false;
+
+	return true;
+
+}
+
+
+/*
+ * Method: static void Write( UraeData &data, const char *filename, RiceData::ValueFormat riceFormat, VectorMath::Real classRange );
+ * Description: Writes the loaded and computed scenario to a bundle, with the K-factors in the given format.
+ * 				classRange is recorded as the range the classifications were pruned to, or 0 if they were not.
+ * 				The summed link set, buckets and grid must already have been computed.
+ */
+void ScenarioBundle::Write( UraeData &data, const char *filename, RiceData::ValueFormat riceFormat, Real classRange ) {
+
+	unsigned int i, j;
+
+	FileHeader header;
+	memset( &header, 0, sizeof(FileHeader) );
+	memcpy( header.mMagic, BUNDLE_FILE_MAGIC, sizeof(header.mMagic) );
+	header.mVersion = BUNDLE_FILE_VERSION;
+	header.mRiceFormat = riceFormat;
+	header.mGridSize = data.mGridSize;
+	header.mBucketSize = data.mBucketSize;
+	header.mLengthIncrement = data.mRiceTable.IsLoaded() ? data.mRiceTable.GetIncrement() : 0;
+	header.mClassRange = classRange;
+	header.mMapRect[0] = data.mMapRect.location.x;
+	header.mMapRect[1] = data.mMapRect.location.y;
+	header.mMapRect[2] = data.mMapRect.size.x;
+	header.mMapRect[3] = data.mMapRect.size.y;
+	header.mCentroid[0] = data.mCentroid.x;
+	header.mCentroid[1] = data.mCentroid.y;
+	header.mBucketX = data.mBucketX;
+	header.mBucketY = data.mBucketY;
+	header.mGridRowCount = data.mGridRowCount;
+	header.mGridColumnCount = data.mGridColumnCount;
+
+	// Flatten everything into records first, so a failure leaves no partial file.
+	std::vector<NodeRecord> nodes( data.mNodeSet.size() );
+	std::vector<uint64_t> nodeLinkOffsets( 1, 0 );
+	std::vector<int32_t> nodeLinks;
+	for ( i = 0; i < data.mNodeSet.size(); i++ ) {
+		UraeData::Node &node = data.mNodeSet[i];
+		memset( &nodes[i], 0, sizeof(NodeRecord) );
+		nodes[i].mIndex = node.index;
+		nodes[i].mPosition[0] = node.position.x;
+		nodes[i].mPosition[1] = node.position.y;
+		nodes[i].mSize = node.mSize;
+		nodeLinks.insert( nodeLinks.end(), node.mConnectedLinks.begin(), node.mConnectedLinks.end() );
+		nodeLinkOffsets.push_back( nodeLinks.size() );
+	}
+
+	std::vector<LinkRecord> links[2];
+	UraeData::LinkSet *pLinkSets[2] = { &data.mLinkSet, &data.mSummedLinkSet };
+	for ( j = 0; j < 2; j++ ) {
+		links[j].resize( pLinkSets[j]->size() );
+		for ( i = 0; i < pLinkSets[j]->size(); i++ ) {
+			UraeData::Link &link = (*pLinkSets[j])[i];
+			links[j][i].mIndex = link.index;
+			links[j][i].mNodeA = link.nodeAindex;
+			links[j][i].mNodeB = link.nodeBindex;
+			links[j][i].mLaneCount = link.NumberOfLanes;
+			links[j][i].mFlow = link.flow;
+			links[j][i].mSpeed = link.speed;
+		}
+	}
+
+	// The classification table is written as it is held, whether it was parsed or mapped from a bundle.
+	uint64_t classCount = data.mClassRowCount > 0 ? data.m_pClassRowOffsets[ data.mClassRowCount ] : 0;
+	std::vector<uint64_t> classRowOffsets( 1, 0 );
+	if ( data.mClassRowCount > 0 )
+		classRowOffsets.assign( data.m_pClassRowOffsets, data.m_pClassRowOffsets + data.mClassRowCount + 1 );
+	std::vector<int32_t> classOtherLinks( data.m_pClassOtherLinks, data.m_pClassOtherLinks + classCount );
+	std::vector<UraeData::ClassificationRecord> classifications( data.m_pClassRecords, data.m_pClassRecords + classCount );
+
+	std::vector<BuildingRecord> buildings( data.mBuildingSet.size() );
+	std::vector<uint64_t> edgeOffsets( 1, 0 );
+	std::vector<EdgeRecord> edges;
+	for ( i = 0; i < data.mBuildingSet.size(); i++ ) {
+		UraeData::Building &building = data.mBuildingSet[i];
+		buildings[i].mId = building.mId;
+		buildings[i].mPermitivity = building.mPermitivity;
+		buildings[i].mMaxHeight = building.mMaxHeight;
+		buildings[i].mHeightStdDev = building.mHeightStdDev;
+		for ( UraeData::LineSet::iterator edgeIt = building.mEdgeSet.begin(); edgeIt != building.mEdgeSet.end(); edgeIt++ ) {
+			EdgeRecord edge = { { edgeIt->mStart.x, edgeIt->mStart.y }, { edgeIt->mEnd.x, edgeIt->mEnd.y } };
+			edges.push_back( edge );
+		}
+		edgeOffsets.push_back( edges.size() );
+	}
+
+	std::vector<uint64_t> bucketOffsets( 1, 0 );
+	std::vector<int64_t> bucketEntries;
+	for ( i = 0; i < data.mBucketX; i++ ) {
+		for ( j = 0; j < data.mBucketY; j++ ) {
+			bucketEntries.insert( bucketEntries.end(), data.m_ppBuckets[i][j].begin(), data.m_ppBuckets[i][j].end() );
+			bucketOffsets.push_back( bucketEntries.size() );
+		}
+	}
+
+	std::vector<uint64_t> gridOffsets( 1, 0 );
+	std::vector<int32_t> gridEntries;
+	for ( i = 0; i < data.mGridRowCount; i++ ) {
+		for ( j = 0; j < data.mGridColumnCount; j++ ) {
+			gridEntries.insert( gridEntries.end(), data.mGridList[i][j].linkList.begin(), data.mGridList[i][j].linkList.end() );
+			gridOffsets.push_back( gridEntries.size() );
+		}
+	}
+
+	std::vector<char> names;
+	std::vector<NameRecord> linkNames[2];
+	std::map<std::string,int> *pNameMaps[2] = { &data.mLinkIndexMap, &data.mInternalLinkIndexMap };
+	for ( j = 0; j < 2; j++ ) {
+		for ( std::map<std::string,int>::iterator it = pNameMaps[j]->begin(); it != pNameMaps[j]->end(); it++ ) {
+			NameRecord record;
+			AddName( it->first, names, &record.mOffset, &record.mLength );
+			record.mIndex = it->second;
+			linkNames[j].push_back( record );
+		}
+	}
+
+	std::vector<CarRecord> cars;
+	for ( UraeData::CarDefinitionMap::iterator it = data.mCarDefinitions.begin(); it != data.mCarDefinitions.end(); it++ ) {
+		CarRecord record;
+		memset( &record, 0, sizeof(CarRecord) );
+		AddName( it->first, names, &record.mNameOffset, &record.mNameLength );
+		record.mAcceleration = it->second.mAcceleration;
+		record.mDeceleration = it->second.mDeceleration;
+		record.mDriverImperfection = it->second.mDriverImperfection;
+		record.mLength = it->second.mLength;
+		record.mWidth = it->second.mWidth;
+		record.mHeight = it->second.mHeight;
+		cars.push_back( record );
+	}
+
+	FILE *pOut = fopen( filename, "wb" );
+	if ( !pOut )
+		THROW_EXCEPTION( "Cannot open bundle for writing: %s", filename );
+
+	try {
+
+		// The header is written again once the sections are in place.
+		fwrite( &header, sizeof(FileHeader), 1, pOut );
+
+		WriteSection( pOut, nodes,              &header.mSectionOffset[Nodes],               &header.mSectionCount[Nodes] );
+		WriteSection( pOut, nodeLinkOffsets,    &header.mSectionOffset[NodeLinkOffsets],     &header.mSectionCount[NodeLinkOffsets] );
+		WriteSection( pOut, nodeLinks,          &header.mSectionOffset[NodeLinks],           &header.mSectionCount[NodeLinks] );
+		WriteSection( pOut, links[0],           &header.mSectionOffset[Links],               &header.mSectionCount[Links] );
+		WriteSection( pOut, links[1],           &header.mSectionOffset[SummedLinks],         &header.mSectionCount[SummedLinks] );
+		WriteSection( pOut, classRowOffsets,    &header.mSectionOffset[ClassRowOffsets],     &header.mSectionCount[ClassRowOffsets] );
+		WriteSection( pOut, classOtherLinks,    &header.mSectionOffset[ClassOtherLinks],     &header.mSectionCount[ClassOtherLinks] );
+		WriteSection( pOut, classifications,    &header.mSectionOffset[Classifications],     &header.mSectionCount[Classifications] );
+		WriteSection( pOut, buildings,          &header.mSectionOffset[Buildings],           &header.mSectionCount[Buildings] );
+		WriteSection( pOut, edgeOffsets,        &header.mSectionOffset[BuildingEdgeOffsets], &header.mSectionCount[BuildingEdgeOffsets] );
+		WriteSection( pOut, edges,              &header.mSectionOffset[BuildingEdges],       &header.mSectionCount[BuildingEdges] );
+		WriteSection( pOut, bucketOffsets,      &header.mSectionOffset[BucketOffsets],       &header.mSectionCount[BucketOffsets] );
+		WriteSection( pOut, bucketEntries,      &header.mSectionOffset[BucketEntries],       &header.mSectionCount[BucketEntries] );
+		WriteSection( pOut, gridOffsets,        &header.mSectionOffset[GridOffsets],         &header.mSectionCount[GridOffsets] );
+		WriteSection( pOut, gridEntries,        &header.mSectionOffset[GridEntries],         &header.mSectionCount[GridEntries] );
+		WriteSection( pOut, linkNames[0],       &header.mSectionOffset[LinkNames],           &header.mSectionCount[LinkNames] );
+		WriteSection( pOut, linkNames[1],       &header.mSectionOffset[InternalLinkNames],   &header.mSectionCount[InternalLinkNames] );
+		WriteSection( pOut, cars,               &header.mSectionOffset[CarDefinitions],      &header.mSectionCount[CarDefinitions] );
+		WriteSection( pOut, names,              &header.mSectionOffset[Names],               &header.mSectionCount[Names] );
+
+		BeginSection( pOut, &header.mSectionOffset[KFactors] );
+		if ( data.mRiceTable.IsLoaded() )
+			data.mRiceTable.Write( pOut, riceFormat );
+		header.mSectionCount[KFactors] = ftell( pOut ) - header.mSectionOffset[KFactors];
+
+		fseek( pOut, 0, SEEK_SET );
+		fwrite( &header, sizeof(FileHeader), 1, pOut );
+
+	} catch ( ... ) {
+
+		fclose( pOut );
+		throw;
+
+	}
+
+	bool failed = ferror( pOut );
+	fclose( pOut );
+	if ( failed )
+		THROW_EXCEPTION( "Error writing bundle: %s", filename );
+
+}
+
+
+/*
+ * Method: static void Read( UraeData &data, const char *filename );
+ * Description: Maps the given bundle and fills the (empty) UraeData from it.
+ * 				The classifications and K-factors are used in place, so the mapping is handed to the UraeData.
+ */
+void ScenarioBundle::Read( UraeData &data, const char *filename ) {
+
+	unsigned int i, j;
+
+	int fd = open( filename, O_RDONLY );
+	if ( fd < 0 )
+		THROW_EXCEPTION( "Cannot open bundle: %s", filename );
+
+	struct stat st;
+	if ( fstat( fd, &st ) != 0 || (size_t)st.st_size < sizeof(FileHeader) ) {
+		close( fd );
+		THROW_EXCEPTION( "Bundle is truncated: %s", filename );
+	}
+
+	void *pMapped = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+	close( fd );
+	if ( pMapped == MAP_FAILED )
+		THROW_EXCEPTION( "Cannot map bundle: %s", filename );
+
+	const char *pBase = (const char*)pMapped;
+	FileHeader header;
+	memcpy( &header, pBase, sizeof(FileHeader) );
+
+	const NodeRecord     *pNodes           = (const NodeRecord*)    ( pBase + header.mSectionOffset[Nodes] );
+	const uint64_t       *pNodeLinkOffsets = (const uint64_t*)      ( pBase + header.mSectionOffset[NodeLinkOffsets] );
+	const int32_t        *pNodeLinks       = (const int32_t*)       ( pBase + header.mSectionOffset[NodeLinks] );
+	const LinkRecord     *pLinks[2]        = { (const LinkRecord*)  ( pBase + header.mSectionOffset[Links] ),
+											   (const LinkRecord*)  ( pBase + header.mSectionOffset[SummedLinks] ) };
+	const uint64_t       *pClassRowOffsets = (const uint64_t*)      ( pBase + header.mSectionOffset[ClassRowOffsets] );
+	const int32_t        *pClassOtherLinks = (const int32_t*)       ( pBase + header.mSectionOffset[ClassOtherLinks] );
+	const UraeData::ClassificationRecord *pClasses = (const UraeData::ClassificationRecord*)( pBase + header.mSectionOffset[Classifications] );
+	const BuildingRecord *pBuildings       = (const BuildingRecord*)( pBase + header.mSectionOffset[Buildings] );
+	const uint64_t       *pEdgeOffsets     = (const uint64_t*)      ( pBase + header.mSectionOffset[BuildingEdgeOffsets] );
+	const EdgeRecord     *pEdges           = (const EdgeRecord*)    ( pBase + header.mSectionOffset[BuildingEdges] );
+	const uint64_t       *pBucketOffsets   = (const uint64_t*)      ( pBase + header.mSectionOffset[BucketOffsets] );
+	const int64_t        *pBucketEntries   = (const int64_t*)       ( pBase + header.mSectionOffset[BucketEntries] );
+	const uint64_t       *pGridOffsets     = (const uint64_t*)      ( pBase + header.mSectionOffset[GridOffsets] );
+	const int32_t        *pGridEntries     = (const int32_t*)       ( pBase + header.mSectionOffset[GridEntries] );
+	const NameRecord     *pNameRecords[2]  = { (const NameRecord*)  ( pBase + header.mSectionOffset[LinkNames] ),
+											   (const NameRecord*)  ( pBase + header.mSectionOffset[InternalLinkNames] ) };
+	const CarRecord      *pCars            = (const CarRecord*)     ( pBase + header.mSectionOffset[CarDefinitions] );
+	const char           *pNames           = pBase + header.mSectionOffset[Names];
+
+	// Check that every index into another section stays inside the file.
+	bool valid = CheckHeader( header, st.st_size );
+	uint64_t bucketCount = (uint64_t)header.mBucketX * header.mBucketY;
+	uint64_t gridCount = (uint64_t)header.mGridRowCount * header.mGridColumnCount;
+	valid = valid && CheckOffsets( pNodeLinkOffsets, header.mSectionCount[NodeLinkOffsets], header.mSectionCount[Nodes] + 1, header.mSectionCount[NodeLinks] );
+	valid = valid && header.mSectionCount[ClassRowOffsets] >= 1 && header.mSectionCount[Classifications] == header.mSectionCount[ClassOtherLinks];
+	valid = valid && CheckOffsets( pClassRowOffsets, header.mSectionCount[ClassRowOffsets], header.mSectionCount[ClassRowOffsets], header.mSectionCount[ClassOtherLinks] );
+	valid = valid && CheckOffsets( pEdgeOffsets, header.mSectionCount[BuildingEdgeOffsets], header.mSectionCount[Buildings] + 1, header.mSectionCount[BuildingEdges] );
+	valid = valid && CheckOffsets( pBucketOffsets, header.mSectionCount[BucketOffsets], bucketCount + 1, header.mSectionCount[BucketEntries] );
+	valid = valid && CheckOffsets( pGridOffsets, header.mSectionCount[GridOffsets], gridCount + 1, header.mSectionCount[GridEntries] );
+	for ( j = 0; j < 2 && valid; j++ )
+		for ( i = 0; i < header.mSectionCount[LinkNames+j] && valid; i++ )
+			valid = pNameRecords[j][i].mOffset + pNameRecords[j][i].mLength <= header.mSectionCount[Names];
+	for ( i = 0; i < header.mSectionCount[CarDefinitions] && valid; i++ )
+		valid = pCars[i].mNameOffset + pCars[i].mNameLength <= header.mSectionCount[Names];
+
+	if ( !valid ) {
+		munmap( pMapped, st.st_size );
+		THROW_EXCEPTION( "Unsupported or corrupt bundle: %s", filename );
+	}
+
+	try {
+
+		data.mGridSize = header.mGridSize;
+		data.mBucketSize = header.mBucketSize;
+		data.mMapRect = Rect( header.mMapRect[0], header.mMapRect[1], header.mMapRect[2], header.mMapRect[3] );
+		data.mCentroid = Vector2D( header.mCentroid[0], header.mCentroid[1] );
+		data.mBucketX = header.mBucketX;
+		data.mBucketY = header.mBucketY;
+		data.mGridRowCount = header.mGridRowCount;
+		data.mGridColumnCount = header.mGridColumnCount;
+		data.mLengthIncrement = header.mLengthIncrement;
+
+		data.mNodeSet.resize( header.mSectionCount[Nodes] );
+		for ( i = 0; i < data.mNodeSet.size(); i++ ) {
+			UraeData::Node &node = data.mNodeSet[i];
+			node.index = pNodes[i].mIndex;
+			node.position = Vector2D( pNodes[i].mPosition[0], pNodes[i].mPosition[1] );
+			node.mSize = pNodes[i].mSize;
+			node.mConnectedLinks.assign( pNodeLinks + pNodeLinkOffsets[i], pNodeLinks + pNodeLinkOffsets[i+1] );
+		}
+
+		UraeData::LinkSet *pLinkSets[2] = { &data.mLinkSet, &data.mSummedLinkSet };
+		for ( j = 0; j < 2; j++ ) {
+			pLinkSets[j]->resize( header.mSectionCount[Links+j] );
+			for ( i = 0; i < pLinkSets[j]->size(); i++ ) {
+				UraeData::Link &link = (*pLinkSets[j])[i];
+				link.index = pLinks[j][i].mIndex;
+				link.nodeAindex = pLinks[j][i].mNodeA;
+				link.nodeBindex = pLinks[j][i].mNodeB;
+				link.NumberOfLanes = pLinks[j][i].mLaneCount;
+				link.flow = pLinks[j][i].mFlow;
+				link.speed = pLinks[j][i].mSpeed;
+			}
+		}
+
+		// The classification table has the same layout in memory, so it is searched in place.
+		data.m_pClassRowOffsets = pClassRowOffsets;
+		data.m_pClassOtherLinks = pClassOtherLinks;
+		data.m_pClassRecords = pClasses;
+		data.mClassRowCount = header.mSectionCount[ClassRowOffsets] - 1;
+
+		data.mBuildingSet.resize( header.mSectionCount[Buildings] );
+		for ( i = 0; i < data.mBuildingSet.size(); i++ ) {
+			UraeData::Building &building = data.mBuildingSet[i];
+			building.mId = pBuildings[i].mId;
+			building.mPermitivity = pBuildings[i].mPermitivity;
+			building.mMaxHeight = pBuildings[i].mMaxHeight;
+			building.mHeightStdDev = pBuildings[i].mHeightStdDev;
+			building.mEdgeSet.reserve( pEdgeOffsets[i+1] - pEdgeOffsets[i] );
+			for ( uint64_t e = pEdgeOffsets[i]; e < pEdgeOffsets[i+1]; e++ )
+				building.mEdgeSet.push_back( LineSegment( Vector2D( pEdges[e].mStart[0], pEdges[e].mStart[1] ), Vector2D( pEdges[e].mEnd[0], pEdges[e].mEnd[1] ) ) );
+		}
+
+		data.m_ppBuckets = new UraeData::Bucket*[data.mBucketX];
+		for ( i = 0; i < data.mBucketX; i++ ) {
+			data.m_ppBuckets[i] = new UraeData::Bucket[data.mBucketY];
+			for ( j = 0; j < data.mBucketY; j++ ) {
+				uint64_t b = (uint64_t)i * data.mBucketY + j;
+				data.m_ppBuckets[i][j].assign( pBucketEntries + pBucketOffsets[b], pBucketEntries + pBucketOffsets[b+1] );
+			}
+		}
+
+		data.mGridList = new UraeData::Grid*[data.mGridRowCount];
+		for ( i = 0; i < data.mGridRowCount; i++ ) {
+			data.mGridList[i] = new UraeData::Grid[data.mGridColumnCount];
+			for ( j = 0; j < data.mGridColumnCount; j++ ) {
+				uint64_t g = (uint64_t)i * data.mGridColumnCount + j;
+				data.mGridList[i][j].gridRect = Rect( j*data.mGridSize, i*data.mGridSize, data.mGridSize, data.mGridSize );
+				data.mGridList[i][j].linkList.assign( pGridEntries + pGridOffsets[g], pGridEntries + pGridOffsets[g+1] );
+			}
+		}
+
+		std::map<std::string,int> *pNameMaps[2] = { &data.mLinkIndexMap, &data.mInternalLinkIndexMap };
+		for ( j = 0; j < 2; j++ ) {
+			for ( i = 0; i < header.mSectionCount[LinkNames+j]; i++ ) {
+				const NameRecord &record = pNameRecords[j][i];
+				pNameMaps[j]->insert( pNameMaps[j]->end(), std::make_pair( std::string( pNames + record.mOffset, record.mLength ), (int)record.mIndex ) );
+			}
+		}
+
+		for ( i = 0; i < header.mSectionCount[CarDefinitions]; i++ ) {
+			UraeData::CarDefinition def;
+			def.mAcceleration = pCars[i].mAcceleration;
+			def.mDeceleration = pCars[i].mDeceleration;
+			def.mDriverImperfection = pCars[i].mDriverImperfection;
+			def.mLength = pCars[i].mLength;
+			def.mWidth = pCars[i].mWidth;
+			def.mHeight = pCars[i].mHeight;
+			data.mCarDefinitions.insert( data.mCarDefinitions.end(), std::make_pair( std::string( pNames + pCars[i].mNameOffset, pCars[i].mNameLength ), def ) );
+		}
+
+		if ( header.mSectionCount[KFactors] > 0 ) {
+			data.mRiceTable.MapRegion( pBase + header.mSectionOffset[KFactors], header.mSectionCount[KFactors], filename );
+			data.mRiceFormat = data.mRiceTable.GetValueFormat();
+		}
+
+	} catch ( ... ) {
+
+		munmap( pMapped, st.st_size );
+		throw;
+
+	}
+
+	data.m_pBundle = pMapped;
+	data.mBundleSize = st.st_size;
+
+}
+
+
+/*
+ * Method: static bool IsBundleFile( const char *filename );
+ * Description: Returns true if the given file starts with the bundle header.
+ */
+bool ScenarioBundle::IsBundleFile( const char *filename ) {
+
+	char magic[8];
+	ifstream stream( filename, ios::binary );
+	if ( !stream.read( magic, sizeof(magic) ) )
+		return false;
+	return memcmp( magic, BUNDLE_FILE_MAGIC, sizeof(magic) ) == 0;
+
+}
+
+
+/*
+ * Method: static bool CheckHeader( const FileHeader &header, uint64_t fileSize );
+ * Description: Returns true if the header is a supported version and every section lies within the file.
+ */
+bool ScenarioBundle::CheckHeader( const FileHeader &header, uint64_t fileSize ) {
+
+	// Size in bytes of one record of each section.
+	static const size_t sectionElementSize[SectionCount] = {
+		sizeof(NodeRecord),			// Nodes
+		sizeof(uint64_t),			// NodeLinkOffsets
+		sizeof(int32_t),			// NodeLinks
+		sizeof(LinkRecord),			// Links
+		sizeof(LinkRecord),			// SummedLinks
+		sizeof(uint64_t),			// ClassRowOffsets
+		sizeof(int32_t),			// ClassOtherLinks
+		sizeof(UraeData::ClassificationRecord),	// Classifications
+		sizeof(BuildingRecord),		// Buildings
+		sizeof(uint64_t),			// BuildingEdgeOffsets
+		sizeof(EdgeRecord),			// BuildingEdges
+		sizeof(uint64_t),			// BucketOffsets
+		sizeof(int64_t),			// BucketEntries
+		sizeof(uint64_t),			// GridOffsets
+		sizeof(int32_t),			// GridEntries
+		sizeof(NameRecord),			// LinkNames
+		sizeof(NameRecord),			// InternalLinkNames
+		sizeof(CarRecord),			// CarDefinitions
+		sizeof(char),				// Names
+		sizeof(char)				// KFactors
+	};
+
+	if ( memcmp( header.mMagic, BUNDLE_FILE_MAGIC, sizeof(header.mMagic) ) != 0 || header.mVersion != BUNDLE_FILE_VERSION )
+		return false;
+
+	for ( int s = 0; s < SectionCount; s++ ) {
+		if ( header.mSectionOffset[s] % 8 != 0 || header.mSectionOffset[s] < sizeof(FileHeader) || header.mSectionOffset[s] > fileSize )
+			return false;
+		if ( header.mSectionCount[s] > ( fileSize - header.mSectionOffset[s] ) / sectionElementSize[s] )
+			return false;
+	}
+
+	return true;
+
+}
+
+
+/*
+ * Method: const char *OptionalFile( const char *filename );
+ * Description: Treats an empty file name as no file.
+ */
+static const char *OptionalFile( const char *filename ) {
+
+	return ( filename && filename[0] ) ? filename : NULL;
+
+}
+
+
+/*
+ * Method: static void Compile( const char *bundleFile, const char *linksFile, ..., RiceData::ValueFormat riceFormat, unsigned int loaderThreads, VectorMath::Real classRange, std::ostream *pLog );
+ * Description: Loads the given CORNER files (NULL or "" for any that are not used), computes the summed links,
+ * 				buckets and grid, and writes them all to a bundle. If classRange is not 0, the classifications between
+ * 				links further apart than it are left out. The load timings are written to pLog, if given.
+ * 				The files are loaded into a UraeData of its own, and UraeData::GetSingleton() is left as it was,
+ * 				though it briefly points at that UraeData, so no other thread should be using it meanwhile.
+ */
+void ScenarioBundle::Compile( const char *bundleFile, const char *linksFile, const char *nodesFile, const char *classFile, const char *buildingFile, const char *linkMapFile, const char *intLinkMapFile, const char *riceDataFile, const char *carDefFile, Real grid, RiceData::ValueFormat riceFormat, unsigned int loaderThreads, Real classRange, std::ostream *pLog ) {
+
+	// The physical parameters are given when the bundle is loaded, so any will do here.
+	// Constructing and deleting a UraeData sets the singleton, so it is put back to the caller's each time.
+	UraeData *pCurrent = UraeData::GetSingleton();
+	UraeData *pData = new UraeData( 5, 0.125, 1, 1, 1, 0.75, grid );
+	UraeData::m_pSingleton = pCurrent;
+
+	try {
+
+		pData->LoadNetwork( OptionalFile( linksFile ),
+							OptionalFile( nodesFile ),
+							OptionalFile( classFile ),
+							OptionalFile( buildingFile ),
+							OptionalFile( linkMapFile ),
+							OptionalFile( intLinkMapFile ),
+							OptionalFile( riceDataFile ),
+							OptionalFile( carDefFile ),
+							loaderThreads );
+		pData->ComputeSummedLinkSet();
+		pData->ComputeBuckets();
+		if ( classRange > 0 )
+			pData->PruneClassifications( classRange );
+
+		Write( *pData, bundleFile, riceFormat, classRange );
+
+	} catch ( ... ) {
+
+		delete pData;
+		UraeData::m_pSingleton = pCurrent;
+		throw;
+
+	}
+
+	if ( pLog )
+		pData->PrintLoadTimings( *pLog );
+
+	delete pData;
+	UraeData::m_pSingleton = pCurrent;
+
+}
+
+
+/*
+ * Method: static std::string Share( const char *name, const char *directory, const char *linksFile, ..., unsigned int loaderThreads, VectorMath::Real classRange );
+ * Description: Returns the path of the bundle called name in the given directory (e.g. /dev/shm, which is held in memory).
+ * 				The first process to ask compiles it from the given files, while any others wait on a lock;
+ * 				after that it is recompiled if one of the files is newer, or if it was compiled with a different
+ * 				grid, riceFormat or classRange. Every process then loads the
+ * 				same bundle, and since the classifications and K-factors are used in place from a shared mapping,
+ * 				the machine holds one copy of them however many processes there are.
+ * 				The bundle is compiled as by Compile, so UraeData::GetSingleton() is left as it was.
+ * 				Processes sharing a name should ask for the same settings, or each will recompile it in turn.
+ */
+std::string ScenarioBundle::Share( const char *name, const char *directory, const char *linksFile, const char *nodesFile, const char *classFile, const char *buildingFile, const char *linkMapFile, const char *intLinkMapFile, const char *riceDataFile, const char *carDefFile, Real grid, RiceData::ValueFormat riceFormat, unsigned int loaderThreads, Real classRange ) {
+
+	if ( !name[0] || strchr( name, '/' ) )
+		THROW_EXCEPTION( "Invalid shared bundle name: '%s'", name );
+
+	std::string path = std::string( directory ) + "/" + name + ".bundle";
+	std::string lockPath = path + ".lock";
+
+	int lockFd = open( lockPath.c_str(), O_RDWR | O_CREAT, 0666 );
+	if ( lockFd < 0 )
+		THROW_EXCEPTION( "Cannot open lock for shared bundle: %s", lockPath.c_str() );
+
+	// Only one process at a time checks the bundle, so the first one compiles it and the others wait.
+	while ( flock( lockFd, LOCK_EX ) != 0 ) {
+		if ( errno != EINTR ) {
+			close( lockFd );
+			THROW_EXCEPTION( "Cannot lock shared bundle: %s", lockPath.c_str() );
+		}
+	}
+
+	try {
+
+		struct stat bundleStat;
+		bool compile = ( stat( path.c_str(), &bundleStat ) != 0 );
+
+		// A bundle of another version, or compiled with other settings, is replaced.
+		if ( !compile ) {
+			FileHeader header;
+			ifstream stream( path.c_str(), ios::binary );
+			compile = !stream.read( (char*)&header, sizeof(FileHeader) )
+					|| memcmp( header.mMagic, BUNDLE_FILE_MAGIC, sizeof(header.mMagic) ) != 0
+					|| header.mVersion != BUNDLE_FILE_VERSION
+					|| header.mGridSize != (double)grid
+					|| header.mRiceFormat != (uint32_t)riceFormat
+					|| header.mClassRange != (double)classRange;
+		}
+
+		const char *inputs[] = { linksFile, nodesFile, classFile, buildingFile, linkMapFile, intLinkMapFile, riceDataFile, carDefFile };
+		for ( unsigned int i = 0; i < sizeof(inputs) / sizeof(const char*) && !compile; i++ ) {
+			struct stat inputStat;
+			if ( OptionalFile( inputs[i] ) && stat( inputs[i], &inputStat ) == 0 && inputStat.st_mtime > bundleStat.st_mtime )
+				compile = true;
+		}
+
+		if ( compile ) {
+
+			// Write to a temporary name first. Renaming it into place leaves processes
+			// which still have the old bundle mapped with a consistent copy.
+			std::string tempPath = path + ".XXXXXX";
+			std::vector<char> tempName( tempPath.begin(), tempPath.end() );
+			tempName.push_back( 0 );
+			int fd = mkstemp( &tempName[0] );
+			if ( fd < 0 )
+				THROW_EXCEPTION( "Cannot create shared bundle: %s", path.c_str() );
+			fchmod( fd, 0644 );
+			close( fd );
+
+			try {
+				Compile( &tempName[0], linksFile, nodesFile, classFile, buildingFile, linkMapFile, intLinkMapFile, riceDataFile, carDefFile, grid, riceFormat, loaderThreads, classRange );
+				if ( rename( &tempName[0], path.c_str() ) != 0 )
+					THROW_EXCEPTION( "Cannot create shared bundle: %s", path.c_str() );
+			} catch ( ... ) {
+				unlink( &tempName[0] );
+				throw;
+			}
+
+		}
+
+	} catch ( ... ) {
+
+		flock( lockFd, LOCK_UN );
+		close( lockFd );
+		throw;
+
+	}
+
+	flock( lockFd, LOCK_UN );
+	close( lockFd );
+
+	return path;
+
+}
@@ -0,0 +1,199 @@
+/*
+ *  TextParser.cpp - Fast tokeniser for the whitespace-separated CORNER and K-factor text files.
+ *  Copyright (C) 2012  C. S. Cooper, A. Mukunthan
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contact Details: Cooper - andor734@gmail.com
+ */
+
+#include <charconv>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "TextParser.h"
+
+using namespace Urae;
+
+
+TextParser::TextParser() {
+
+	m_pBegin = m_pEnd = m_pPos = NULL;
+	mFail = true;
+	m_pMapped = NULL;
+	mMappedSize = 0;
+
+}
+
+
+TextParser::~TextParser() {
+
+	Close();
+
+}
+
+
+/*
+ * Method: bool Open( const char *filename );
+ * Description: Loads the given file. Returns false if it cannot be read.
+ */
+bool TextParser::Open( const char *filename ) {
+
+	Close();
+
+	int fd = open( filename, O_RDONLY );
+	if ( fd < 0 )
+		return false;
+
+	struct stat fileStat;
+	if ( fstat( fd, &fileStat ) == 0 && S_ISREG( fileStat.st_mode ) && fileStat.st_size > 0 ) {
+
+		void *pMapped = mmap( NULL, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+		if ( pMapped != MAP_FAILED ) {
+			madvise( pMapped, fileStat.st_size, MADV_SEQUENTIAL );
+			m_pMapped = pMapped;
+			mMappedSize = fileStat.st_size;
+			m_pBegin = (const char*)pMapped;
+			m_pEnd = m_pBegin + mMappedSize;
+		}
+
+	}
+
+	if ( !m_pMapped ) {
+
+		// Not a regular file (or empty), so read whatever there is.
+		char chunk[65536];
+		ssize_t count;
+		while ( ( count = read( fd, chunk, sizeof(chunk) ) ) > 0 )
+			mBuffer.insert( mBuffer.end(), chunk, chunk + count );
+
+		if ( count < 0 ) {
+			close( fd );
+			mBuffer.clear();
+			return false;
+		}
+
+		m_pBegin = mBuffer.empty() ? NULL : &mBuffer[0];
+		m_pEnd = m_pBegin + mBuffer.size();
+
+	}
+
+	close( fd );
+	m_pPos = m_pBegin;
+	mFail = false;
+	return true;
+
+}
+
+
+/*
+ * Method: void Close();
+ * Description: Releases the file.
+ */
+void TextParser::Close() {
+
+	if ( m_pMapped )
+		munmap( m_pMapped, mMappedSize );
+	m_pMapped = NULL;
+	mMappedSize = 0;
+	mBuffer.clear();
+	m_pBegin = m_pEnd = m_pPos = NULL;
+	mFail = true;
+
+}
+
+
+/*
+ * Method: bool SkipWhitespace();
+ * Description: Moves to the start of the next token. Returns false, and fails, at the end of the file.
+ */
+bool TextParser::SkipWhitespace() {
+
+	if ( mFail )
+		return false;
+
+	while ( m_pPos < m_pEnd && ( *m_pPos == ' ' || ( *m_pPos >= '\t' && *m_pPos <= '\r' ) ) )
+		m_pPos++;
+
+	if ( m_pPos == m_pEnd )
+		mFail = true;
+
+	return !mFail;
+
+}
+
+
+/*
+ * Method: std::string_view ReadToken();
+ * Description: Reads the next whitespace-separated token. The view is valid until the file is closed.
+ */
+std::string_view TextParser::ReadToken() {
+
+	if ( !SkipWhitespace() )
+		return std::string_view();
+
+	const char *pStart = m_pPos;
+	while ( m_pPos < m_pEnd && !( *m_pPos == ' ' || ( *m_pPos >= '\t' && *m_pPos <= '\r' ) ) )
+		m_pPos++;
+
+	return std::string_view( pStart, m_pPos - pStart );
+
+}
+
+
+int TextParser::ReadInt() {
+
+	if ( !SkipWhitespace() )
+		return 0;
+
+	// from_chars does not take a leading '+', which the streams accept.
+	const char *pStart = m_pPos;
+	if ( *pStart == '+' && pStart + 1 < m_pEnd && *(pStart+1) != '-' )
+		pStart++;
+
+	int value = 0;
+	std::from_chars_result result = std::from_chars( pStart, m_pEnd, value );
+	if ( result.ec != std::errc() ) {
+		mFail = true;
+		return 0;
+	}
+
+	m_pPos = result.ptr;
+	return value;
+
+}
+
+
+double TextParser::ReadDouble() {
+
+	if ( !SkipWhitespace() )
+		return 0;
+
+	const char *pStart = m_pPos;
+	if ( *pStart == '+' && pStart + 1 < m_pEnd && *(pStart+1) != '-' )
+		pStart++;
+
+	double value = 0;
+	std::from_chars_result result = std::from_chars( pStart, m_pEnd, value );
+	if ( result.ec != std::errc() ) {
+		mFail = true;
+		return 0;
+	}
+
+	m_pPos = result.ptr;
+	return value;
+
+}
@@ -23,15 +23,23 @@
 #include <algorithm>
 #include <vector>
 #include <cfloat>
+#include <cstring>
 #include <string>
 #include <list>
 #include <map>
+#include <tuple>
 #include <climits>
+#include <ctime>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "Singleton.h"
 #include "VectorMath.h"
 #include "UraeData.h"
+#include "ScenarioBundle.h"
 #include "Classifier.h"
+#include "GraphClassifier.h"
+#include "TextParser.h"
 
 using namespace std;
 using namespace VectorMath;
@@ -42,6 +50,19 @@ DECLARE_SINGLETON( UraeData );
 
 
 
+/*
+ * Method: double GetWallTime();
+ * Description: Seconds on a monotonic clock, for timing the steps of loading.
+ */
+static double GetWallTime() {
+
+	timespec t;
+	clock_gettime( CLOCK_MONOTONIC, &t );
+	return t.tv_sec + t.tv_nsec * 1e-9;
+
+}
+
+
 
 
 
@@ -98,6 +119,16 @@ UraeData::UraeData( VectorMath::Real laneWidth, VectorMath::Real lambda, VectorM
 	mBucketSize = grid;
 	mLambdaBy4PiSq = pow( mWavelength / (4 * M_PI), 2 );
 	mFreeSpaceRange = ( mWavelength / ( 4 * M_PI ) ) * sqrt( mTransmitPower / ( mSystemLoss * mSensitivity ) );
+	mRiceFormat = RiceData::Float64;
+	mRiceCacheBytes = 0;
+	m_pBundle = NULL;
+	mBundleSize = 0;
+	m_pGraphClassifier = NULL;
+	m_pClassRowOffsets = NULL;
+	m_pClassOtherLinks = NULL;
+	m_pClassRecords = NULL;
+	mClassRowCount = 0;
+	ComputePathlossCoefficients();
 
 }
 
@@ -115,6 +146,8 @@ UraeData::UraeData( VectorMath::Real laneWidth, VectorMath::Real lambda, VectorM
  * 		9. L - losses due to the system (signal processing, etc) not related to propagation
  * 		10. sensitivity - the sensitivity of the receiver
  * 		11. lpr - The loss per reflection
+ * 		12. grid - size of the grid squares in metres
+ * 		13. loaderThreads - number of threads parsing the input files (1 reads them one after another)
  */
 UraeData::UraeData(
 		const char* linksFile,
@@ -128,7 +161,8 @@ UraeData::UraeData(
 		VectorMath::Real L, 
 		VectorMath::Real sensitivity, 
 		VectorMath::Real lpr, 
-		VectorMath::Real grid ) { 
+		VectorMath::Real grid,
+		unsigned int loaderThreads ) { 
 
 	mLaneWidth = laneWidth;
 	mWavelength = lambda;
@@ -140,10 +174,21 @@ UraeData::UraeData(
 	mBucketSize = grid; 
 	mLambdaBy4PiSq = pow( mWavelength / (4 * M_PI), 2 );
 	mFreeSpaceRange = sqrt( mLambdaBy4PiSq * mTransmitPower / ( mSystemLoss * mSensitivity ) );
-
-	LoadNetwork( linksFile, nodesFile, classFile, buildingFile, linkMapFile, NULL, NULL, NULL );
+	mRiceFormat = RiceData::Float64;
+	mRiceCacheBytes = 0;
+	m_pBundle = NULL;
+	mBundleSize = 0;
+	m_pGraphClassifier = NULL;
+	m_pClassRowOffsets = NULL;
+	m_pClassOtherLinks = NULL;
+	m_pClassRecords = NULL;
+	mClassRowCount = 0;
+
+	LoadNetwork( linksFile, nodesFile, classFile, buildingFile, linkMapFile, NULL, NULL, NULL, loaderThreads );
 	ComputeSummedLinkSet();
 	ComputeBuckets();
+	ComputeJunctionClassifications();
+	ComputePathlossCoefficients();
 
 }
 
@@ -165,6 +210,11 @@ UraeData::UraeData(
  * 		12. L - losses due to the system (signal processing, etc) not related to propagation
  * 		13. sensitivity - the sensitivity of the receiver
  * 		14. lpr - The loss per reflection
+ * 		15. grid - size of the grid squares in metres
+ * 		16. loaderThreads - number of threads parsing the input files (1 reads them one after another)
+ * 		17. riceFormat - precision the K-factors are kept in
+ * 		18. riceCacheBytes - if not 0, a binary K-factor file is paged by source link, keeping about this many bytes in memory
+ * 		19. classRange - if not 0, classifications between links further apart than this are dropped
  */
 UraeData::UraeData(
 		const char* linksFile,
@@ -181,7 +231,11 @@ UraeData::UraeData(
 		VectorMath::Real L, 
 		VectorMath::Real sensitivity, 
 		VectorMath::Real lpr, 
-		VectorMath::Real grid ) { 
+		VectorMath::Real grid,
+		unsigned int loaderThreads,
+		RiceData::ValueFormat riceFormat,
+		size_t riceCacheBytes,
+		VectorMath::Real classRange ) { 
 
 	mLaneWidth = laneWidth;
 	mWavelength = lambda;
@@ -193,10 +247,74 @@ UraeData::UraeData(
 	mBucketSize = grid; 
 	mLambdaBy4PiSq = pow( mWavelength / (4 * M_PI), 2 );
 	mFreeSpaceRange = sqrt( mLambdaBy4PiSq * mTransmitPower / ( mSystemLoss * mSensitivity ) );
-
-	LoadNetwork( linksFile, nodesFile, classFile, NULL, linkMapFile, intLinkMapFile, riceDataFile, carDefFile );
+	mRiceFormat = riceFormat;
+	mRiceCacheBytes = riceCacheBytes;
+	m_pBundle = NULL;
+	mBundleSize = 0;
+	m_pGraphClassifier = NULL;
+	m_pClassRowOffsets = NULL;
+	m_pClassOtherLinks = NULL;
+	m_pClassRecords = NULL;
+	mClassRowCount = 0;
+
+	LoadNetwork( linksFile, nodesFile, classFile, NULL, linkMapFile, intLinkMapFile, riceDataFile, carDefFile, loaderThreads );
 	ComputeSummedLinkSet();
 	ComputeBuckets();
+	if ( classRange > 0 )
+		PruneClassifications( classRange );		// which computes the pathloss coefficients of what is left
+	else
+		ComputePathlossCoefficients();
+	ComputeJunctionClassifications();
+
+}
+
+
+/*
+ * Constructor Arguments:
+ * 		1. bundleFile - file name of a scenario bundle written by the BundleCompiler
+ * 		2. laneWidth - width of one lane in metres
+ * 		3. lambda - wavelength of the carrier signal
+ * 		4. txPower - transmission power of the signal
+ * 		5. L - losses due to the system (signal processing, etc) not related to propagation
+ * 		6. sensitivity - the sensitivity of the receiver
+ * 		7. lpr - The loss per reflection
+ */
+UraeData::UraeData(
+		const char *bundleFile,
+		VectorMath::Real laneWidth,
+		VectorMath::Real lambda,
+		VectorMath::Real txPower,
+		VectorMath::Real L,
+		VectorMath::Real sensitivity,
+		VectorMath::Real lpr ) {
+
+	mLaneWidth = laneWidth;
+	mWavelength = lambda;
+	mTransmitPower = txPower;
+	mSystemLoss = L;
+	mSensitivity = sensitivity;
+	mLossPerReflection = lpr;
+	mLambdaBy4PiSq = pow( mWavelength / (4 * M_PI), 2 );
+	mFreeSpaceRange = sqrt( mLambdaBy4PiSq * mTransmitPower / ( mSystemLoss * mSensitivity ) );
+	mRiceFormat = RiceData::Float64;
+	mRiceCacheBytes = 0;
+	m_pBundle = NULL;
+	mBundleSize = 0;
+	m_pGraphClassifier = NULL;
+	m_pClassRowOffsets = NULL;
+	m_pClassOtherLinks = NULL;
+	m_pClassRecords = NULL;
+	mClassRowCount = 0;
+
+	// The bundle holds the grid size, the summed links, buckets and grid as well as the input files.
+	double start = GetWallTime();
+	ScenarioBundle::Read( *this, bundleFile );
+	InternRoads();
+	ComputeNodePairLinks();
+	AddLoadTiming( "bundle", GetWallTime() - start );
+	ComputeLinkRaster();
+	ComputeJunctionClassifications();
+	ComputePathlossCoefficients();
 
 }
 
@@ -206,8 +324,14 @@ UraeData::~UraeData() {
 	mNodeSet.clear();
 	mLinkSet.clear();
 	mSummedLinkSet.clear();
-	mClassificationMap.clear();
+	mClassificationTable = ClassificationTable();
 	mBuildingSet.clear();
+	delete m_pGraphClassifier;
+
+	// The K-factors of a bundle point into its mapping.
+	mRiceTable.Unload();
+	if ( m_pBundle )
+		munmap( m_pBundle, mBundleSize );
 
 }
 
@@ -314,11 +438,24 @@ UraeData::Classification UraeData::GetClassification( int l1, int l2 ) {
 	OrderedIndexPair linkPair(l1,l2);
 	Classification c;
 
-	ClassificationMap::iterator cm = mClassificationMap.find(linkPair);
-	if ( cm != mClassificationMap.end() ) {
-
-		c = cm->second;
+	const ClassificationRecord *pRecord = FindClassification( linkPair );
+	ClassificationRecord computed;
+	if ( !pRecord && m_pGraphClassifier && m_pGraphClassifier->Classify( linkPair, &computed ) )
+		pRecord = &computed;
+
+	if ( pRecord ) {
+
+		c.mLinkPair = linkPair;
+		c.mClassification = pRecord->mClassification;
+		c.mNodeSet[0] = pRecord->mNodeSet[0];
+		c.mNodeSet[1] = pRecord->mNodeSet[1];
+		c.mFullNodeCount = pRecord->mFullNodeCount;
+		c.mMainStreetLaneCount = pRecord->mMainStreetLaneCount;
+		c.mSideStreetLaneCount = pRecord->mSideStreetLaneCount;
+		c.mParaStreetLaneCount = pRecord->mParaStreetLaneCount;
 		c.mFlipped = ( c.mLinkPair.first != l1 );
+		if ( pRecord != &computed && !mClassCoefficients.empty() )
+			c.mCoefficients = mClassCoefficients[ pRecord - m_pClassRecords ];
 
 	} else {
 
@@ -332,12 +469,39 @@ UraeData::Classification UraeData::GetClassification( int l1, int l2 ) {
 
 
 /*
- * Method: Classification GetClassification( std::string link1, std::string link2 );
- * Description: Get the CORNER classification between the given links (by name).
+ * Method: const ClassificationRecord *FindClassification( const VectorMath::OrderedIndexPair &linkPair );
+ * Description: Returns the classification record of the given link pair, or NULL if there is none.
  */
-UraeData::Classification UraeData::GetClassification( std::string link1, std::string link2 ) {
+const UraeData::ClassificationRecord *UraeData::FindClassification( const OrderedIndexPair &linkPair ) const {
+
+	if ( linkPair.first < 0 || (size_t)linkPair.first >= mClassRowCount )
+		return NULL;
+
+	const int32_t *pRowBegin = m_pClassOtherLinks + m_pClassRowOffsets[ linkPair.first ];
+	const int32_t *pRowEnd   = m_pClassOtherLinks + m_pClassRowOffsets[ linkPair.first + 1 ];
+	const int32_t *pOther = std::lower_bound( pRowBegin, pRowEnd, linkPair.second );
+	if ( pOther == pRowEnd || *pOther != linkPair.second )
+		return NULL;
 
-	return GetClassification( mLinkIndexMap[link1], mLinkIndexMap[link2] );
+	return &m_pClassRecords[ pOther - m_pClassOtherLinks ];
+
+}
+
+
+/*
+ * Method: Classification GetClassification( std::string_view link1, std::string_view link2 );
+ * Description: Get the CORNER classification between the given links (by name). Unmapped names are out of range.
+ */
+UraeData::Classification UraeData::GetClassification( std::string_view link1, std::string_view link2 ) {
+
+	int l1, l2;
+	if ( LinkHasMapping( link1, &l1 ) && LinkHasMapping( link2, &l2 ) )
+		return GetClassification( l1, l2 );
+
+	Classification c;
+	c.mClassification = Classifier::OutOfRange;
+	c.mFullNodeCount = INT_MAX;
+	return c;
 
 }
 
@@ -346,12 +510,23 @@ UraeData::Classification UraeData::GetClassification( std::string link1, std::st
 /**
  *	Get the classification and k factor between the given points.
  */
-UraeData::Classification UraeData::GetClassification( std::string txName, std::string rxName, Vector2D txPos, Vector2D rxPos ) {
+UraeData::Classification UraeData::GetClassification( std::string_view txName, std::string_view rxName, Vector2D txPos, Vector2D rxPos ) {
+
+	return GetClassification( GetRoadId( txName ), GetRoadId( rxName ), txPos, rxPos );
+
+}
+
+
+/*
+ * Method: Classification GetClassification( RoadId txRoad, RoadId rxRoad, Vector2D txPos, Vector2D rxPos );
+ * Description: Get the classification between the given points, on roads resolved by GetRoadId.
+ */
+UraeData::Classification UraeData::GetClassification( RoadId txRoad, RoadId rxRoad, Vector2D txPos, Vector2D rxPos ) {
 
 	int txIndex = 0;
-	bool txHasMapping = LinkHasMapping( txName, &txIndex ); 
+	bool txHasMapping = LinkHasMapping( txRoad, &txIndex ); 
 	int rxIndex = 0;
-	bool rxHasMapping = LinkHasMapping( rxName, &rxIndex ); 
+	bool rxHasMapping = LinkHasMapping( rxRoad, &rxIndex ); 
 
 	if ( txHasMapping && rxHasMapping ) {
 		// We have a mapping for both links
@@ -359,17 +534,25 @@ UraeData::Classification UraeData::GetClassification( std::string txName, std::s
 	}
 
 	// otherwise, we may have one car on an internal edge
-	if ( txHasMapping != rxHasMapping ) {
+	int txNode = txHasMapping ? -1 : GetRoad( txRoad ) ? GetRoad( txRoad )->mNodeIndex : -1;
+	int rxNode = rxHasMapping ? -1 : GetRoad( rxRoad ) ? GetRoad( rxRoad )->mNodeIndex : -1;
+	if ( ( txHasMapping || txNode >= 0 ) && ( rxHasMapping || rxNode >= 0 ) ) {
 
-		if ( !txHasMapping )
-			return GetClassificationFromOneInternal( txName, rxIndex, txPos, rxPos );
-		if ( !rxHasMapping )
-			return GetClassificationFromOneInternal( rxName, txIndex, txPos, rxPos );
+		if ( !txHasMapping && rxHasMapping )
+			return GetClassificationFromOneInternal( txNode, rxIndex, txPos, rxPos );
+		if ( !rxHasMapping && txHasMapping )
+			return GetClassificationFromOneInternal( rxNode, txIndex, txPos, rxPos );
+
+		// otherwise we have both cars on internal links.
+		return GetClassificationFromInternalLinks( txNode, rxNode, txPos, rxPos );
 
 	}
 
-	// otherwise we have both cars on internal links.
-	return GetClassificationFromInternalLinks( txName, rxName, txPos, rxPos );
+	// a car is on an edge we know nothing about
+	Classification c;
+	c.mClassification = Classifier::OutOfRange;
+	c.mFullNodeCount = INT_MAX;
+	return c;
 
 }
 
@@ -392,19 +575,19 @@ void UraeData::RefineClassification( UraeData::Classification &cls, VectorMath::
 		Vector2D &commonNode = GetNode( cls.mNodeSet[0] )->position;
 		Real sDist, dDist;
 		if ( cls.mFlipped ) {
-			sDist = GetSummedLink( cls.mLinkPair.second )->NumberOfLanes*mLaneWidth*0.5;
-			dDist = GetSummedLink( cls.mLinkPair.first  )->NumberOfLanes*mLaneWidth*0.5;
+			sDist = mLinkHalfWidthSq[ cls.mLinkPair.second ];
+			dDist = mLinkHalfWidthSq[ cls.mLinkPair.first  ];
 		} else {
-			sDist = GetSummedLink( cls.mLinkPair.first  )->NumberOfLanes*mLaneWidth*0.5;
-			dDist = GetSummedLink( cls.mLinkPair.second )->NumberOfLanes*mLaneWidth*0.5;
+			sDist = mLinkHalfWidthSq[ cls.mLinkPair.first  ];
+			dDist = mLinkHalfWidthSq[ cls.mLinkPair.second ];
 		}
 
-		if ( commonNode.DistanceSq( s ) < sDist*sDist || commonNode.Distance( d ) < dDist*dDist )
+		if ( commonNode.DistanceSq( s ) < sDist || commonNode.DistanceSq( d ) < dDist )
 			cls.mClassification = Classifier::LOS;
 
 		return;
 
-	} else {
+	} else if ( cls.mClassification == Classifier::NLOS2 ) {
 
 		// We're in NLOS2. We need to be a bit more tricky here.
 		// We have to get the common link. Then, if both source and destination are near enough to either of the common link's nodes,
@@ -414,34 +597,16 @@ void UraeData::RefineClassification( UraeData::Classification &cls, VectorMath::
 		Node *n2 = GetNode( cls.mNodeSet[1] );
 
 		// Find the common link between them.
-		LinkIndexSet commonLinkSet;
-		LinkIndexSet::iterator linkIt = std::set_intersection( n1->mConnectedLinks.begin(), n1->mConnectedLinks.end(), n2->mConnectedLinks.begin(), n2->mConnectedLinks.end(), commonLinkSet.begin() );
-		commonLinkSet.resize( linkIt - commonLinkSet.begin() );
-
+		int commonLink = GetCommonLink( cls.mNodeSet[0], cls.mNodeSet[1] );
+		if ( commonLink < 0 ) {
 #ifdef DEBUG
-		if ( commonLinkSet.size() == 0 ) {
-			// Found more or less than 1 common link. Bailing out and leaving as is.
 			std::cerr << "Found no common link between nodes " << cls.mNodeSet[0] << " and " << cls.mNodeSet[1] << ". Bailing out and leaving as is.\n";
+#endif // #ifdef DEBUG
 			return;
 		}
 
-		if ( commonLinkSet.size() > 1 ) {
-			// Found more than 1 common link. Bailing out and leaving as is.
-			std::cerr << "Found more than 1 common link between nodes " << cls.mNodeSet[0] << " and " << cls.mNodeSet[1] << ". Bailing out and leaving as is.\n";
-			return;
-		}
-
-#else // #ifdef DEBUG
-
-		if ( commonLinkSet.size() != 1 ) {
-			// Found more or less than 1 common link. Bailing out and leaving as is.
-			return;
-		}
-
-#endif // #ifdef DEBUG
-
-		// Calculate the minimum distance we need to be within.
-		Real dist = pow( GetSummedLink( *linkIt )->NumberOfLanes*mLaneWidth*0.5, 2 );
+		// The minimum distance we need to be within.
+		Real dist = mLinkHalfWidthSq[ commonLink ];
 
 		// Now work out how far from the nodes we are.
 		Real sDist, dDist;
@@ -462,11 +627,103 @@ void UraeData::RefineClassification( UraeData::Classification &cls, VectorMath::
 
 	}
 
+	// Out of range: nothing to refine.
+
 }
 
 
 
 
+/*
+ * Method: void FillPathlossCoefficients( const Vector2D &corner1, const Vector2D *pCorner2, Real Wm, Real Ws, Real Wp, UraeData::PathlossCoefficients *pOut );
+ * Description: Computes the coefficients of a classification with the given junctions (pCorner2 is NULL for NLOS1) and street widths.
+ */
+static void FillPathlossCoefficients( const Vector2D &corner1, const Vector2D *pCorner2, Real Wm, Real Ws, Real Wp, UraeData::PathlossCoefficients *pOut ) {
+
+	pOut->mCorner[0] = corner1;
+	pOut->mCorner[1] = pCorner2 ? *pCorner2 : corner1;
+	pOut->mMainWidth = Wm;
+	pOut->mSideWidth = Ws;
+	pOut->mParaWidth = Wp;
+	pOut->mSideMainWidth = Ws * Wm;
+	pOut->mParaSideWidth = Wp * Ws;
+	pOut->mCornerDistance = ( pOut->mCorner[0] - pOut->mCorner[1] ).Magnitude();
+	pOut->mCornerDistanceWidth = pOut->mCornerDistance * Wm * Wp;
+
+}
+
+
+/*
+ * Method: const PathlossCoefficients *GetPathlossCoefficients( const Classification &cls, PathlossCoefficients *pScratch ) const;
+ * Description: Get the precomputed coefficients of the given classification, or compute them into pScratch.
+ */
+const UraeData::PathlossCoefficients *UraeData::GetPathlossCoefficients( const Classification &cls, PathlossCoefficients *pScratch ) const {
+
+	if ( cls.mCoefficients >= 0 )
+		return &mPathlossCoefficients[ cls.mCoefficients ];
+
+	const Vector2D *pCorner2 = ( cls.mClassification == Classifier::NLOS2 ) ? &mNodeSet[ cls.mNodeSet[1] ].position : NULL;
+	FillPathlossCoefficients( mNodeSet[ cls.mNodeSet[0] ].position, pCorner2, cls.mMainStreetLaneCount * mLaneWidth,
+							  cls.mSideStreetLaneCount * mLaneWidth, cls.mParaStreetLaneCount * mLaneWidth, pScratch );
+	return pScratch;
+
+}
+
+
+/*
+ * Method: void ComputePathlossCoefficients();
+ * Description: Computes the coefficients of every NLOS classification in the table, the reflection losses and the wavelength terms.
+ */
+void UraeData::ComputePathlossCoefficients() {
+
+	double start = GetWallTime();
+
+	mLambdaTerms[0] = mLambdaBy4PiSq;
+	mLambdaTerms[1] = mLambdaBy4PiSq * mWavelength;
+	mLambdaTerms[2] = mLambdaBy4PiSq * pow( mWavelength, 2 );
+
+	// The losses are kept until they underflow to 0, or the table is as long as is worth holding.
+	mReflectionLoss.clear();
+	for ( unsigned int n = 0; n < MAX_REFLECTION_LOSSES; n++ ) {
+		mReflectionLoss.push_back( pow( mLossPerReflection, 2 * n ) );
+		if ( mReflectionLoss.back() == 0 )
+			break;
+	}
+
+	// Classifications with the same junctions and streets share their coefficients. NLOS2 ones refined to NLOS1 keep them.
+	typedef std::tuple<int32_t,int32_t,float,float,float> CoefficientKey;
+	std::map<CoefficientKey,int32_t> keys;
+	uint64_t classCount = GetClassificationCount();
+	mPathlossCoefficients.clear();
+	mClassCoefficients.assign( classCount, -1 );
+	for ( uint64_t c = 0; c < classCount; c++ ) {
+
+		const ClassificationRecord &record = m_pClassRecords[c];
+		bool nlos2 = ( record.mClassification == Classifier::NLOS2 );
+		if ( record.mClassification != Classifier::NLOS1 && !nlos2 )
+			continue;
+		if ( record.mNodeSet[0] < 0 || (size_t)record.mNodeSet[0] >= mNodeSet.size() || ( nlos2 && ( record.mNodeSet[1] < 0 || (size_t)record.mNodeSet[1] >= mNodeSet.size() ) ) )
+			continue;
+
+		CoefficientKey key( record.mNodeSet[0], nlos2 ? record.mNodeSet[1] : -1, record.mMainStreetLaneCount, record.mSideStreetLaneCount, nlos2 ? record.mParaStreetLaneCount : 0 );
+		std::map<CoefficientKey,int32_t>::iterator it = keys.find( key );
+		if ( it == keys.end() ) {
+			PathlossCoefficients coefficients;
+			FillPathlossCoefficients( mNodeSet[ record.mNodeSet[0] ].position, nlos2 ? &mNodeSet[ record.mNodeSet[1] ].position : NULL,
+									  record.mMainStreetLaneCount * mLaneWidth, record.mSideStreetLaneCount * mLaneWidth,
+									  record.mParaStreetLaneCount * mLaneWidth, &coefficients );
+			it = keys.insert( std::make_pair( key, (int32_t)mPathlossCoefficients.size() ) ).first;
+			mPathlossCoefficients.push_back( coefficients );
+		}
+		mClassCoefficients[c] = it->second;
+
+	}
+
+	AddLoadTiming( "pathloss coefficients", GetWallTime() - start );
+
+}
+
+
 /*
  * Method: VectorMath::Real GetK( LinkPair p, Vector2D srcPos, Vector2D destPos );
  * Description: Get the pre-computed k-factor between the given source and destination.
@@ -488,45 +745,45 @@ Real UraeData::GetK( OrderedIndexPair p, Vector2D srcPos, int srcLane, Vector2D
 	// TODO: the lane indexing isn't quite right due to the summing of links in both directions.
 	// TODO: See if you can think of a way to fix this. Maybe rework the raytracer to consider links in both directions...
 
-	if ( sourceLink >= mRiceFactorData.size() )
-		return 0;	// Don't know this link, so assume Rayleigh.
+	return mRiceTable.GetK( sourceLink, sourcePos, srcLane, destLink, destinationPos, destLane );
 
-	SourceLocationList &srcLocList = mRiceFactorData[sourceLink];
-	if ( sourcePos >= srcLocList.size() )
-		return 0;	// Non-indexable position on source link, so assume Rayleigh.
+}
 
-	SourceLaneList &srcLaneList = srcLocList[sourcePos];
-	if ( srcLane >= srcLaneList.size() )
-		return 0;	// Non-indexable lane on source link, so assume Rayleigh.
 
-	DestinationLookup &destLookup = srcLaneList[srcLane];
-	if ( destLookup.find( destLink ) != destLookup.end() )
-		return 0;	// No connection between this source and destination, so assume Rayleigh.
+/*
+ * Method: RoadId GetRoadId( std::string_view roadName ) const;
+ * Description: Returns the ID of the given SUMO edge name, or NoRoad if neither link mapping holds it.
+ */
+UraeData::RoadId UraeData::GetRoadId( std::string_view roadName ) const {
 
-	DestinationLocationList &destLocList = destLookup[destLink];
-	if ( destinationPos >= destLocList.size() )
-		return 0;	// Non-indexable position on destination link, so assume Rayleigh.
+	std::unordered_map<std::string_view,RoadId>::const_iterator it = mRoadIdMap.find( roadName );
+	return it != mRoadIdMap.end() ? it->second : NoRoad;
 
-	DestinationLaneList &destLaneList = destLocList[destinationPos];
-	if ( destLane >= destLaneList.size() )
-		return 0;	// Non-indexable lane on destination link, so assume Rayleigh.
+}
 
-	// Now index the lookup.
-	return destLaneList[destLane];
+
+/*
+ * Method: bool LinkIsInternal( std::string_view linkName, LinkIndexSet **pLinkIndices );
+ * Description: Returns true if the given link name is an internal link, and returns a pointer to the parent node's connected links.
+ */
+bool UraeData::LinkIsInternal( std::string_view linkName, LinkIndexSet **pLinkIndices ) {
+
+	return LinkIsInternal( GetRoadId( linkName ), pLinkIndices );
 
 }
 
 
 /*
- * Method: bool LinkIsInternal( std::string linkName, LinkIndexSet **pLinkIndices );
- * Description: Returns true if the given link name is an internal link, and returns a pointer to the parent node's connected links.
+ * Method: bool LinkIsInternal( RoadId road, LinkIndexSet **pLinkIndices );
+ * Description: Returns true if the given road is an internal link, and returns a pointer to the parent node's connected links.
  */
-bool UraeData::LinkIsInternal( std::string linkName, LinkIndexSet **pLinkIndices ) {
+bool UraeData::LinkIsInternal( RoadId road, LinkIndexSet **pLinkIndices ) {
 
-	if ( linkName[0] != ':' )
+	const Road *pRoad = GetRoad( road );
+	if ( !pRoad || pRoad->mNodeIndex < 0 )
 		return false;
 
-	(*pLinkIndices) = &mNodeSet[ mInternalLinkIndexMap[ linkName ] ].mConnectedLinks;
+	(*pLinkIndices) = &mNodeSet[ pRoad->mNodeIndex ].mConnectedLinks;
 
 	return true;
 
@@ -534,15 +791,29 @@ bool UraeData::LinkIsInternal( std::string linkName, LinkIndexSet **pLinkIndices
 
 
 /*
- * Method: bool LinkHasMapping( std::string linkName, int *pMapping );
+ * Method: bool LinkHasMapping( std::string_view linkName, int *pMapping );
  * Description: Returns true if the given link name is mapped to an index.
  */
-bool UraeData::LinkHasMapping( std::string linkName, int *pMapping ) {
+bool UraeData::LinkHasMapping( std::string_view linkName, int *pMapping ) {
 
-	bool hasMapping = mLinkIndexMap.find(linkName) != mLinkIndexMap.end();
-	if ( hasMapping && pMapping )
-		*pMapping = mLinkIndexMap[linkName];
-	return hasMapping;
+	return LinkHasMapping( GetRoadId( linkName ), pMapping );
+
+}
+
+
+/*
+ * Method: bool LinkHasMapping( RoadId road, int *pMapping );
+ * Description: Returns true if the given road is mapped to an index.
+ */
+bool UraeData::LinkHasMapping( RoadId road, int *pMapping ) const {
+
+	const Road *pRoad = GetRoad( road );
+	if ( !pRoad || pRoad->mLinkIndex < 0 )
+		return false;
+
+	if ( pMapping )
+		*pMapping = pRoad->mLinkIndex;
+	return true;
 
 }
 
@@ -565,315 +836,749 @@ UraeData::Grid* UraeData::GetGrid(Vector2D position) {
 	
 }
 
+
 /*
- * Method: void LoadNetwork( char* linksFile, char* nodesFile, const char* classFile, const char* buildingFile, const char* linkMapFile, const char* intLinkMapFile, const char* riceDataFile, const char* carDefFile );
- * Description: Loads the data from the links and nodes files.
+ * Method: unsigned int RasterCell( Real v, Real origin, Real cellSize, unsigned int count );
+ * Description: Column (or row) of the raster holding the given coordinate, clamped to the raster.
  */
-void UraeData::LoadNetwork( const char* linksFile, const char* nodesFile, const char* classFile, const char* buildingFile, const char* linkMapFile, const char* intLinkMapFile, const char* riceDataFile, const char* carDefFile ) {
-	ifstream stream;
-	char buffer[20];
+static inline unsigned int RasterCell( Real v, Real origin, Real cellSize, unsigned int count ) {
 
-	int numNodesInFile, numLinksInFile, numClassInFile, numBuildingsInFile, numLinkMappings, numRice, numCars;
-	Vector2D topLeft, bottomRight;
-	UraeData::Node tempNode;
-	UraeData::Link tempLink;
+	Real cell = floor( ( v - origin ) / cellSize );
+	return ( cell < 0 ) ? 0 : ( cell >= count ) ? count - 1 : (unsigned int)cell;
 
-	// read the nodes file
-	if ( nodesFile ) { 
+}
 
-		stream.open( nodesFile );
-		if ( stream.fail() ) {
-			THROW_EXCEPTION( "Cannot open nodes file: %s", nodesFile );
+
+/*
+ * Method: int MatchPosition( VectorMath::Vector2D position, int *pNode ) const;
+ * Description: Returns the summed link nearest the given position, if it is within the width of the link, or -1,
+ * 				and sets *pNode to the nearest junction whose area holds the position, or -1.
+ */
+int UraeData::MatchPosition( Vector2D position, int *pNode ) const {
+
+	const LinkRaster &raster = mLinkRaster;
+	if ( pNode )
+		*pNode = -1;
+	if ( raster.mColumnCount == 0 || raster.mRowCount == 0 )
+		return -1;
+
+	// Positions off the raster use its nearest cell; the candidates there are as near as any.
+	size_t cell = (size_t)RasterCell( position.y, raster.mOrigin.y, raster.mCellSize, raster.mRowCount ) * raster.mColumnCount
+				+ RasterCell( position.x, raster.mOrigin.x, raster.mCellSize, raster.mColumnCount );
+
+	int link = -1;
+	Real bestSq = DBL_MAX;
+	for ( uint32_t e = raster.mLinkRowOffsets[cell]; e < raster.mLinkRowOffsets[cell+1]; e++ ) {
+		const LinkSegment &segment = raster.mSegments[ raster.mLinks[e] ];
+		Real dSq = segment.DistanceSq( position );
+		if ( dSq < segment.mWidthSq && dSq < bestSq ) {
+			bestSq = dSq;
+			link = raster.mLinks[e];
 		}
+	}
 
-		stream >> dec >> numNodesInFile;
-
-		mNodeSet.reserve(numNodesInFile);
-
-		for(int n = 0; n < numNodesInFile; n++) {
-			stream >> tempNode.index >> tempNode.position.x >> tempNode.position.y;
-			if ( topLeft.x > tempNode.position.x )
-				topLeft.x = tempNode.position.x;
-			if ( bottomRight.x < tempNode.position.x )
-				bottomRight.x = tempNode.position.x;
-			if ( topLeft.y > tempNode.position.y )
-				topLeft.y = tempNode.position.y;
-			if ( bottomRight.y < tempNode.position.y )
-				bottomRight.y = tempNode.position.y;
-			mNodeSet.push_back(tempNode);
+	if ( pNode ) {
+		bestSq = DBL_MAX;
+		for ( uint32_t e = raster.mNodeRowOffsets[cell]; e < raster.mNodeRowOffsets[cell+1]; e++ ) {
+			const Node &node = mNodeSet[ raster.mNodes[e] ];
+			Real dx = position.x - node.position.x, dy = position.y - node.position.y;
+			Real dSq = dx * dx + dy * dy;
+			if ( dSq < node.mSize * node.mSize && dSq < bestSq ) {
+				bestSq = dSq;
+				*pNode = raster.mNodes[e];
+			}
 		}
-	
-		stream.close();
+	}
+
+	return link;
+
+}
+
+/*
+ * Method: off_t GetFileSize( const char *filename );
+ * Description: Size of the given file in bytes, or 0 if it cannot be read.
+ */
+static off_t GetFileSize( const char *filename ) {
+
+	struct stat fileStat;
+	if ( stat( filename, &fileStat ) != 0 )
+		return 0;
+	return fileStat.st_size;
+
+}
+
 
+/*
+ * Method: void LoadNetwork( char* linksFile, char* nodesFile, const char* classFile, const char* buildingFile, const char* linkMapFile, const char* intLinkMapFile, const char* riceDataFile, const char* carDefFile, unsigned int threads );
+ * Description: Loads the data from the links and nodes files.
+ */
+void UraeData::LoadNetwork( const char* linksFile, const char* nodesFile, const char* classFile, const char* buildingFile, const char* linkMapFile, const char* intLinkMapFile, const char* riceDataFile, const char* carDefFile, unsigned int threads ) {
+
+	// The tasks are listed in the order the files were always read in.
+	LoadTask tasks[] = {
+		{ &UraeData::LoadNodes,				nodesFile,		"nodes",				0, NULL },
+		{ &UraeData::LoadLinks,				linksFile,		"links",				0, NULL },
+		{ &UraeData::LoadClassifications,	classFile,		"classifications",		0, NULL },
+		{ &UraeData::LoadBuildings,			buildingFile,	"buildings",			0, NULL },
+		{ &UraeData::LoadLinkMap,			linkMapFile,	"link map",				0, NULL },
+		{ &UraeData::LoadInternalLinkMap,	intLinkMapFile,	"internal link map",	0, NULL },
+		{ &UraeData::LoadCarDefinitions,	carDefFile,		"car definitions",		0, NULL },
+		{ &UraeData::LoadRiceData,			riceDataFile,	"K-factors",			0, NULL }
+	};
+	unsigned int taskCount = sizeof(tasks) / sizeof(LoadTask);
+	unsigned int i;
+
+	// the map rectangle always includes the origin, and stays empty without a nodes file.
+	mMapRect = Rect();
+
+	mLoadQueue.clear();
+	std::vector<off_t> fileSizes;
+	for ( i = 0; i < taskCount; i++ ) {
+		if ( tasks[i].mFilename ) {
+			mLoadQueue.push_back( &tasks[i] );
+			fileSizes.push_back( threads > 1 ? GetFileSize( tasks[i].mFilename ) : 0 );
+		}
 	}
 
-	// read the links file
-	if ( linksFile ) {
+	double start = GetWallTime();
 
-		stream.open( linksFile );
-		if ( stream.fail() ) {
-			THROW_EXCEPTION( "Cannot open links file: %s", linksFile );
+	if ( threads <= 1 || mLoadQueue.size() <= 1 ) {
+
+		// Read the files one after another, stopping at the first failure.
+		for ( i = 0; i < mLoadQueue.size(); i++ ) {
+			RunLoadTask( mLoadQueue[i] );
+			if ( mLoadQueue[i]->m_pError ) {
+				Exception e = *mLoadQueue[i]->m_pError;
+				delete mLoadQueue[i]->m_pError;
+				mLoadQueue.clear();
+				throw e;
+			}
 		}
 
-		stream >> dec >> numLinksInFile;
-
-		mLinkSet.reserve(numLinksInFile);
-		for(int l = 0; l < numLinksInFile; l++)
-		{
-			stream >> tempLink.index
-				>> tempLink.nodeAindex
-				>> tempLink.nodeBindex
-				>> tempLink.NumberOfLanes
-				>> buffer // Boarder segment is not in use
-				>> tempLink.flow
-				>> tempLink.speed;
-			mLinkSet.push_back(tempLink);
+	} else {
+
+		// Start the largest files first, so the small ones fill in around them.
+		for ( i = 1; i < mLoadQueue.size(); i++ ) {
+			for ( unsigned int j = i; j > 0 && fileSizes[j-1] < fileSizes[j]; j-- ) {
+				std::swap( fileSizes[j-1], fileSizes[j] );
+				std::swap( mLoadQueue[j-1], mLoadQueue[j] );
+			}
 		}
 
-		stream.close();
+		if ( threads > mLoadQueue.size() )
+			threads = mLoadQueue.size();
 
-	}
+		mNextLoadTask = 0;
+		pthread_mutex_init( &mLoadQueueMutex, NULL );
+
+		pthread_t *pLoaderThreads = new pthread_t[threads];
+		unsigned int started;
+		for ( started = 0; started < threads; started++ ) {
+			if ( pthread_create( &pLoaderThreads[started], NULL, &UraeData::LoaderThread, this ) )
+				break;
+		}
+
+		// If no thread could be created, this thread does all the work.
+		if ( started == 0 )
+			LoaderThread( this );
 
-	// read the classification files
-	if ( classFile ) {
+		for ( i = 0; i < started; i++ )
+			pthread_join( pLoaderThreads[i], NULL );
 
-		stream.open( classFile );
-		if ( stream.fail() ) {
-			THROW_EXCEPTION( "Cannot open classification file: %s", classFile );
+		delete[] pLoaderThreads;
+		pthread_mutex_destroy( &mLoadQueueMutex );
+
+		// Report the first failure in file order.
+		Exception *pError = NULL;
+		for ( i = 0; i < taskCount; i++ ) {
+			if ( tasks[i].m_pError && !pError )
+				pError = tasks[i].m_pError;
+			else if ( tasks[i].m_pError )
+				delete tasks[i].m_pError;
 		}
 
-		stream >> dec >> numClassInFile;
-		int link1, link2;
+		if ( pError ) {
+			Exception e = *pError;
+			delete pError;
+			mLoadQueue.clear();
+			throw e;
+		}
 
-		Classification tempClass;
-		for(int c = 0; c < numClassInFile; c++ ) {
+	}
 
-			stream >> link1 >> link2 >> tempClass.mClassification >> tempClass.mFullNodeCount;
+	mLoadQueue.clear();
 
-			if ( tempClass.mClassification == Classifier::NLOS1 || tempClass.mClassification == Classifier::NLOS2 ) {
-				stream >> tempClass.mMainStreetLaneCount;
-				stream >> tempClass.mSideStreetLaneCount;
-				if ( tempClass.mClassification == Classifier::NLOS2 )
-					stream >> tempClass.mParaStreetLaneCount;
-			}
+	for ( i = 0; i < taskCount; i++ ) {
+		if ( tasks[i].mFilename )
+			AddLoadTiming( tasks[i].mStep, tasks[i].mSeconds );
+	}
+	AddLoadTiming( "total file loading", GetWallTime() - start );
 
-			if ( tempClass.mClassification != Classifier::LOS ) {
+	InternRoads();
 
-				for ( int n = 0; n < tempClass.mClassification; n++ ) {
+}
 
-					stream >> tempClass.mNodeSet[ n ];
 
-				}
+/*
+ * Method: static void *LoaderThread( void *pArg );
+ * Description: Worker thread which takes tasks from the load queue until it is empty.
+ */
+void *UraeData::LoaderThread( void *pArg ) {
 
-			}
+	UraeData *pData = (UraeData*)pArg;
 
-			tempClass.mLinkPair = VectorMath::OrderedIndexPair(link1,link2);
-			mClassificationMap[ tempClass.mLinkPair ] = tempClass;
+	while ( true ) {
 
+		pthread_mutex_lock( &pData->mLoadQueueMutex );
+		if ( pData->mNextLoadTask >= pData->mLoadQueue.size() ) {
+			pthread_mutex_unlock( &pData->mLoadQueueMutex );
+			break;
 		}
+		LoadTask *pTask = pData->mLoadQueue[ pData->mNextLoadTask++ ];
+		pthread_mutex_unlock( &pData->mLoadQueueMutex );
 
-		stream.close();
+		pData->RunLoadTask( pTask );
 
 	}
 
-	// read the building files
-	if ( buildingFile ) {
+	return NULL;
 
-		stream.open( buildingFile );
-		if ( stream.fail() ) {
-			THROW_EXCEPTION( "Cannot open building file: %s", buildingFile );
-		}
+}
 
-		stream >> dec >> numBuildingsInFile;
-		int vertexCount, tmp;
-		Vector2D v1, v2, v3;
 
-		Building tempBuilding;
-		for(int c = 0; c < numBuildingsInFile; c++ ) {
+/*
+ * Method: void RunLoadTask( LoadTask *pTask );
+ * Description: Parses one file, recording the time taken and any exception thrown.
+ */
+void UraeData::RunLoadTask( LoadTask *pTask ) {
 
-			tempBuilding.mId = c;
-			stream >> tmp >> tempBuilding.mPermitivity >> tempBuilding.mMaxHeight >> tempBuilding.mHeightStdDev >> vertexCount >> v1.x >> v1.y;
-			v3 = v1;
-			for ( int v = 0; v < vertexCount-1; v++ ) {
+	double start = GetWallTime();
 
-				if ( topLeft.x > tempNode.position.x )
-					topLeft.x = tempNode.position.x;
-				if ( bottomRight.x < tempNode.position.x )
-					bottomRight.x = tempNode.position.x;
-				if ( topLeft.y > tempNode.position.y )
-					topLeft.y = tempNode.position.y;
-				if ( bottomRight.y < tempNode.position.y )
-					bottomRight.y = tempNode.position.y;
+	try {
 
-				stream >> v2.x >> v2.y;
-				tempBuilding.mEdgeSet.push_back( LineSegment( v1, v2 ) );
-				v1 = v2;
+		(this->*pTask->m_pLoader)( pTask->mFilename );
 
-			}
+	} catch ( Exception &e ) {
 
-			tempBuilding.mEdgeSet.push_back( LineSegment( v1, v3 ) );
-			mBuildingSet.push_back( tempBuilding );
-			tempBuilding.mEdgeSet.clear();
+		pTask->m_pError = new Exception( e );
 
-		}
+	} catch ( std::exception &e ) {
 
-		stream.close();
+		pTask->m_pError = new Exception( "Failed to load %s file: %s", pTask->mStep, e.what() );
 
 	}
 
-	// read the link mappings
-	if ( linkMapFile ) {
+	pTask->mSeconds = GetWallTime() - start;
 
-		stream.open( linkMapFile );
-		if ( stream.fail() ) {
-			THROW_EXCEPTION( "Cannot open link mapping file: %s", linkMapFile );
-		}
+}
 
-		stream >> dec >> numLinkMappings;
-		for ( int c = 0; c < numLinkMappings; c++ ) {
 
-			std::string strTmp;
-			int index;
-			stream >> strTmp >> index;
-			mLinkIndexMap[ strTmp ] = index;
+/*
+ * Method: void AddLoadTiming( const char *step, double seconds );
+ * Description: Append a step to the load timings.
+ */
+void UraeData::AddLoadTiming( const char *step, double seconds ) {
+
+	LoadTiming timing;
+	timing.mStep = step;
+	timing.mSeconds = seconds;
+	mLoadTimings.push_back( timing );
+
+}
 
-		}
 
-		stream.close();
+/*
+ * Method: void PrintLoadTimings( std::ostream &stream );
+ * Description: Write the time taken by each file and step to the given stream.
+ */
+void UraeData::PrintLoadTimings( std::ostream &stream ) const {
+
+	for ( LoadTimingList::const_iterator it = mLoadTimings.begin(); it != mLoadTimings.end(); it++ )
+		stream << "  " << it->mStep << ": " << it->mSeconds << "s\n";
+
+}
 
+
+/*
+ * Method: void LoadNodes( const char *nodesFile );
+ * Description: Reads the nodes file, and sets the map rectangle from the node positions.
+ */
+void UraeData::LoadNodes( const char *nodesFile ) {
+
+	TextParser parser;
+	int numNodesInFile;
+	Vector2D topLeft, bottomRight;
+	UraeData::Node tempNode;
+
+	if ( !parser.Open( nodesFile ) ) {
+		THROW_EXCEPTION( "Cannot open nodes file: %s", nodesFile );
 	}
 
-	
-	// read the internal link mappings
-	if ( intLinkMapFile ) {
+	parser >> numNodesInFile;
+
+	mNodeSet.reserve(numNodesInFile);
+
+	for(int n = 0; n < numNodesInFile; n++) {
+		parser >> tempNode.index >> tempNode.position.x >> tempNode.position.y;
+		tempNode.mSize = 0;								// set by ComputeNodePairLinks
+		if ( topLeft.x > tempNode.position.x )
+			topLeft.x = tempNode.position.x;
+		if ( bottomRight.x < tempNode.position.x )
+			bottomRight.x = tempNode.position.x;
+		if ( topLeft.y > tempNode.position.y )
+			topLeft.y = tempNode.position.y;
+		if ( bottomRight.y < tempNode.position.y )
+			bottomRight.y = tempNode.position.y;
+		mNodeSet.push_back(tempNode);
+	}
+
+	parser.Close();
+
+	mMapRect.location = topLeft;
+	mMapRect.size = bottomRight - topLeft;
+
+}
+
+
+/*
+ * Method: void LoadLinks( const char *linksFile );
+ * Description: Reads the links file.
+ */
+void UraeData::LoadLinks( const char *linksFile ) {
+
+	TextParser parser;
+	int numLinksInFile;
+	UraeData::Link tempLink;
+
+	if ( !parser.Open( linksFile ) ) {
+		THROW_EXCEPTION( "Cannot open links file: %s", linksFile );
+	}
+
+	parser >> numLinksInFile;
+
+	mLinkSet.reserve(numLinksInFile);
+	for(int l = 0; l < numLinksInFile; l++)
+	{
+		parser >> tempLink.index
+			>> tempLink.nodeAindex
+			>> tempLink.nodeBindex
+			>> tempLink.NumberOfLanes;
+		parser.ReadToken(); // Boarder segment is not in use
+		parser >> tempLink.flow
+			>> tempLink.speed;
+		mLinkSet.push_back(tempLink);
+	}
+
+	parser.Close();
+
+}
+
 
-		stream.open( intLinkMapFile );
-		if ( stream.fail() ) {
-			THROW_EXCEPTION( "Cannot open internal link mapping file: %s", intLinkMapFile );
+/*
+ * Method: bool CompareClassificationEntries( const std::pair<OrderedIndexPair,ClassificationRecord> &a, const std::pair<OrderedIndexPair,ClassificationRecord> &b );
+ * Description: Orders the classifications read from the file by link pair.
+ */
+static bool CompareClassificationEntries( const std::pair<OrderedIndexPair,UraeData::ClassificationRecord> &a, const std::pair<OrderedIndexPair,UraeData::ClassificationRecord> &b ) {
+
+	return a.first < b.first;
+
+}
+
+
+/*
+ * Method: void LoadClassifications( const char *classFile );
+ * Description: Reads the CORNER classification file.
+ */
+void UraeData::LoadClassifications( const char *classFile ) {
+
+	TextParser parser;
+	int numClassInFile;
+
+	if ( !parser.Open( classFile ) ) {
+		THROW_EXCEPTION( "Cannot open classification file: %s", classFile );
+	}
+
+	parser >> numClassInFile;
+	int link1, link2, classification;
+
+	// Read the classifications in file order, then sort them into rows.
+	typedef std::pair<OrderedIndexPair,ClassificationRecord> ClassificationEntry;
+	std::vector<ClassificationEntry> entries;
+	entries.reserve( numClassInFile > 0 ? numClassInFile : 0 );
+
+	ClassificationEntry entry;
+	ClassificationRecord &tempClass = entry.second;
+	for(int c = 0; c < numClassInFile; c++ ) {
+
+		memset( &tempClass, 0, sizeof(ClassificationRecord) );
+		parser >> link1 >> link2 >> classification >> tempClass.mFullNodeCount;
+		tempClass.mClassification = classification;
+
+		if ( classification == Classifier::NLOS1 || classification == Classifier::NLOS2 ) {
+			tempClass.mMainStreetLaneCount = parser.ReadDouble();
+			tempClass.mSideStreetLaneCount = parser.ReadDouble();
+			if ( classification == Classifier::NLOS2 )
+				tempClass.mParaStreetLaneCount = parser.ReadDouble();
 		}
 
-		stream >> dec >> numLinkMappings;
-		for ( int c = 0; c < numLinkMappings; c++ ) {
+		if ( classification != Classifier::LOS ) {
 
-			std::string strTmp;
-			int index;
-			stream >> strTmp >> index;
-			mInternalLinkIndexMap[ strTmp ] = index;
+			for ( int n = 0; n < classification && n < 2; n++ ) {
+
+				parser >> tempClass.mNodeSet[ n ];
+
+			}
 
 		}
 
-		stream.close();
+		entry.first = VectorMath::OrderedIndexPair(link1,link2);
+		entries.push_back( entry );
+
+	}
+
+	parser.Close();
+
+	// As with the map this replaces, a link pair listed twice keeps its last classification.
+	std::stable_sort( entries.begin(), entries.end(), CompareClassificationEntries );
+
+	ClassificationTable &table = mClassificationTable;
+	table = ClassificationTable();
+	table.mRowOffsets.push_back( 0 );
+	for ( size_t e = 0; e < entries.size(); e++ ) {
+
+		if ( e + 1 < entries.size() && entries[e].first == entries[e+1].first )
+			continue;
+
+		while ( table.mRowOffsets.size() <= (size_t)entries[e].first.first )
+			table.mRowOffsets.push_back( table.mOtherLinks.size() );
+		table.mOtherLinks.push_back( entries[e].first.second );
+		table.mRecords.push_back( entries[e].second );
 
 	}
+	table.mRowOffsets.push_back( table.mOtherLinks.size() );
+
+	m_pClassRowOffsets = &table.mRowOffsets[0];
+	m_pClassOtherLinks = table.mOtherLinks.empty() ? NULL : &table.mOtherLinks[0];
+	m_pClassRecords = table.mRecords.empty() ? NULL : &table.mRecords[0];
+	mClassRowCount = table.mRowOffsets.size() - 1;
+
+}
+
+
+/*
+ * Method: size_t PruneClassifications( VectorMath::Real range );
+ * Description: Drops the classifications between summed links whose closest points are further apart than range.
+ */
+size_t UraeData::PruneClassifications( Real range ) {
+
+	double start = GetWallTime();
+	size_t dropped = 0;
+
+	std::vector<LineSegment> segments( mSummedLinkSet.size() );
+	for ( size_t l = 0; l < mSummedLinkSet.size(); l++ )
+		segments[l] = LineSegment( mNodeSet[ mSummedLinkSet[l].nodeAindex ].position, mNodeSet[ mSummedLinkSet[l].nodeBindex ].position );
+
+	// Links we have no geometry for are kept.
+	ClassificationTable pruned;
+	pruned.mRowOffsets.reserve( mClassRowCount + 1 );
+	pruned.mRowOffsets.push_back( 0 );
+	for ( size_t l = 0; l < mClassRowCount; l++ ) {
 
-	// read the car definitions
-	if ( carDefFile ) {
+		for ( uint64_t c = m_pClassRowOffsets[l]; c < m_pClassRowOffsets[l+1]; c++ ) {
+
+			size_t other = m_pClassOtherLinks[c];
+			if ( l < segments.size() && other < segments.size() && segments[l].DistanceFromSegment( segments[other] ) > range ) {
+				dropped++;
+				continue;
+			}
+
+			pruned.mOtherLinks.push_back( other );
+			pruned.mRecords.push_back( m_pClassRecords[c] );
 
-		stream.open( carDefFile );
-		if ( stream.fail() ) {
-			THROW_EXCEPTION( "Cannot open car definitions file: %s", carDefFile );
 		}
 
-		stream >> dec >> numCars;
-		for ( int c = 0; c < numCars; c++ ) {
-
-			std::string strName, strCol;
-			Real w;
-			stream >> strName;
-			stream >> mCarDefinitions[strName].mAcceleration
-				   >> mCarDefinitions[strName].mDeceleration
-				   >> mCarDefinitions[strName].mDriverImperfection
-				   >> mCarDefinitions[strName].mLength
-				   >> strCol
-				   >> mCarDefinitions[strName].mWidth
-				   >> mCarDefinitions[strName].mHeight
-				   >> w;
+		pruned.mRowOffsets.push_back( pruned.mOtherLinks.size() );
+
+	}
+
+	// The table may have been mapped from a bundle, so the pruned copy is always held in memory.
+	// Copying it leaves no spare capacity.
+	mClassificationTable = pruned;
+
+	m_pClassRowOffsets = &mClassificationTable.mRowOffsets[0];
+	m_pClassOtherLinks = mClassificationTable.mOtherLinks.empty() ? NULL : &mClassificationTable.mOtherLinks[0];
+	m_pClassRecords = mClassificationTable.mRecords.empty() ? NULL : &mClassificationTable.mRecords[0];
+	mClassRowCount = mClassificationTable.mRowOffsets.size() - 1;
+
+	AddLoadTiming( "classification pruning", GetWallTime() - start );
+	ComputePathlossCoefficients();
+	return dropped;
+
+}
+
+
+/*
+ * Method: void EnableGraphClassification( VectorMath::Real range );
+ * Description: Link pairs with no classification are classified from the road graph the first time they are
+ * 				asked for, instead of being out of range. A range of 0 uses the free space range.
+ */
+void UraeData::EnableGraphClassification( Real range ) {
+
+	delete m_pGraphClassifier;
+	m_pGraphClassifier = new GraphClassifier( this, range > 0 ? range : mFreeSpaceRange );
+
+}
+
+
+/*
+ * Method: void ComputeClassifications( VectorMath::Real range, unsigned int threads );
+ * Description: Replaces the classifications with those of every pair of links in range, computed from the road
+ * 				graph by the given number of threads. A range of 0 uses the free space range.
+ */
+void UraeData::ComputeClassifications( Real range, unsigned int threads ) {
+
+	double start = GetWallTime();
+
+	GraphClassifier classifier( this, range > 0 ? range : mFreeSpaceRange );
+	classifier.ClassifyAll( threads, &mClassificationTable.mRowOffsets, &mClassificationTable.mOtherLinks, &mClassificationTable.mRecords );
+
+	m_pClassRowOffsets = &mClassificationTable.mRowOffsets[0];
+	m_pClassOtherLinks = mClassificationTable.mOtherLinks.empty() ? NULL : &mClassificationTable.mOtherLinks[0];
+	m_pClassRecords = mClassificationTable.mRecords.empty() ? NULL : &mClassificationTable.mRecords[0];
+	mClassRowCount = mClassificationTable.mRowOffsets.size() - 1;
+
+	AddLoadTiming( "classification generation", GetWallTime() - start );
+	ComputePathlossCoefficients();
+
+}
+
+
+/*
+ * Method: void DisableGraphClassification();
+ * Description: Link pairs with no classification are out of range again, and the computed ones are forgotten.
+ */
+void UraeData::DisableGraphClassification() {
+
+	delete m_pGraphClassifier;
+	m_pGraphClassifier = NULL;
+
+}
+
+
+/*
+ * Method: void WriteClassifications( const char *classFile );
+ * Description: Writes the classifications held to a CORNER class file.
+ */
+void UraeData::WriteClassifications( const char *classFile ) {
+
+	std::ofstream out( classFile );
+	if ( !out.is_open() )
+		THROW_EXCEPTION( "Cannot open classification file for writing: %s", classFile );
+
+	out.precision( 9 );
+	out << GetClassificationCount() << "\n";
+	for ( size_t l = 0; l < mClassRowCount; l++ ) {
+
+		for ( uint64_t c = m_pClassRowOffsets[l]; c < m_pClassRowOffsets[l+1]; c++ ) {
+
+			const ClassificationRecord &record = m_pClassRecords[c];
+			int classification = record.mClassification;
+			out << l << " " << m_pClassOtherLinks[c] << " " << classification << " " << record.mFullNodeCount;
+
+			// The same fields LoadClassifications reads for each classification.
+			if ( classification == Classifier::NLOS1 || classification == Classifier::NLOS2 ) {
+				out << " " << record.mMainStreetLaneCount << " " << record.mSideStreetLaneCount;
+				if ( classification == Classifier::NLOS2 )
+					out << " " << record.mParaStreetLaneCount;
+			}
+			if ( classification != Classifier::LOS )
+				for ( int n = 0; n < classification && n < 2; n++ )
+					out << " " << record.mNodeSet[n];
+			out << "\n";
 
 		}
 
-		stream.close();
+	}
+
+	if ( !out.good() )
+		THROW_EXCEPTION( "Error writing classification file: %s", classFile );
+
+}
+
+
+/*
+ * Method: void LoadBuildings( const char *buildingFile );
+ * Description: Reads the building file.
+ */
+void UraeData::LoadBuildings( const char *buildingFile ) {
+
+	TextParser parser;
+	int numBuildingsInFile;
 
+	if ( !parser.Open( buildingFile ) ) {
+		THROW_EXCEPTION( "Cannot open building file: %s", buildingFile );
 	}
 
+	parser >> numBuildingsInFile;
+	int vertexCount, tmp;
+	Vector2D v1, v2, v3;
+
+	Building tempBuilding;
+	for(int c = 0; c < numBuildingsInFile; c++ ) {
+
+		tempBuilding.mId = c;
+		parser >> tmp >> tempBuilding.mPermitivity >> tempBuilding.mMaxHeight >> tempBuilding.mHeightStdDev >> vertexCount >> v1.x >> v1.y;
+		v3 = v1;
+		for ( int v = 0; v < vertexCount-1; v++ ) {
 
-	// read the pre-computed K-factors
-	if ( riceDataFile ) {
+			parser >> v2.x >> v2.y;
+			tempBuilding.mEdgeSet.push_back( LineSegment( v1, v2 ) );
+			v1 = v2;
 
-		stream.open( riceDataFile );
-		if ( stream.fail() ) {
-			THROW_EXCEPTION( "Cannot open Rice datafile: %s", riceDataFile );
 		}
 
-		stream >> dec >> mLengthIncrement;
-		stream >> dec >> numRice;
-
-		for ( int r = 0; r < numRice; r++ ) {
-
-			// Read the index of the source link and number of locations.
-			SourceLocationList srcLocList;
-			int srcId, srcLocCount;
-			stream >> srcId >> srcLocCount;
-			for ( int srcLoc = 0; srcLoc < srcLocCount; srcLoc++ ) {
-
-				// Read the number of source lanes.
-				SourceLaneList srcLaneList;
-				int srcLaneCount;
-				stream >> srcLaneCount;
-				for ( int srcLane = 0; srcLane < srcLaneCount; srcLane++ ) {
-
-					// Read the number of destination links.
-					DestinationLookup destLookup;
-					int destLinkCount;
-					stream >> destLinkCount;
-					for ( int destLink = 0; destLink < destLinkCount; destLink++ ) {
-
-						// Read the index of the destination link and the number of locations therein.
-						DestinationLocationList destLocList;
-						int destId, destLocCount;
-						stream >> destId >> destLocCount;
-						for ( int destLoc = 0; destLoc < destLocCount; destLoc++ ) {
-
-							// Read the number of destination lanes.
-							DestinationLaneList newDestLane;
-							int destLaneCount;
-							stream >> destLaneCount;
-							for ( int destLane = 0; destLane < destLaneCount; destLane++ ) {
-
-								// Read the K-Factor
-								std::string kStr;
-								stream >> kStr;
-								if ( "inf" == kStr )
-									newDestLane.push_back( DBL_MAX );
-								else
-									newDestLane.push_back( atof( kStr.c_str() ) );
-
-							}
-
-							destLocList.push_back( newDestLane );
+		tempBuilding.mEdgeSet.push_back( LineSegment( v1, v3 ) );
+		mBuildingSet.push_back( tempBuilding );
+		tempBuilding.mEdgeSet.clear();
 
-						}
+	}
 
-						destLookup[destId] = destLocList;
+	parser.Close();
 
-					}
+}
 
-					srcLaneList.push_back( destLookup );
 
-				}
+/*
+ * Method: void ReadLinkMapping( const char *filename, const char *description, std::map<std::string,int> &linkMap );
+ * Description: Reads a file of link names and the indices they map to.
+ */
+static void ReadLinkMapping( const char *filename, const char *description, std::map<std::string,int> &linkMap ) {
 
-				srcLocList.push_back( srcLaneList );
+	TextParser parser;
+	int numLinkMappings;
 
-			}
+	if ( !parser.Open( filename ) ) {
+		THROW_EXCEPTION( "Cannot open %s file: %s", description, filename );
+	}
+
+	parser >> numLinkMappings;
+	for ( int c = 0; c < numLinkMappings; c++ ) {
+
+		std::string strTmp;
+		int index;
+		parser >> strTmp >> index;
+		linkMap[ strTmp ] = index;
 
-			mRiceFactorData.push_back( srcLocList );
+	}
+
+	parser.Close();
+
+}
+
+
+/*
+ * Method: void LoadLinkMap( const char *linkMapFile );
+ * Description: Reads the mapping between link names and summed link indices.
+ */
+void UraeData::LoadLinkMap( const char *linkMapFile ) {
+
+	ReadLinkMapping( linkMapFile, "link mapping", mLinkIndexMap );
+
+}
+
+
+/*
+ * Method: void LoadInternalLinkMap( const char *intLinkMapFile );
+ * Description: Reads the mapping between internal link names and node indices.
+ */
+void UraeData::LoadInternalLinkMap( const char *intLinkMapFile ) {
 
+	ReadLinkMapping( intLinkMapFile, "internal link mapping", mInternalLinkIndexMap );
+
+}
+
+
+/*
+ * Method: void InternRoads();
+ * Description: Gives every name in the link and internal link mappings a road ID. An edge is internal if its name
+ * 				starts with ':', as SUMO names them, and it maps to a node.
+ */
+void UraeData::InternRoads() {
+
+	mRoads.clear();
+	mRoadIdMap.clear();
+	mRoadIdMap.reserve( mLinkIndexMap.size() + mInternalLinkIndexMap.size() );
+
+	for ( LinkIndexMap::iterator it = mLinkIndexMap.begin(); it != mLinkIndexMap.end(); it++ ) {
+		Road road = { it->first, it->second, -1 };
+		mRoadIdMap[ road.mName ] = mRoads.size();
+		mRoads.push_back( road );
+	}
+
+	for ( InternalLinkIndexMap::iterator it = mInternalLinkIndexMap.begin(); it != mInternalLinkIndexMap.end(); it++ ) {
+
+		if ( it->first.empty() || it->first[0] != ':' || it->second < 0 || it->second >= (int)mNodeSet.size() )
+			continue;
+
+		std::unordered_map<std::string_view,RoadId>::iterator idIt = mRoadIdMap.find( it->first );
+		if ( idIt != mRoadIdMap.end() ) {
+			mRoads[ idIt->second ].mNodeIndex = it->second;
+		} else {
+			Road road = { it->first, -1, it->second };
+			mRoadIdMap[ road.mName ] = mRoads.size();
+			mRoads.push_back( road );
 		}
 
-    }
+	}
 
-   
-	mMapRect.location = topLeft;
-	mMapRect.size = bottomRight - topLeft;
+}
+
+
+/*
+ * Method: void LoadCarDefinitions( const char *carDefFile );
+ * Description: Reads the car definitions.
+ */
+void UraeData::LoadCarDefinitions( const char *carDefFile ) {
+
+	TextParser parser;
+	int numCars;
+
+	if ( !parser.Open( carDefFile ) ) {
+		THROW_EXCEPTION( "Cannot open car definitions file: %s", carDefFile );
+	}
+
+	parser >> numCars;
+	for ( int c = 0; c < numCars; c++ ) {
+
+		std::string strName;
+		Real w;
+		parser >> strName;
+		CarDefinition &def = mCarDefinitions[strName];
+		parser >> def.mAcceleration
+			   >> def.mDeceleration
+			   >> def.mDriverImperfection
+			   >> def.mLength;
+		parser.ReadToken(); // colour is not in use
+		parser >> def.mWidth
+			   >> def.mHeight
+			   >> w;
+
+	}
+
+	parser.Close();
+
+}
+
+
+/*
+ * Method: void LoadRiceData( const char *riceDataFile );
+ * Description: Loads the pre-computed K-factors.
+ */
+void UraeData::LoadRiceData( const char *riceDataFile ) {
+
+	// This maps a binary file, or parses the text output of the Raytracer.
+	mRiceTable.Load( riceDataFile, mRiceFormat, mRiceCacheBytes );
+	mLengthIncrement = mRiceTable.GetIncrement();
 
 }
 
@@ -890,6 +1595,7 @@ void UraeData::ComputeSummedLinkSet() {
 
 	// Note: Not sure if this is necessary now, since the Corner python class performs the link reduction.
 	
+	double start = GetWallTime();
 	LinkSet::iterator linkIt;
 	std::map< std::pair<int,int>, int > nodePairMapLinkIndex;
 	std::pair<int,int> n1, n2;
@@ -920,10 +1626,242 @@ void UraeData::ComputeSummedLinkSet() {
 	}
 
 	nodePairMapLinkIndex.clear();
+	ComputeNodePairLinks();
+
+	AddLoadTiming( "summed link set", GetWallTime() - start );
 
 }
 
 
+/*
+ * Method: void ComputeNodePairLinks();
+ * Description: Builds the table of summed links by the pair of nodes they join, and the squared half width
+ * 				of each summed link.
+ */
+void UraeData::ComputeNodePairLinks() {
+
+	size_t l, n;
+
+	mLinkHalfWidthSq.resize( mSummedLinkSet.size() );
+	for ( l = 0; l < mSummedLinkSet.size(); l++ )
+		mLinkHalfWidthSq[l] = pow( mSummedLinkSet[l].NumberOfLanes*mLaneWidth*0.5, 2 );
+
+	// A junction reaches as far as half the width of its widest link.
+	for ( n = 0; n < mNodeSet.size(); n++ ) {
+		mNodeSet[n].mSize = 0;
+		const LinkIndexSet &links = mNodeSet[n].mConnectedLinks;
+		for ( l = 0; l < links.size(); l++ )
+			mNodeSet[n].mSize = std::max<Real>( mNodeSet[n].mSize, mSummedLinkSet[ links[l] ].NumberOfLanes*mLaneWidth*0.5 );
+	}
+
+	// Each summed link is the only one between its nodes, so a row is the other end of each connected link.
+	NodePairLinkTable &table = mNodePairLinks;
+	table = NodePairLinkTable();
+	table.mRowOffsets.push_back( 0 );
+
+	std::vector< std::pair<int32_t,int32_t> > row;
+	for ( n = 0; n < mNodeSet.size(); n++ ) {
+
+		row.clear();
+		const LinkIndexSet &links = mNodeSet[n].mConnectedLinks;
+		for ( l = 0; l < links.size(); l++ ) {
+			const Link &link = mSummedLinkSet[ links[l] ];
+			if ( link.nodeAindex != link.nodeBindex )
+				row.push_back( std::pair<int32_t,int32_t>( link.nodeAindex == (int)n ? link.nodeBindex : link.nodeAindex, links[l] ) );
+		}
+
+		std::sort( row.begin(), row.end() );
+		for ( l = 0; l < row.size(); l++ ) {
+			table.mNodes.push_back( row[l].first );
+			table.mLinks.push_back( row[l].second );
+		}
+		table.mRowOffsets.push_back( table.mNodes.size() );
+
+	}
+
+}
+
+
+/*
+ * Method: int GetCommonLink( int n1, int n2 ) const;
+ * Description: Returns the summed link joining the two given nodes, or -1 if there is none.
+ */
+int UraeData::GetCommonLink( int n1, int n2 ) const {
+
+	if ( n1 < 0 || n1 + 1 >= (int)mNodePairLinks.mRowOffsets.size() )
+		return -1;
+
+	const int32_t *pRowBegin = mNodePairLinks.mNodes.data() + mNodePairLinks.mRowOffsets[n1];
+	const int32_t *pRowEnd   = mNodePairLinks.mNodes.data() + mNodePairLinks.mRowOffsets[n1+1];
+	const int32_t *pNode = std::lower_bound( pRowBegin, pRowEnd, n2 );
+	if ( pNode == pRowEnd || *pNode != n2 )
+		return -1;
+
+	return mNodePairLinks.mLinks[ pNode - mNodePairLinks.mNodes.data() ];
+
+}
+
+
+
+/*
+ * Method: void ComputeJunctionClassifications();
+ * Description: Finds, for every junction with internal links, the connected link which gives the best
+ * 				classification to each other link, and the pair of connected links which gives the best
+ * 				classification to each other junction.
+ */
+void UraeData::ComputeJunctionClassifications() {
+
+	double start = GetWallTime();
+	JunctionTable &table = mJunctionTable;
+	table = JunctionTable();
+
+	size_t nodeCount = mNodeSet.size();
+	size_t linkCount = std::max( mSummedLinkSet.size(), mClassRowCount );
+	uint64_t classCount = mClassRowCount > 0 ? m_pClassRowOffsets[ mClassRowCount ] : 0;
+	uint64_t c;
+	size_t i, l;
+
+	for ( c = 0; c < classCount; c++ )
+		linkCount = std::max( linkCount, (size_t)m_pClassOtherLinks[c] + 1 );
+
+	// The table holds each pair once, under the lower link. Index every in range pair under both links.
+	std::vector<uint64_t> partnerOffsets( linkCount + 1, 0 );
+	for ( l = 0; l < mClassRowCount; l++ ) {
+		for ( c = m_pClassRowOffsets[l]; c < m_pClassRowOffsets[l+1]; c++ ) {
+			if ( m_pClassRecords[c].mClassification >= Classifier::OutOfRange )
+				continue;
+			partnerOffsets[ l + 1 ]++;
+			if ( (size_t)m_pClassOtherLinks[c] != l )
+				partnerOffsets[ m_pClassOtherLinks[c] + 1 ]++;
+		}
+	}
+	for ( l = 0; l < linkCount; l++ )
+		partnerOffsets[ l + 1 ] += partnerOffsets[l];
+
+	std::vector<int32_t> partners( partnerOffsets[ linkCount ] );
+	std::vector<uint8_t> partnerClasses( partnerOffsets[ linkCount ] );
+	std::vector<uint64_t> partnerFill( partnerOffsets.begin(), partnerOffsets.end() - 1 );
+	for ( l = 0; l < mClassRowCount; l++ ) {
+		for ( c = m_pClassRowOffsets[l]; c < m_pClassRowOffsets[l+1]; c++ ) {
+			uint8_t classification = m_pClassRecords[c].mClassification;
+			if ( classification >= Classifier::OutOfRange )
+				continue;
+			int32_t other = m_pClassOtherLinks[c];
+			partners[ partnerFill[l] ] = other;
+			partnerClasses[ partnerFill[l]++ ] = classification;
+			if ( (size_t)other != l ) {
+				partners[ partnerFill[other] ] = l;
+				partnerClasses[ partnerFill[other]++ ] = classification;
+			}
+		}
+	}
+
+	// Only the parents of internal links are looked up.
+	std::vector<bool> isJunction( nodeCount, false );
+	for ( i = 0; i < mRoads.size(); i++ )
+		if ( mRoads[i].mNodeIndex >= 0 )
+			isJunction[ mRoads[i].mNodeIndex ] = true;
+
+	// Scratch space: the best classification found so far, per other link and per other junction.
+	struct Best {
+		int mClassification;
+		int mPosition[2];		// of the winning links within the connected links
+		int mLinks[2];
+	};
+	Best none = { Classifier::OutOfRange, { -1, -1 }, { -1, -1 } };
+	std::vector<Best> bestToLink( linkCount, none ), bestToNode( nodeCount, none );
+	std::vector<int> touchedLinks, touchedNodes;
+
+	table.mLinkRowOffsets.push_back( 0 );
+	table.mNodeRowOffsets.push_back( 0 );
+	for ( size_t n = 0; n < nodeCount; n++ ) {
+
+		if ( isJunction[n] ) {
+
+			const LinkIndexSet &links = mNodeSet[n].mConnectedLinks;
+			for ( int a = 0; a < (int)links.size(); a++ ) {
+
+				int link = links[a];
+				if ( link < 0 || (size_t)link >= linkCount )
+					continue;
+
+				for ( c = partnerOffsets[link]; c < partnerOffsets[link+1]; c++ ) {
+
+					int other = partners[c];
+					int classification = partnerClasses[c];
+
+					// Later links win ties, so a lower or equal classification always replaces the best so far.
+					Best &toLink = bestToLink[other];
+					if ( toLink.mPosition[0] < 0 )
+						touchedLinks.push_back( other );
+					if ( classification <= toLink.mClassification ) {
+						toLink.mClassification = classification;
+						toLink.mPosition[0] = a;
+						toLink.mLinks[0] = link;
+					}
+
+					// The other link joins one or two junctions; find its last place among their connected links.
+					if ( (size_t)other >= mSummedLinkSet.size() )
+						continue;
+					int ends[2] = { mSummedLinkSet[other].nodeAindex, mSummedLinkSet[other].nodeBindex };
+					for ( int e = 0; e < 2; e++ ) {
+
+						if ( ( e == 1 && ends[1] == ends[0] ) || !isJunction[ ends[e] ] )
+							continue;
+
+						const LinkIndexSet &otherLinks = mNodeSet[ ends[e] ].mConnectedLinks;
+						int b = otherLinks.size() - 1;
+						while ( b >= 0 && otherLinks[b] != other )
+							b--;
+						if ( b < 0 )
+							continue;
+
+						Best &toNode = bestToNode[ ends[e] ];
+						if ( toNode.mPosition[0] < 0 )
+							touchedNodes.push_back( ends[e] );
+						if ( classification < toNode.mClassification || ( classification == toNode.mClassification && ( a > toNode.mPosition[0] || b >= toNode.mPosition[1] ) ) ) {
+							toNode.mClassification = classification;
+							toNode.mPosition[0] = a;
+							toNode.mPosition[1] = b;
+							toNode.mLinks[0] = link;
+							toNode.mLinks[1] = other;
+						}
+
+					}
+
+				}
+
+			}
+
+			std::sort( touchedLinks.begin(), touchedLinks.end() );
+			for ( i = 0; i < touchedLinks.size(); i++ ) {
+				table.mLinks.push_back( touchedLinks[i] );
+				table.mLinkWinners.push_back( bestToLink[ touchedLinks[i] ].mLinks[0] );
+				bestToLink[ touchedLinks[i] ] = none;
+			}
+
+			std::sort( touchedNodes.begin(), touchedNodes.end() );
+			for ( i = 0; i < touchedNodes.size(); i++ ) {
+				Best &toNode = bestToNode[ touchedNodes[i] ];
+				table.mNodes.push_back( touchedNodes[i] );
+				table.mNodeWinners.push_back( LinkPair( toNode.mLinks[0], toNode.mLinks[1] ) );
+				toNode = none;
+			}
+
+			touchedLinks.clear();
+			touchedNodes.clear();
+
+		}
+
+		table.mLinkRowOffsets.push_back( table.mLinks.size() );
+		table.mNodeRowOffsets.push_back( table.mNodes.size() );
+
+	}
+
+	AddLoadTiming( "junction classifications", GetWallTime() - start );
+
+}
+
 
 /*
  * Method: void ComputeBuckets();
@@ -932,6 +1870,7 @@ void UraeData::ComputeSummedLinkSet() {
 void UraeData::ComputeBuckets() {
 
 	unsigned int i, j;
+	double start = GetWallTime();
 
 	if ( mMapRect.size.x > mBucketSize * SINCOS45 )
 		mBucketX = ceil( mMapRect.size.x / mBucketSize - SINCOS45 );
@@ -1001,6 +1940,125 @@ void UraeData::ComputeBuckets() {
 			}
 		}
 	}
+
+	AddLoadTiming( "buckets and grid", GetWallTime() - start );
+	ComputeLinkRaster();
+
+}
+
+
+/*
+ * Method: void FillRasterRows( const std::vector< std::pair<uint32_t,int32_t> > &entries, size_t cellCount, ... );
+ * Description: Sorts the (cell, index) entries into compressed rows, one per cell, keeping their order within each cell.
+ */
+static void FillRasterRows( const std::vector< std::pair<uint32_t,int32_t> > &entries, size_t cellCount, std::vector<uint32_t> *pRowOffsets, std::vector<int32_t> *pItems ) {
+
+	pRowOffsets->assign( cellCount + 1, 0 );
+	for ( size_t e = 0; e < entries.size(); e++ )
+		(*pRowOffsets)[ entries[e].first + 1 ]++;
+	for ( size_t c = 0; c < cellCount; c++ )
+		(*pRowOffsets)[c+1] += (*pRowOffsets)[c];
+
+	std::vector<uint32_t> fill( pRowOffsets->begin(), pRowOffsets->end() - 1 );
+	pItems->resize( entries.size() );
+	for ( size_t e = 0; e < entries.size(); e++ )
+		(*pItems)[ fill[ entries[e].first ]++ ] = entries[e].second;
+
+}
+
+
+/*
+ * Method: void ComputeLinkRaster();
+ * Description: Builds the raster MatchPosition uses.
+ */
+void UraeData::ComputeLinkRaster() {
+
+	double start = GetWallTime();
+	LinkRaster &raster = mLinkRaster;
+	raster = LinkRaster();
+	raster.mColumnCount = raster.mRowCount = 0;
+	if ( mNodeSet.empty() )
+		return;
+
+	// No link or junction reaches further than the margin beyond the nodes.
+	Real margin = 0;
+	raster.mSegments.resize( mSummedLinkSet.size() );
+	for ( size_t l = 0; l < mSummedLinkSet.size(); l++ ) {
+
+		const Link &link = mSummedLinkSet[l];
+		LinkSegment &segment = raster.mSegments[l];
+		Vector2D end = mNodeSet[ link.nodeBindex ].position;
+		segment.mStart = mNodeSet[ link.nodeAindex ].position;
+		segment.mLength = ( end - segment.mStart ).Magnitude();
+		segment.mDirection = ( segment.mLength > 0 ) ? ( end - segment.mStart ) / segment.mLength : Vector2D( 0, 0 );
+		Real width = link.NumberOfLanes * mLaneWidth;
+		segment.mWidthSq = width * width;
+		margin = std::max( margin, width );
+
+	}
+
+	Vector2D low( DBL_MAX, DBL_MAX ), high( -DBL_MAX, -DBL_MAX );
+	for ( size_t n = 0; n < mNodeSet.size(); n++ ) {
+		const Vector2D &p = mNodeSet[n].position;
+		low = Vector2D( std::min( low.x, p.x ), std::min( low.y, p.y ) );
+		high = Vector2D( std::max( high.x, p.x ), std::max( high.y, p.y ) );
+		margin = std::max( margin, mNodeSet[n].mSize );
+	}
+
+	raster.mOrigin = low - Vector2D( margin, margin );
+	Vector2D size = high - low + Vector2D( margin, margin ) * 2;
+	raster.mCellSize = LINK_RASTER_CELL_SIZE;
+	while ( ( size.x / raster.mCellSize + 1 ) * ( size.y / raster.mCellSize + 1 ) > LINK_RASTER_MAX_CELLS )
+		raster.mCellSize *= 2;
+	raster.mColumnCount = (unsigned int)( size.x / raster.mCellSize ) + 1;
+	raster.mRowCount = (unsigned int)( size.y / raster.mCellSize ) + 1;
+	size_t cellCount = (size_t)raster.mColumnCount * raster.mRowCount;
+
+	// A cell takes everything within reach of its centre, plus half its diagonal.
+	Real halfDiagonal = raster.mCellSize * SINCOS45;
+	std::vector< std::pair<uint32_t,int32_t> > entries;
+	for ( size_t l = 0; l < raster.mSegments.size(); l++ ) {
+
+		const LinkSegment &segment = raster.mSegments[l];
+		Vector2D end = segment.mStart + segment.mDirection * segment.mLength;
+		Real reach = sqrt( segment.mWidthSq ) + halfDiagonal;
+		unsigned int x0 = RasterCell( std::min( segment.mStart.x, end.x ) - reach, raster.mOrigin.x, raster.mCellSize, raster.mColumnCount );
+		unsigned int x1 = RasterCell( std::max( segment.mStart.x, end.x ) + reach, raster.mOrigin.x, raster.mCellSize, raster.mColumnCount );
+		unsigned int y0 = RasterCell( std::min( segment.mStart.y, end.y ) - reach, raster.mOrigin.y, raster.mCellSize, raster.mRowCount );
+		unsigned int y1 = RasterCell( std::max( segment.mStart.y, end.y ) + reach, raster.mOrigin.y, raster.mCellSize, raster.mRowCount );
+		for ( unsigned int y = y0; y <= y1; y++ )
+			for ( unsigned int x = x0; x <= x1; x++ ) {
+				Vector2D centre = raster.mOrigin + Vector2D( x + 0.5, y + 0.5 ) * raster.mCellSize;
+				if ( segment.DistanceSq( centre ) <= reach * reach )
+					entries.push_back( std::pair<uint32_t,int32_t>( y * raster.mColumnCount + x, l ) );
+			}
+
+	}
+	FillRasterRows( entries, cellCount, &raster.mLinkRowOffsets, &raster.mLinks );
+
+	entries.clear();
+	for ( size_t n = 0; n < mNodeSet.size(); n++ ) {
+
+		const Node &node = mNodeSet[n];
+		if ( node.mSize <= 0 )
+			continue;
+		Real reach = node.mSize + halfDiagonal;
+		unsigned int x0 = RasterCell( node.position.x - reach, raster.mOrigin.x, raster.mCellSize, raster.mColumnCount );
+		unsigned int x1 = RasterCell( node.position.x + reach, raster.mOrigin.x, raster.mCellSize, raster.mColumnCount );
+		unsigned int y0 = RasterCell( node.position.y - reach, raster.mOrigin.y, raster.mCellSize, raster.mRowCount );
+		unsigned int y1 = RasterCell( node.position.y + reach, raster.mOrigin.y, raster.mCellSize, raster.mRowCount );
+		for ( unsigned int y = y0; y <= y1; y++ )
+			for ( unsigned int x = x0; x <= x1; x++ ) {
+				Vector2D centre = raster.mOrigin + Vector2D( x + 0.5, y + 0.5 ) * raster.mCellSize;
+				if ( centre.DistanceSq( node.position ) <= reach * reach )
+					entries.push_back( std::pair<uint32_t,int32_t>( y * raster.mColumnCount + x, n ) );
+			}
+
+	}
+	FillRasterRows( entries, cellCount, &raster.mNodeRowOffsets, &raster.mNodes );
+
+	AddLoadTiming( "link raster", GetWallTime() - start );
+
 }
 
 
@@ -1035,62 +2093,75 @@ void UraeData::CollectBucketsInRange( VectorMath::Real r, VectorMath::Vector2D p
 
 
 
-UraeData::Classification UraeData::GetClassificationFromOneInternal( std::string internalName, int otherIndex, Vector2D txPos, Vector2D rxPos ) {
+UraeData::Classification UraeData::GetClassificationFromOneInternal( int internalNode, int otherIndex, Vector2D txPos, Vector2D rxPos ) {
 
-	LinkIndexSet *pSet;
-	bool isInternal = LinkIsInternal( internalName, &pSet );
+	const LinkIndexSet &links = mNodeSet[ internalNode ].mConnectedLinks;
+	const JunctionTable &table = mJunctionTable;
 
-	LinkIndexSet::iterator it;
-	Classification bestClass;
-	int internalIndex = -1;
+	const int32_t *pRowBegin = table.mLinks.data() + table.mLinkRowOffsets[ internalNode ];
+	const int32_t *pRowEnd   = table.mLinks.data() + table.mLinkRowOffsets[ internalNode + 1 ];
+	const int32_t *pOther = std::lower_bound( pRowBegin, pRowEnd, otherIndex );
+	if ( pOther != pRowEnd && *pOther == otherIndex )
+		return GetClassification( table.mLinkWinners[ pOther - table.mLinks.data() ], otherIndex );
 
+	Classification bestClass;
 	bestClass.mClassification = Classifier::OutOfRange;
-	for ( AllInVector( it, (*pSet) ) ) {
-
-		Classification c = GetClassification( *it, otherIndex );
-		if ( c.mClassification <= bestClass.mClassification ) {
-
-			bestClass = c;
-			internalIndex = *it;
-
+	bestClass.mFullNodeCount = INT_MAX;
+
+	// Pairs missing from the table may be classified from the graph, so search the connected links.
+	if ( m_pGraphClassifier ) {
+		LinkIndexSet::const_iterator it;
+		for ( AllInVector( it, links ) ) {
+			Classification c = GetClassification( *it, otherIndex );
+			if ( c.mClassification <= bestClass.mClassification )
+				bestClass = c;
 		}
-
+		return bestClass;
 	}
 
+	// Out of range of every connected link, so the search would have settled on the last of them.
+	if ( !links.empty() )
+		return GetClassification( links.back(), otherIndex );
+
 	return bestClass;
 
 }
 
 
-UraeData::Classification UraeData::GetClassificationFromInternalLinks( std::string txName, std::string rxName, Vector2D txPos, Vector2D rxPos ) {
+UraeData::Classification UraeData::GetClassificationFromInternalLinks( int txNode, int rxNode, Vector2D txPos, Vector2D rxPos ) {
 
-	LinkIndexSet *pTxSet, *pRxSet;
-	bool txIsInternal = LinkIsInternal( txName, &pTxSet );
-	bool rxIsInternal = LinkIsInternal( rxName, &pRxSet );
+	const LinkIndexSet &txLinks = mNodeSet[ txNode ].mConnectedLinks;
+	const LinkIndexSet &rxLinks = mNodeSet[ rxNode ].mConnectedLinks;
+	const JunctionTable &table = mJunctionTable;
 
-	LinkIndexSet::iterator txIt, rxIt;
-	Classification bestClass;
-	int txIndex = -1, rxIndex = -1;
+	const int32_t *pRowBegin = table.mNodes.data() + table.mNodeRowOffsets[ txNode ];
+	const int32_t *pRowEnd   = table.mNodes.data() + table.mNodeRowOffsets[ txNode + 1 ];
+	const int32_t *pOther = std::lower_bound( pRowBegin, pRowEnd, rxNode );
+	if ( pOther != pRowEnd && *pOther == rxNode ) {
+		const LinkPair &winner = table.mNodeWinners[ pOther - table.mNodes.data() ];
+		return GetClassification( winner.first, winner.second );
+	}
 
+	Classification bestClass;
 	bestClass.mClassification = Classifier::OutOfRange;
-
-	for ( AllInVector( txIt, (*pTxSet) ) ) {
-
-		for ( AllInVector( rxIt, (*pRxSet) ) ) {
-
-			Classification c = GetClassification( *txIt, *rxIt );
-			if ( c.mClassification <= bestClass.mClassification ) {
-
-				bestClass = c;
-				txIndex = *txIt;
-				rxIndex = *rxIt;
-
+	bestClass.mFullNodeCount = INT_MAX;
+
+	// Pairs missing from the table may be classified from the graph, so search the connected links.
+	if ( m_pGraphClassifier ) {
+		LinkIndexSet::const_iterator txIt, rxIt;
+		for ( AllInVector( txIt, txLinks ) ) {
+			for ( AllInVector( rxIt, rxLinks ) ) {
+				Classification c = GetClassification( *txIt, *rxIt );
+				if ( c.mClassification <= bestClass.mClassification )
+					bestClass = c;
 			}
-
 		}
-
+		return bestClass;
 	}
 
+	if ( !txLinks.empty() && !rxLinks.empty() )
+		return GetClassification( txLinks.back(), rxLinks.back() );
+
 	return bestClass;
 
 }
@@ -394,6 +394,20 @@ Real LineSegment::DistanceFromPoint(Vector2D p) {
 	return (p-(mStart + (mEnd-mStart)*t)).Magnitude();
 }
 
+Real LineSegment::DistanceFromSegment( LineSegment l ) {
+
+	if ( IntersectLine( l, NULL ) )
+		return 0;
+
+	// Otherwise the closest points include an end of one of the segments. A segment of no length is a point.
+	Real d = ( mStart == mEnd ) ? (l.mStart-mStart).Magnitude() : DistanceFromPoint( l.mStart );
+	d = MIN( d, ( mStart == mEnd ) ? (l.mEnd-mStart).Magnitude() : DistanceFromPoint( l.mEnd ) );
+	d = MIN( d, ( l.mStart == l.mEnd ) ? (mStart-l.mStart).Magnitude() : l.DistanceFromPoint( mStart ) );
+	d = MIN( d, ( l.mStart == l.mEnd ) ? (mEnd-l.mStart).Magnitude() : l.DistanceFromPoint( mEnd ) );
+	return d;
+
+}
+
 Real LineSegment::DistanceAlongLine( Vector2D p ) {
 
 	Vector2D n = GetVector().Unitise();